@@ -49,7 +49,7 @@ std::vector<float> FrequencyAdjustments(RiskScore& risk_score,
     while (exposure != exposures.end() &&
            timestep.end_time() > exposure->start_time) {
       risk_score.AddExposureNotification({.exposure = *exposure},
-                                         {.probability = 1.0});
+                                         {.probability = 1.0}, /*hops=*/1);
       exposure++;
     }
     adjustments.push_back(risk_score.GetVisitAdjustment(timestep, location_uuid)
@@ -168,7 +168,8 @@ TEST_F(RiskScoreTest, GetTestResult) {
           .time_requested = TimeFromDay(1),
           .time_received = TimeFromDay(2),
           .probability = 0.0,
-      });
+      },
+      /*hops=*/1);
   {
     // Negative results don't matter.
     TestResult result =
@@ -185,7 +186,8 @@ TEST_F(RiskScoreTest, GetTestResult) {
           .time_requested = TimeFromDay(2),
           .time_received = TimeFromDay(3),
           .probability = 1.0,
-      });
+      },
+      /*hops=*/1);
   {
     // On positive contact reports we perform a test, but if we're not sick
     // the result is negative.
@@ -203,7 +205,8 @@ TEST_F(RiskScoreTest, GetTestResult) {
           .time_requested = TimeFromDay(8),
           .time_received = TimeFromDay(9),
           .probability = 1.0,
-      });
+      },
+      /*hops=*/1);
   {
     // Another positive contact that is within the test validity period will
     // NOT cause another test.
@@ -223,7 +226,8 @@ TEST_F(RiskScoreTest, GetTestResult) {
           .time_requested = TimeFromDay(12),
           .time_received = TimeFromDay(13),
           .probability = 1.0,
-      });
+      },
+      /*hops=*/1);
   {
     // Another positive contact after the validity period expires will perform
     // another test.  This time it will report that we are sick since we
@@ -248,11 +252,13 @@ TEST_F(RiskScoreTest, GetsContactTracingPolicy) {
 
   risk_score->AddHealthStateTransistion(
       {.time = TimeFromDay(2), .health_state = HealthState::EXPOSED});
-  risk_score->AddExposureNotification({}, {
-                                              .time_requested = TimeFromDay(3),
-                                              .time_received = TimeFromDay(6),
-                                              .probability = 1.0,
-                                          });
+  risk_score->AddExposureNotification({},
+                                      {
+                                          .time_requested = TimeFromDay(3),
+                                          .time_received = TimeFromDay(6),
+                                          .probability = 1.0,
+                                      },
+                                      /*hops=*/1);
 
   // If the test isn't received yet (will be received on day 7) don't send.
   EXPECT_THAT(risk_score->GetContactTracingPolicy(
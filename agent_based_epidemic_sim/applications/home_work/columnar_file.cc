@@ -0,0 +1,277 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/columnar_file.h"
+
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+const int kMagicSize = 4;
+const int kHeaderSize = kMagicSize + sizeof(uint64);
+const int kTrailerSize = sizeof(uint32) + kMagicSize;
+
+int64 TimeToMicros(const absl::Time time) {
+  if (time == absl::InfiniteFuture()) return kint64max;
+  if (time == absl::InfinitePast()) return kint64min;
+  return absl::ToUnixMicros(time);
+}
+
+absl::Time MicrosToTime(const int64 micros) {
+  if (micros == kint64max) return absl::InfiniteFuture();
+  if (micros == kint64min) return absl::InfinitePast();
+  return absl::FromUnixMicros(micros);
+}
+
+template <typename T>
+void Append(const T value, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+std::vector<T> DecodeValues(absl::string_view data) {
+  std::vector<T> values(data.size() / sizeof(T));
+  std::memcpy(values.data(), data.data(), values.size() * sizeof(T));
+  return values;
+}
+
+// Reads fixed-width values from the front of a footer.
+class FooterReader {
+ public:
+  explicit FooterReader(absl::string_view footer) : footer_(footer) {}
+
+  template <typename T>
+  bool Read(T* value) {
+    if (footer_.size() < sizeof(T)) return false;
+    std::memcpy(value, footer_.data(), sizeof(T));
+    footer_.remove_prefix(sizeof(T));
+    return true;
+  }
+  bool ReadString(const int size, std::string* value) {
+    if (footer_.size() < size) return false;
+    *value = std::string(footer_.substr(0, size));
+    footer_.remove_prefix(size);
+    return true;
+  }
+
+ private:
+  absl::string_view footer_;
+};
+
+absl::Status CorruptFileError(absl::string_view what) {
+  return absl::Status(absl::StatusCode::kDataLoss,
+                      absl::StrCat("Corrupt columnar file: ", what));
+}
+
+}  // namespace
+
+ColumnarBlockWriter::ColumnarBlockWriter(const absl::Time time,
+                                         const int64 num_rows)
+    : time_(time), num_rows_(num_rows) {}
+
+void ColumnarBlockWriter::AddColumn(absl::string_view name,
+                                    const ColumnType type, const void* values,
+                                    const int64 size) {
+  DCHECK_LE(name.size(), 255) << "Column name too long: " << name;
+  columns_.push_back({std::string(name), type, data_.size()});
+  data_.append(static_cast<const char*>(values), size);
+}
+
+void ColumnarBlockWriter::AddInt64Column(absl::string_view name,
+                                         absl::Span<const int64> values) {
+  DCHECK_EQ(values.size(), num_rows_);
+  AddColumn(name, ColumnType::kInt64, values.data(),
+            values.size() * sizeof(int64));
+}
+
+void ColumnarBlockWriter::AddInt32Column(absl::string_view name,
+                                         absl::Span<const int32> values) {
+  DCHECK_EQ(values.size(), num_rows_);
+  AddColumn(name, ColumnType::kInt32, values.data(),
+            values.size() * sizeof(int32));
+}
+
+void ColumnarBlockWriter::AddFloatColumn(absl::string_view name,
+                                         absl::Span<const float> values) {
+  DCHECK_EQ(values.size(), num_rows_);
+  AddColumn(name, ColumnType::kFloat, values.data(),
+            values.size() * sizeof(float));
+}
+
+void ColumnarBlockWriter::AddTimeColumn(absl::string_view name,
+                                        absl::Span<const absl::Time> values) {
+  DCHECK_EQ(values.size(), num_rows_);
+  std::vector<uint32> indices;
+  indices.reserve(values.size());
+  for (const absl::Time time : values) {
+    const int64 micros = TimeToMicros(time);
+    const auto [iter, inserted] =
+        dictionary_indices_.try_emplace(micros, dictionary_.size());
+    if (inserted) dictionary_.push_back(micros);
+    indices.push_back(iter->second);
+  }
+  AddColumn(name, ColumnType::kTime, indices.data(),
+            indices.size() * sizeof(uint32));
+}
+
+std::string ColumnarBlockWriter::Finish() {
+  std::string block = std::move(data_);
+  const uint64 dictionary_offset = block.size();
+  block.append(reinterpret_cast<const char*>(dictionary_.data()),
+               dictionary_.size() * sizeof(int64));
+
+  std::string footer;
+  Append<int64>(TimeToMicros(time_), &footer);
+  Append<uint64>(num_rows_, &footer);
+  Append<uint64>(block.size(), &footer);
+  Append<uint64>(dictionary_offset, &footer);
+  Append<uint32>(dictionary_.size(), &footer);
+  Append<uint32>(columns_.size(), &footer);
+  for (const Column& column : columns_) {
+    Append<uint8>(static_cast<uint8>(column.type), &footer);
+    Append<uint8>(column.name.size(), &footer);
+    footer += column.name;
+    Append<uint64>(column.offset, &footer);
+  }
+  block += footer;
+  Append<uint32>(footer.size(), &block);
+  block.append(kColumnarMagic, kMagicSize);
+
+  std::string header(kColumnarMagic, kMagicSize);
+  Append<uint64>(block.size(), &header);
+  return header + block;
+}
+
+StatusOr<absl::string_view> ColumnarBlock::ColumnData(
+    absl::string_view name, const ColumnType type, const int width) const {
+  auto iter = columns_.find(name);
+  if (iter == columns_.end() || iter->second.type != type) {
+    return absl::Status(
+        absl::StatusCode::kNotFound,
+        absl::StrCat("No column of the requested type: ", name));
+  }
+  const uint64 offset = iter->second.offset;
+  if (offset > block_.size() || num_rows_ > (block_.size() - offset) / width) {
+    return CorruptFileError(absl::StrCat("column out of bounds: ", name));
+  }
+  return block_.substr(offset, num_rows_ * width);
+}
+
+StatusOr<std::vector<int64>> ColumnarBlock::Int64Column(
+    absl::string_view name) const {
+  auto data_or = ColumnData(name, ColumnType::kInt64, sizeof(int64));
+  if (!data_or.ok()) return data_or.status();
+  return DecodeValues<int64>(*data_or);
+}
+
+StatusOr<std::vector<int32>> ColumnarBlock::Int32Column(
+    absl::string_view name) const {
+  auto data_or = ColumnData(name, ColumnType::kInt32, sizeof(int32));
+  if (!data_or.ok()) return data_or.status();
+  return DecodeValues<int32>(*data_or);
+}
+
+StatusOr<std::vector<float>> ColumnarBlock::FloatColumn(
+    absl::string_view name) const {
+  auto data_or = ColumnData(name, ColumnType::kFloat, sizeof(float));
+  if (!data_or.ok()) return data_or.status();
+  return DecodeValues<float>(*data_or);
+}
+
+StatusOr<std::vector<absl::Time>> ColumnarBlock::TimeColumn(
+    absl::string_view name) const {
+  auto data_or = ColumnData(name, ColumnType::kTime, sizeof(uint32));
+  if (!data_or.ok()) return data_or.status();
+  std::vector<absl::Time> times;
+  times.reserve(num_rows_);
+  for (const uint32 index : DecodeValues<uint32>(*data_or)) {
+    if (index >= dictionary_.size()) {
+      return CorruptFileError(absl::StrCat("time out of range: ", name));
+    }
+    times.push_back(MicrosToTime(dictionary_[index]));
+  }
+  return times;
+}
+
+StatusOr<std::vector<ColumnarBlock>> ReadColumnarBlocks(
+    absl::string_view contents) {
+  const absl::string_view magic(kColumnarMagic, kMagicSize);
+  std::vector<ColumnarBlock> blocks;
+  while (!contents.empty()) {
+    if (!absl::StartsWith(magic, contents.substr(0, kMagicSize))) {
+      return CorruptFileError("missing header");
+    }
+    if (contents.size() < kHeaderSize) break;
+    uint64 size;
+    std::memcpy(&size, contents.data() + kMagicSize, sizeof(size));
+    // The rest of the file is a block still being written.
+    if (size > contents.size() - kHeaderSize) break;
+    const absl::string_view block_contents =
+        contents.substr(kHeaderSize, size);
+    contents.remove_prefix(kHeaderSize + size);
+
+    if (size < kTrailerSize ||
+        block_contents.substr(size - kMagicSize, kMagicSize) != magic) {
+      return CorruptFileError("missing footer");
+    }
+    uint32 footer_size;
+    std::memcpy(&footer_size, block_contents.data() + size - kTrailerSize,
+                sizeof(footer_size));
+    if (footer_size > size - kTrailerSize) {
+      return CorruptFileError("footer out of bounds");
+    }
+    const size_t footer_start = size - kTrailerSize - footer_size;
+    FooterReader footer(block_contents.substr(footer_start, footer_size));
+
+    ColumnarBlock& block = blocks.emplace_back();
+    int64 time;
+    uint64 data_size, dictionary_offset;
+    uint32 dictionary_size, num_columns;
+    if (!footer.Read(&time) || !footer.Read(&block.num_rows_) ||
+        !footer.Read(&data_size) || !footer.Read(&dictionary_offset) ||
+        !footer.Read(&dictionary_size) || !footer.Read(&num_columns)) {
+      return CorruptFileError("truncated footer");
+    }
+    if (data_size != footer_start || dictionary_offset > data_size ||
+        dictionary_size > (data_size - dictionary_offset) / sizeof(int64)) {
+      return CorruptFileError("block out of bounds");
+    }
+    block.time_ = MicrosToTime(time);
+    block.block_ = block_contents.substr(0, data_size);
+    block.dictionary_ = DecodeValues<int64>(block.block_.substr(
+        dictionary_offset, dictionary_size * sizeof(int64)));
+    for (uint32 i = 0; i < num_columns; ++i) {
+      uint8 type, name_size;
+      std::string name;
+      uint64 offset;
+      if (!footer.Read(&type) || !footer.Read(&name_size) ||
+          !footer.ReadString(name_size, &name) || !footer.Read(&offset)) {
+        return CorruptFileError("truncated footer");
+      }
+      if (type > static_cast<uint8>(ColumnType::kTime)) {
+        return CorruptFileError(absl::StrCat("unknown column type: ", type));
+      }
+      block.columns_[name] = {static_cast<ColumnType>(type), offset};
+    }
+  }
+  return blocks;
+}
+
+}  // namespace abesim
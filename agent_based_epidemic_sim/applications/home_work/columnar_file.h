@@ -0,0 +1,144 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_COLUMNAR_FILE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_COLUMNAR_FILE_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+// A columnar binary format for the learning observers' output, which can be
+// loaded without parsing text.
+//
+// A file is a sequence of blocks, normally one for each timestep written.  A
+// block starts with a header giving its size, and then holds a number of rows
+// as named, fixed-width columns stored one after another, then a dictionary of
+// the distinct times in the block, then a footer indexing the columns.  A file
+// that is still being appended to, or whose writer was interrupted, can be
+// read up to its last complete block.  Values are stored in the writer's byte
+// order, which is little-endian on every supported platform.
+//
+// Times are stored as 4-byte indices into the block's dictionary, whose
+// entries are microseconds since the Unix epoch, with kint64max and kint64min
+// standing for the infinite future and past.
+//
+// The header is laid out as:
+//   char magic[4]             kColumnarMagic
+//   uint64 block_size         bytes of the block after the header
+//
+// Offsets below are from the end of the header.  The footer ends the block,
+// and is laid out as:
+//   int64 time                the time of the block, encoded as above
+//   uint64 num_rows
+//   uint64 data_size          bytes of columns and dictionary before the footer
+//   uint64 dictionary_offset
+//   uint32 dictionary_size    entries
+//   uint32 num_columns
+//   num_columns times:
+//     uint8 type, uint8 name_size, char name[name_size],
+//     uint64 offset
+//   uint32 footer_size        bytes of the footer before this field
+//   char magic[4]             kColumnarMagic
+
+namespace abesim {
+
+inline constexpr char kColumnarMagic[] = "ABC1";
+
+// The formats the learning observers can write.
+enum class LearningOutputFormat { kCsv, kColumnar };
+
+enum class ColumnType : uint8 { kInt64, kInt32, kFloat, kTime };
+
+// Builds one block of a columnar file.  Every column must have num_rows
+// values, and column names must be distinct and at most 255 bytes long.
+class ColumnarBlockWriter {
+ public:
+  ColumnarBlockWriter(absl::Time time, int64 num_rows);
+
+  void AddInt64Column(absl::string_view name, absl::Span<const int64> values);
+  void AddInt32Column(absl::string_view name, absl::Span<const int32> values);
+  void AddFloatColumn(absl::string_view name, absl::Span<const float> values);
+  void AddTimeColumn(absl::string_view name,
+                     absl::Span<const absl::Time> values);
+
+  // Returns the encoded block, ready to be appended to a file.
+  std::string Finish();
+
+ private:
+  struct Column {
+    std::string name;
+    ColumnType type;
+    uint64 offset;
+  };
+  void AddColumn(absl::string_view name, ColumnType type, const void* values,
+                 int64 size);
+
+  const absl::Time time_;
+  const int64 num_rows_;
+  std::string data_;
+  std::vector<Column> columns_;
+  std::vector<int64> dictionary_;
+  absl::flat_hash_map<int64, uint32> dictionary_indices_;
+};
+
+// A block read from a columnar file.  It refers to the file's contents, which
+// must outlive it.
+class ColumnarBlock {
+ public:
+  absl::Time time() const { return time_; }
+  int64 num_rows() const { return num_rows_; }
+
+  // Each of these returns the named column, or an error if the block has no
+  // column of that name and type.
+  StatusOr<std::vector<int64>> Int64Column(absl::string_view name) const;
+  StatusOr<std::vector<int32>> Int32Column(absl::string_view name) const;
+  StatusOr<std::vector<float>> FloatColumn(absl::string_view name) const;
+  StatusOr<std::vector<absl::Time>> TimeColumn(absl::string_view name) const;
+
+ private:
+  friend StatusOr<std::vector<ColumnarBlock>> ReadColumnarBlocks(
+      absl::string_view contents);
+
+  struct Column {
+    ColumnType type;
+    uint64 offset;
+  };
+  StatusOr<absl::string_view> ColumnData(absl::string_view name,
+                                         ColumnType type, int width) const;
+
+  absl::Time time_;
+  int64 num_rows_ = 0;
+  absl::string_view block_;
+  absl::flat_hash_map<std::string, Column> columns_;
+  std::vector<int64> dictionary_;
+};
+
+// Parses the blocks of a columnar file, in the order they were written.  A
+// partial block at the end of contents, as a writer leaves while appending it,
+// is ignored.
+StatusOr<std::vector<ColumnarBlock>> ReadColumnarBlocks(
+    absl::string_view contents);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_COLUMNAR_FILE_H_
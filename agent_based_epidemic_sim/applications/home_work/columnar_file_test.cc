@@ -0,0 +1,136 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/columnar_file.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+using testing::ElementsAreArray;
+using testing::IsEmpty;
+using testing::SizeIs;
+
+absl::Time TestHour(const int hours) {
+  return absl::UnixEpoch() + absl::Hours(hours);
+}
+
+TEST(ColumnarFileTest, RoundTripsBlocks) {
+  const std::vector<int64> uuids = {1, 2, 3};
+  const std::vector<int32> states = {4, 5, 6};
+  const std::vector<float> values = {0.25f, 0.5f, 1.0f};
+  const std::vector<absl::Time> times = {TestHour(1) + absl::Microseconds(7),
+                                         absl::InfiniteFuture(), TestHour(1)};
+  ColumnarBlockWriter first(TestHour(0), 3);
+  first.AddInt64Column("uuid", uuids);
+  first.AddInt32Column("state", states);
+  first.AddFloatColumn("value", values);
+  first.AddTimeColumn("time", times);
+  ColumnarBlockWriter second(TestHour(24), 0);
+  second.AddInt64Column("uuid", {});
+  const std::string contents = first.Finish() + second.Finish();
+
+  const auto blocks_or = ReadColumnarBlocks(contents);
+  PANDEMIC_ASSERT_OK(blocks_or);
+  const std::vector<ColumnarBlock>& blocks = *blocks_or;
+  ASSERT_THAT(blocks, SizeIs(2));
+  EXPECT_EQ(blocks[0].time(), TestHour(0));
+  EXPECT_EQ(blocks[0].num_rows(), 3);
+  EXPECT_THAT(blocks[0].Int64Column("uuid"),
+              IsOkAndHolds(ElementsAreArray(uuids)));
+  EXPECT_THAT(blocks[0].Int32Column("state"),
+              IsOkAndHolds(ElementsAreArray(states)));
+  EXPECT_THAT(blocks[0].FloatColumn("value"),
+              IsOkAndHolds(ElementsAreArray(values)));
+  EXPECT_THAT(blocks[0].TimeColumn("time"),
+              IsOkAndHolds(ElementsAreArray(times)));
+  EXPECT_EQ(blocks[1].time(), TestHour(24));
+  EXPECT_THAT(blocks[1].Int64Column("uuid"), IsOkAndHolds(IsEmpty()));
+}
+
+TEST(ColumnarFileTest, EncodesTimesInADictionary) {
+  const std::vector<absl::Time> times(1000, TestHour(1));
+  ColumnarBlockWriter writer(TestHour(0), times.size());
+  writer.AddTimeColumn("time", times);
+  // The column holds an index for each row, and the dictionary one time.
+  EXPECT_LT(writer.Finish().size(), times.size() * sizeof(uint32) + 100);
+}
+
+TEST(ColumnarFileTest, ReportsMissingColumns) {
+  ColumnarBlockWriter writer(TestHour(0), 1);
+  writer.AddInt64Column("uuid", {1});
+  const std::string contents = writer.Finish();
+
+  const auto blocks_or = ReadColumnarBlocks(contents);
+  PANDEMIC_ASSERT_OK(blocks_or);
+  const std::vector<ColumnarBlock>& blocks = *blocks_or;
+  ASSERT_THAT(blocks, SizeIs(1));
+  EXPECT_THAT(blocks[0].Int64Column("other"),
+              StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(blocks[0].FloatColumn("uuid"),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(ColumnarFileTest, RejectsCorruptFiles) {
+  ColumnarBlockWriter writer(TestHour(0), 1);
+  writer.AddInt64Column("uuid", {1});
+  const std::string contents = writer.Finish();
+  std::string damaged_footer = contents;
+  damaged_footer.back() = '!';
+
+  EXPECT_THAT(ReadColumnarBlocks(""), IsOkAndHolds(IsEmpty()));
+  EXPECT_THAT(ReadColumnarBlocks(contents.substr(1)),
+              StatusIs(absl::StatusCode::kDataLoss));
+  EXPECT_THAT(ReadColumnarBlocks(damaged_footer),
+              StatusIs(absl::StatusCode::kDataLoss));
+  EXPECT_THAT(ReadColumnarBlocks(absl::StrCat("junk", contents)),
+              StatusIs(absl::StatusCode::kDataLoss));
+}
+
+TEST(ColumnarFileTest, ReadsCompleteBlocksBeforeATruncatedOne) {
+  ColumnarBlockWriter first(TestHour(0), 1);
+  first.AddInt64Column("uuid", {1});
+  ColumnarBlockWriter second(TestHour(24), 2);
+  second.AddInt64Column("uuid", {2, 3});
+  const std::string first_block = first.Finish();
+  const std::string contents = first_block + second.Finish();
+
+  for (int size = 0; size < contents.size(); ++size) {
+    // Blocks view the contents they were read from, so keep the prefix alive.
+    const std::string prefix = contents.substr(0, size);
+    const auto blocks_or = ReadColumnarBlocks(prefix);
+    PANDEMIC_ASSERT_OK(blocks_or);
+    if (size < first_block.size()) {
+      EXPECT_THAT(*blocks_or, IsEmpty()) << size;
+    } else {
+      ASSERT_THAT(*blocks_or, SizeIs(1)) << size;
+      EXPECT_THAT((*blocks_or)[0].Int64Column("uuid"),
+                  IsOkAndHolds(ElementsAre(1)));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace abesim
@@ -1,5 +1,7 @@
 #include "agent_based_epidemic_sim/applications/home_work/learning_contacts_observer.h"
 
+#include <vector>
+
 #include "absl/strings/str_cat.h"
 #include "absl/strings/substitute.h"
 #include "absl/types/span.h"
@@ -29,12 +31,32 @@ void LearningContactsObserver::Observe(
 }
 
 LearningContactsObserverFactory::LearningContactsObserverFactory(
-    absl::string_view output_pattern)
-    : output_pattern_(output_pattern) {}
+    absl::string_view output_pattern, const LearningOutputFormat format)
+    : output_pattern_(output_pattern), format_(format) {}
+
+LearningContactsObserverFactory::~LearningContactsObserverFactory() {
+  Close();
+}
+
+void LearningContactsObserverFactory::Close() {
+  if (columnar_writer_ == nullptr) return;
+  status_.Update(columnar_writer_->Close());
+  columnar_writer_.reset();
+}
 
 void LearningContactsObserverFactory::Aggregate(
     const Timestep& timestep,
     absl::Span<std::unique_ptr<LearningContactsObserver> const> observers) {
+  if (format_ == LearningOutputFormat::kColumnar) {
+    WriteColumnar(timestep, observers);
+  } else {
+    WriteCsv(timestep, observers);
+  }
+}
+
+void LearningContactsObserverFactory::WriteCsv(
+    const Timestep& timestep,
+    absl::Span<std::unique_ptr<LearningContactsObserver> const> observers) {
   const std::string csv_path_base = absl::StrCat(
       output_pattern_, "_", absl::FormatTime(timestep.start_time()));
   auto contacts_writer =
@@ -53,9 +75,51 @@ void LearningContactsObserverFactory::Aggregate(
   }
 }
 
+void LearningContactsObserverFactory::WriteColumnar(
+    const Timestep& timestep,
+    absl::Span<std::unique_ptr<LearningContactsObserver> const> observers) {
+  int64 num_rows = 0;
+  for (const auto& observer : observers) num_rows += observer->outcomes_.size();
+  std::vector<int64> source_uuids, sink_uuids, durations;
+  std::vector<absl::Time> start_times;
+  std::vector<float> infectivities;
+  source_uuids.reserve(num_rows);
+  sink_uuids.reserve(num_rows);
+  start_times.reserve(num_rows);
+  durations.reserve(num_rows);
+  infectivities.reserve(num_rows);
+  for (const auto& observer : observers) {
+    for (const auto& outcome : observer->outcomes_) {
+      source_uuids.push_back(outcome.source_uuid);
+      sink_uuids.push_back(outcome.agent_uuid);
+      start_times.push_back(outcome.exposure.start_time);
+      durations.push_back(absl::ToInt64Microseconds(outcome.exposure.duration));
+      infectivities.push_back(outcome.exposure.infectivity);
+    }
+  }
+  ColumnarBlockWriter block(timestep.start_time(), num_rows);
+  block.AddInt64Column("source_uuid", source_uuids);
+  block.AddInt64Column("sink_uuid", sink_uuids);
+  block.AddTimeColumn("start_time", start_times);
+  block.AddInt64Column("duration_micros", durations);
+  block.AddFloatColumn("infectivity", infectivities);
+  if (columnar_writer_ == nullptr) {
+    columnar_writer_ =
+        file::OpenOrDie(absl::StrCat(output_pattern_, "_contacts.columnar"));
+  }
+  status_.Update(columnar_writer_->WriteString(block.Finish()));
+  status_.Update(columnar_writer_->Flush());
+}
+
 std::unique_ptr<LearningContactsObserver>
 LearningContactsObserverFactory::MakeObserver(const Timestep& timestep) const {
   return absl::make_unique<LearningContactsObserver>();
 }
 
+bool LearningContactsObserverFactory::ResetObserver(
+    const Timestep& timestep, LearningContactsObserver* observer) const {
+  observer->outcomes_.clear();
+  return true;
+}
+
 }  // namespace abesim
@@ -3,12 +3,16 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "agent_based_epidemic_sim/applications/home_work/columnar_file.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
 
 namespace abesim {
 
@@ -24,25 +28,50 @@ class LearningContactsObserver : public AgentInfectionObserver {
  private:
   friend class LearningContactsObserverFactory;
 
-  std::list<InfectionOutcome> outcomes_;
+  std::vector<InfectionOutcome> outcomes_;
 };
 
 class LearningContactsObserverFactory
     : public ObserverFactory<LearningContactsObserver> {
  public:
-  explicit LearningContactsObserverFactory(absl::string_view output_pattern);
+  // In CSV format, each timestep's contacts are written to a separate file.
+  // In columnar format, they are written to one file, with a block for each
+  // timestep holding the columns source_uuid, sink_uuid, start_time,
+  // duration_micros and infectivity.
+  explicit LearningContactsObserverFactory(
+      absl::string_view output_pattern,
+      LearningOutputFormat format = LearningOutputFormat::kCsv);
+  ~LearningContactsObserverFactory() override;
 
   void Aggregate(const Timestep& timestep,
                  absl::Span<std::unique_ptr<LearningContactsObserver> const>
                      observers) override;
   std::unique_ptr<LearningContactsObserver> MakeObserver(
       const Timestep& timestep) const override;
+  bool ResetObserver(const Timestep& timestep,
+                     LearningContactsObserver* observer) const override;
+
+  // Closes the columnar output, if any.  Call this once the last timestep has
+  // been aggregated, before checking status().
+  void Close();
 
   absl::Status status() const { return status_; }
 
  private:
+  void WriteCsv(const Timestep& timestep,
+                absl::Span<std::unique_ptr<LearningContactsObserver> const>
+                    observers);
+  void WriteColumnar(
+      const Timestep& timestep,
+      absl::Span<std::unique_ptr<LearningContactsObserver> const> observers);
+
   absl::Status status_;
   std::string output_pattern_;
+  const LearningOutputFormat format_;
+  // The columnar output, opened when the first timestep is aggregated.  Each
+  // block is flushed as it is written, so the file can be read while the
+  // simulation runs.
+  std::unique_ptr<file::FileWriter> columnar_writer_;
 };
 
 }  // namespace abesim
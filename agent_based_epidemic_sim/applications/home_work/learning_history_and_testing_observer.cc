@@ -1,5 +1,7 @@
 #include "agent_based_epidemic_sim/applications/home_work/learning_history_and_testing_observer.h"
 
+#include <vector>
+
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/substitute.h"
@@ -19,23 +21,50 @@ LearningHistoryAndTestingObserver::LearningHistoryAndTestingObserver(
 
 void LearningHistoryAndTestingObserver::Observe(
     const Agent& agent, absl::Span<const InfectionOutcome> outcomes) {
-  HealthTransitionsAndTestResults output;
+  HealthTransitionsAndTestResults& output = history_and_tests_.emplace_back();
   output.agent_uuid = agent.uuid();
   for (const auto& health_transition : agent.HealthTransitions()) {
     output.health_transitions.push_back(health_transition);
   }
   output.test_results.push_back(agent.CurrentTestResult(timestep_));
-  history_and_tests_.push_back(output);
 }
 
+namespace {
+
+// Calls fn for each of the agent's health transitions that changes its
+// health state.
+template <typename Fn>
+void ForEachStateChange(const HealthTransitionsAndTestResults& history,
+                        const Fn& fn) {
+  HealthState::State last_state = HealthState::SUSCEPTIBLE;
+  for (const auto& health_transition : history.health_transitions) {
+    if (health_transition.health_state == last_state) continue;
+    fn(health_transition);
+    last_state = health_transition.health_state;
+  }
+}
+
+}  // namespace
+
 LearningHistoryAndTestingObserverFactory::
-    LearningHistoryAndTestingObserverFactory(absl::string_view output_pattern)
-    : output_pattern_(output_pattern) {}
+    LearningHistoryAndTestingObserverFactory(absl::string_view output_pattern,
+                                             const LearningOutputFormat format)
+    : output_pattern_(output_pattern), format_(format) {}
 
 void LearningHistoryAndTestingObserverFactory::Aggregate(
     const Timestep& timestep,
     absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
         observers) {
+  if (format_ == LearningOutputFormat::kColumnar) {
+    WriteColumnar(timestep, observers);
+  } else {
+    WriteCsv(observers);
+  }
+}
+
+void LearningHistoryAndTestingObserverFactory::WriteCsv(
+    absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+        observers) {
   auto history_writer =
       file::OpenOrDie(absl::StrCat(output_pattern_, "_history.csv"));
   auto tests_writer =
@@ -45,16 +74,11 @@ void LearningHistoryAndTestingObserverFactory::Aggregate(
       const auto agent_uuid = history_and_tests.agent_uuid;
       std::string history_line = absl::StrCat(agent_uuid);
       std::string test_line = absl::StrCat(agent_uuid);
-      HealthState::State last_state = HealthState::SUSCEPTIBLE;
-      for (const auto& health_transition :
-           history_and_tests.health_transitions) {
-        if (health_transition.health_state == last_state) {
-          continue;
-        }
-        absl::StrAppend(&history_line, ",", health_transition.health_state, ",",
-                        absl::FormatTime(health_transition.time));
-        last_state = health_transition.health_state;
-      }
+      ForEachStateChange(
+          history_and_tests, [&history_line](const HealthTransition& change) {
+            absl::StrAppend(&history_line, ",", change.health_state, ",",
+                            absl::FormatTime(change.time));
+          });
       for (const auto& test_result : history_and_tests.test_results) {
         absl::StrAppend(&test_line, ",", test_result.probability, ",",
                         absl::FormatTime(test_result.time_received));
@@ -67,10 +91,62 @@ void LearningHistoryAndTestingObserverFactory::Aggregate(
   }
 }
 
+void LearningHistoryAndTestingObserverFactory::WriteColumnar(
+    const Timestep& timestep,
+    absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+        observers) {
+  std::vector<int64> history_uuids, test_uuids;
+  std::vector<int32> health_states;
+  std::vector<absl::Time> transition_times, test_times;
+  std::vector<float> probabilities;
+  for (const auto& observer : observers) {
+    for (const auto& history_and_tests : observer->history_and_tests_) {
+      const int64 agent_uuid = history_and_tests.agent_uuid;
+      ForEachStateChange(history_and_tests,
+                         [&](const HealthTransition& change) {
+                           history_uuids.push_back(agent_uuid);
+                           health_states.push_back(change.health_state);
+                           transition_times.push_back(change.time);
+                         });
+      for (const auto& test_result : history_and_tests.test_results) {
+        test_uuids.push_back(agent_uuid);
+        probabilities.push_back(test_result.probability);
+        test_times.push_back(test_result.time_received);
+      }
+    }
+  }
+
+  ColumnarBlockWriter history(timestep.start_time(), history_uuids.size());
+  history.AddInt64Column("agent_uuid", history_uuids);
+  history.AddInt32Column("health_state", health_states);
+  history.AddTimeColumn("time", transition_times);
+  auto history_writer =
+      file::OpenOrDie(absl::StrCat(output_pattern_, "_history.columnar"));
+  status_.Update(history_writer->WriteString(history.Finish()));
+  status_.Update(history_writer->Close());
+
+  ColumnarBlockWriter tests(timestep.start_time(), test_uuids.size());
+  tests.AddInt64Column("agent_uuid", test_uuids);
+  tests.AddFloatColumn("probability", probabilities);
+  tests.AddTimeColumn("time_received", test_times);
+  auto tests_writer =
+      file::OpenOrDie(absl::StrCat(output_pattern_, "_tests.columnar"));
+  status_.Update(tests_writer->WriteString(tests.Finish()));
+  status_.Update(tests_writer->Close());
+}
+
 std::unique_ptr<LearningHistoryAndTestingObserver>
 LearningHistoryAndTestingObserverFactory::MakeObserver(
     const Timestep& timestep) const {
   return absl::make_unique<LearningHistoryAndTestingObserver>(timestep);
 }
 
+bool LearningHistoryAndTestingObserverFactory::ResetObserver(
+    const Timestep& timestep,
+    LearningHistoryAndTestingObserver* observer) const {
+  observer->timestep_ = timestep;
+  observer->history_and_tests_.clear();
+  return true;
+}
+
 }  // namespace abesim
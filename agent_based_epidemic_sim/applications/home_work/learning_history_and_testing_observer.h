@@ -7,7 +7,9 @@
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "agent_based_epidemic_sim/applications/home_work/columnar_file.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/observer.h"
@@ -32,15 +34,20 @@ class LearningHistoryAndTestingObserver : public AgentInfectionObserver {
  private:
   friend class LearningHistoryAndTestingObserverFactory;
 
-  const Timestep timestep_;
+  Timestep timestep_;
   std::vector<HealthTransitionsAndTestResults> history_and_tests_;
 };
 
 class LearningHistoryAndTestingObserverFactory
     : public ObserverFactory<LearningHistoryAndTestingObserver> {
  public:
+  // In columnar format, the history file has a row for each health
+  // transition, with the columns agent_uuid, health_state and time, and the
+  // tests file a row for each test, with the columns agent_uuid, probability
+  // and time_received.
   explicit LearningHistoryAndTestingObserverFactory(
-      absl::string_view output_pattern);
+      absl::string_view output_pattern,
+      LearningOutputFormat format = LearningOutputFormat::kCsv);
 
   void Aggregate(
       const Timestep& timestep,
@@ -48,12 +55,24 @@ class LearningHistoryAndTestingObserverFactory
           observers) override;
   std::unique_ptr<LearningHistoryAndTestingObserver> MakeObserver(
       const Timestep& timestep) const override;
+  bool ResetObserver(
+      const Timestep& timestep,
+      LearningHistoryAndTestingObserver* observer) const override;
 
   absl::Status status() const { return status_; }
 
  private:
+  void WriteCsv(
+      absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+          observers);
+  void WriteColumnar(
+      const Timestep& timestep,
+      absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+          observers);
+
   absl::Status status_;
   std::string output_pattern_;
+  const LearningOutputFormat format_;
 };
 
 }  // namespace abesim
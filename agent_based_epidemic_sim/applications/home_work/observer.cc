@@ -14,75 +14,66 @@
 
 #include "agent_based_epidemic_sim/applications/home_work/observer.h"
 
+#include <algorithm>
 #include <initializer_list>
 
 #include "absl/strings/str_format.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/port/logging.h"
 #include "agent_based_epidemic_sim/port/proto_enum_utils.h"
 
 namespace abesim {
 
-namespace {
-
-// Very simple histogram class with powers of two bucket sizes.
-template <typename T, int Size>
-class Histogram {
- public:
-  explicit Histogram() { buckets_.fill(0); }
-
-  void Add(T value, T scale) {
-    const size_t n = static_cast<size_t>(value / scale);
-    const size_t index = n == 0 ? 0 : 1 + std::floor(std::log2(n));
-    const size_t bucket = std::min(index, buckets_.size() - 1);
-    buckets_[bucket]++;
-  }
-
-  void AppendValuesToString(std::string* dst) const {
-    for (int bucket : buckets_) {
-      absl::StrAppendFormat(dst, ",%d", bucket);
-    }
-  }
-
- private:
-  std::array<size_t, Size> buckets_;
-};
-
-const int kDurationBuckets = 6;
-const int kContactBuckets = 10;
-
-}  // namespace
-
 HomeWorkSimulationObserver::HomeWorkSimulationObserver(
-    LocationTypeFn location_type)
-    : location_type_(std::move(location_type)) {
+    LocationTypeFn location_type, const UuidIndex* const agent_index)
+    : location_type_(std::move(location_type)), agent_index_(agent_index) {
   health_state_counts_.fill(0);
 }
 
 void HomeWorkSimulationObserver::Observe(
     const Agent& agent, absl::Span<const InfectionOutcome> outcomes) {
   health_state_counts_[agent.CurrentHealthState()]++;
-  auto& visitor_contacts = contacts_[agent.uuid()];
-  for (const InfectionOutcome outcome : outcomes) {
+  contacts_.clear();
+  for (const InfectionOutcome& outcome : outcomes) {
     if (outcome.exposure_type == InfectionOutcomeProto::CONTACT) {
-      visitor_contacts.insert(outcome.source_uuid);
+      contacts_.push_back(outcome.source_uuid);
     }
   }
+  if (contacts_.empty()) return;
+  std::sort(contacts_.begin(), contacts_.end());
+  const int distinct = std::unique(contacts_.begin(), contacts_.end()) -
+                       contacts_.begin();
+  contact_histogram_.Add(distinct - 1, 1);
 }
+void HomeWorkSimulationObserver::Reset() {
+  health_state_counts_.fill(0);
+  durations_.clear();
+  contact_histogram_ = Histogram<size_t, kContactBuckets>();
+}
+
 void HomeWorkSimulationObserver::Observe(const Location& location,
                                          const absl::Span<const Visit> visits) {
+  const LocationType location_type = location_type_(location.uuid());
   for (const Visit& visit : visits) {
-    agent_location_type_durations_[visit.agent_uuid]
-                                  [location_type_(visit.location_uuid)] +=
-        visit.end_time - visit.start_time;
+    const int agent_index = agent_index_->Find(visit.agent_uuid);
+    DCHECK_NE(agent_index, -1) << "Unknown agent " << visit.agent_uuid;
+    if (agent_index == -1) continue;
+    durations_.push_back({.agent_index = agent_index,
+                          .location_type = location_type,
+                          .duration = visit.end_time - visit.start_time});
   }
 }
 
 HomeWorkSimulationObserverFactory::HomeWorkSimulationObserverFactory(
     file::FileWriter* const output, LocationTypeFn location_type,
+    const absl::Span<const int64> agent_uuids,
     const std::vector<std::pair<std::string, std::string>>& pass_through_fields)
-    : output_(output), location_type_(std::move(location_type)) {
+    : output_(output),
+      location_type_(std::move(location_type)),
+      agent_index_(agent_uuids) {
   std::string headers;
   if (!pass_through_fields.empty()) {
     for (const auto& field : pass_through_fields) {
@@ -112,25 +103,24 @@ void HomeWorkSimulationObserverFactory::Aggregate(
     const Timestep& timestep,
     absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const> observers) {
   health_state_counts_.fill(0);
-  agent_location_type_durations_.clear();
-  contacts_.clear();
+  LocationArray<absl::Duration> zero;
+  zero.fill(absl::ZeroDuration());
+  agent_location_type_durations_.assign(agent_index_.size(), zero);
+  Histogram<size_t, kContactBuckets> contact_histogram;
   int agents = 0;
 
-  for (auto& observer : observers) {
+  for (const auto& observer : observers) {
     for (HealthState::State state : EnumerateEnumValues<HealthState::State>()) {
       int n = observer->health_state_counts_[state];
       health_state_counts_[state] += n;
       agents += n;
     }
-    for (auto iter : observer->agent_location_type_durations_) {
-      for (LocationType location_type : kAllLocationTypes) {
-        agent_location_type_durations_[iter.first][location_type] +=
-            iter.second[location_type];
-      }
-    }
-    for (auto iter : observer->contacts_) {
-      contacts_[iter.first].insert(iter.second.begin(), iter.second.end());
+    for (const auto& duration : observer->durations_) {
+      agent_location_type_durations_[duration.agent_index]
+                                    [duration.location_type] +=
+          duration.duration;
     }
+    contact_histogram.Merge(observer->contact_histogram_);
   }
 
   std::string line = data_prefix_;
@@ -141,21 +131,16 @@ void HomeWorkSimulationObserverFactory::Aggregate(
   }
 
   LocationArray<Histogram<absl::Duration, kDurationBuckets>> location_histogram;
-  for (const auto iter : agent_location_type_durations_) {
+  for (const auto& durations : agent_location_type_durations_) {
     for (LocationType i : kAllLocationTypes) {
-      if (iter.second[i] == absl::ZeroDuration()) continue;
-      location_histogram[i].Add(iter.second[i], absl::Hours(1));
+      if (durations[i] == absl::ZeroDuration()) continue;
+      location_histogram[i].Add(durations[i], absl::Hours(1));
     }
   }
   for (const auto& location_type : location_histogram) {
     location_type.AppendValuesToString(&line);
   }
 
-  Histogram<size_t, kContactBuckets> contact_histogram;
-  for (const auto& iter : contacts_) {
-    if (iter.second.empty()) continue;
-    contact_histogram.Add(iter.second.size() - 1, 1);
-  }
   contact_histogram.AppendValuesToString(&line);
 
   line += "\n";
@@ -165,7 +150,14 @@ void HomeWorkSimulationObserverFactory::Aggregate(
 std::unique_ptr<HomeWorkSimulationObserver>
 HomeWorkSimulationObserverFactory::MakeObserver(
     const Timestep& timestep) const {
-  return absl::make_unique<HomeWorkSimulationObserver>(location_type_);
+  return absl::make_unique<HomeWorkSimulationObserver>(location_type_,
+                                                       &agent_index_);
+}
+
+bool HomeWorkSimulationObserverFactory::ResetObserver(
+    const Timestep& timestep, HomeWorkSimulationObserver* observer) const {
+  observer->Reset();
+  return true;
 }
 
 }  // namespace abesim
@@ -17,13 +17,20 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_OBSERVER_H_
 #define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_OBSERVER_H_
 
-#include "absl/container/flat_hash_map.h"
-#include "absl/container/flat_hash_set.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/applications/home_work/location_type.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/uuid_index.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
 
 namespace abesim {
@@ -35,24 +42,73 @@ template <typename T>
 using LocationArray =
     EnumIndexedArray<T, LocationType, kAllLocationTypes.size()>;
 
+// Very simple histogram class with powers of two bucket sizes.
+template <typename T, int Size>
+class Histogram {
+ public:
+  explicit Histogram() { buckets_.fill(0); }
+
+  void Add(T value, T scale) {
+    const size_t n = static_cast<size_t>(value / scale);
+    const size_t index = n == 0 ? 0 : 1 + std::floor(std::log2(n));
+    const size_t bucket = std::min(index, buckets_.size() - 1);
+    buckets_[bucket]++;
+  }
+
+  void Merge(const Histogram& other) {
+    for (int i = 0; i < Size; ++i) buckets_[i] += other.buckets_[i];
+  }
+
+  void AppendValuesToString(std::string* dst) const {
+    for (int bucket : buckets_) {
+      absl::StrAppendFormat(dst, ",%d", bucket);
+    }
+  }
+
+ private:
+  std::array<size_t, Size> buckets_;
+};
+
+inline constexpr int kDurationBuckets = 6;
+inline constexpr int kContactBuckets = 10;
+
+// Each agent is observed once per timestep, so the observer histograms its
+// distinct contacts as it goes.  Visits to an agent's home and work may be
+// observed by different observers, so those are recorded by the agent's dense
+// index and summed when the observers are aggregated.
 class HomeWorkSimulationObserver : public AgentInfectionObserver,
                                    public LocationVisitObserver {
  public:
-  explicit HomeWorkSimulationObserver(LocationTypeFn location_type);
+  // agent_index must outlive the observer.
+  HomeWorkSimulationObserver(LocationTypeFn location_type,
+                             const UuidIndex* agent_index);
 
   void Observe(const Agent& agent,
                absl::Span<const InfectionOutcome> outcomes) override;
   void Observe(const Location& location,
                absl::Span<const Visit> visits) override;
 
+  // Forgets all observations, keeping the capacity of the observer's
+  // buffers.
+  void Reset();
+
  private:
   friend class HomeWorkSimulationObserverFactory;
 
+  // The time an agent spent at a location of the given type.
+  struct AgentDuration {
+    int agent_index;
+    LocationType location_type;
+    absl::Duration duration;
+  };
+
   const LocationTypeFn location_type_;
+  const UuidIndex* const agent_index_;
   HealthArray<int> health_state_counts_;
-  absl::flat_hash_map<int64, LocationArray<absl::Duration>>
-      agent_location_type_durations_;
-  absl::flat_hash_map<int64, absl::flat_hash_set<int64>> contacts_;
+  std::vector<AgentDuration> durations_;
+  Histogram<size_t, kContactBuckets> contact_histogram_;
+  // Scratch space for finding an agent's distinct contacts.
+  std::vector<int64> contacts_;
 };
 
 // This aggregator assumes single node execution.
@@ -61,12 +117,14 @@ class HomeWorkSimulationObserverFactory
  public:
   // Creates a new HomeWorkSimulationObserverFactory that will write to file.
   // The given location_type function will be used to distinguish different
-  // types of locations based on the uuid of the location.
+  // types of locations based on the uuid of the location.  agent_uuids are
+  // the uuids of every agent in the simulation.
   // Use pass_through_fields to append a set of field values to every line
   // of the csv output, each entry is a pair of {field_name, field_value}.
-  explicit HomeWorkSimulationObserverFactory(
+  HomeWorkSimulationObserverFactory(
       file::FileWriter* output,
       std::function<LocationType(int64)> location_type,
+      absl::Span<const int64> agent_uuids,
       const std::vector<std::pair<std::string, std::string>>&
           pass_through_fields);
 
@@ -75,6 +133,8 @@ class HomeWorkSimulationObserverFactory
                      observers) override;
   std::unique_ptr<HomeWorkSimulationObserver> MakeObserver(
       const Timestep& timestep) const override;
+  bool ResetObserver(const Timestep& timestep,
+                     HomeWorkSimulationObserver* observer) const override;
 
   absl::Status status() const { return status_; }
 
@@ -83,11 +143,12 @@ class HomeWorkSimulationObserverFactory
   const LocationTypeFn location_type_;
   std::string data_prefix_;
 
+  const UuidIndex agent_index_;
+
   absl::Status status_;
   HealthArray<int> health_state_counts_;
-  absl::flat_hash_map<int64, LocationArray<absl::Duration>>
-      agent_location_type_durations_;
-  absl::flat_hash_map<int64, absl::flat_hash_set<int64>> contacts_;
+  // Indexed by the agents' dense indices in agent_index_.
+  std::vector<LocationArray<absl::Duration>> agent_location_type_durations_;
 };
 
 }  // namespace abesim
@@ -37,6 +37,8 @@ class MemFileWriterImpl : public file::FileWriter {
     return absl::OkStatus();
   }
 
+  absl::Status Flush() override { return absl::OkStatus(); }
+
   absl::Status Close() override { return absl::OkStatus(); }
 
  private:
@@ -107,6 +109,8 @@ std::unique_ptr<MockLocation> MakeLocation(int64 uuid) {
   return location;
 }
 
+const std::vector<int64> kAgentUuids = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
 absl::Time TestHour(int hours) {
   return absl::UnixEpoch() + absl::Hours(hours);
 }
@@ -123,6 +127,7 @@ TEST(HomeWorkSimulationObserverTest, ZerosReturnedForNoObservations) {
         [](int64 uuid) {
           return uuid == 0 ? LocationType::kHome : LocationType::kWork;
         },
+        kAgentUuids,
         {});
     std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
     Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
@@ -140,6 +145,45 @@ TEST(HomeWorkSimulationObserverTest, ZerosReturnedForNoObservations) {
   PANDEMIC_ASSERT_OK(file->Close());
 }
 
+TEST(HomeWorkSimulationObserverTest, ResetObserversReportNoObservations) {
+  Timestep t(absl::UnixEpoch(), absl::Hours(24));
+
+  std::string output;
+  auto file = absl::make_unique<MemFileWriterImpl>(&output);
+
+  {
+    HomeWorkSimulationObserverFactory observer_factory(
+        file.get(),
+        [](int64 uuid) {
+          return uuid == 0 ? LocationType::kHome : LocationType::kWork;
+        },
+        kAgentUuids,
+        {});
+    std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
+    observers.push_back(observer_factory.MakeObserver(t));
+    auto home = MakeLocation(0);
+    observers[0]->Observe(
+        *MakeAgent(1, HealthState::INFECTIOUS),
+        {{.agent_uuid = 1,
+          .exposure_type = InfectionOutcomeProto::CONTACT,
+          .source_uuid = 2}});
+    observers[0]->Observe(*home, {{.location_uuid = 0,
+                                   .agent_uuid = 1,
+                                   .start_time = TestHour(0),
+                                   .end_time = TestHour(8)}});
+    EXPECT_TRUE(observer_factory.ResetObserver(t, observers[0].get()));
+    observer_factory.Aggregate(t, observers);
+
+    std::string expected = kExpectedHeaders;
+    expected +=
+        "86400,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+        "0,0,0,0,0,0,0,0,0\n";
+    EXPECT_EQ(output, expected);
+  }
+
+  PANDEMIC_ASSERT_OK(file->Close());
+}
+
 TEST(HomeWorkSimulationObserverTest, PassthroughFields) {
   Timestep t(absl::UnixEpoch(), absl::Hours(24));
 
@@ -154,6 +198,7 @@ TEST(HomeWorkSimulationObserverTest, PassthroughFields) {
         [](int64 uuid) {
           return uuid == 0 ? LocationType::kHome : LocationType::kWork;
         },
+        kAgentUuids,
         passthrough);
     std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
     Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
@@ -183,6 +228,7 @@ TEST(HomeWorkSimulationObserverTest, CorrectValuesForObservations) {
         [](int64 uuid) {
           return uuid == 0 ? LocationType::kHome : LocationType::kWork;
         },
+        kAgentUuids,
         {});
     std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
     Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
@@ -40,7 +40,8 @@ class TogglingRiskScore : public RiskScore {
   void AddHealthStateTransistion(HealthTransition transition) override {}
   void AddExposures(absl::Span<const Exposure* const> exposures) override {}
   void AddExposureNotification(const Contact& contact,
-                               const TestResult& result) override {}
+                               const TestResult& result,
+                               const int hops) override {}
 
   VisitAdjustment GetVisitAdjustment(const Timestep& timestep,
                                      const int64 location_uuid) const override {
@@ -16,12 +16,15 @@
 
 #include <queue>
 #include <string>
+#include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/agent_synthesis/shuffled_sampler.h"
+#include "agent_based_epidemic_sim/applications/home_work/columnar_file.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
 #include "agent_based_epidemic_sim/applications/home_work/learning_contacts_observer.h"
 #include "agent_based_epidemic_sim/applications/home_work/learning_history_and_testing_observer.h"
@@ -29,12 +32,14 @@
 #include "agent_based_epidemic_sim/applications/home_work/risk_score.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/coalescing_location.h"
 #include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
 #include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
 #include "agent_based_epidemic_sim/core/ptts_transition_model.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
+#include "agent_based_epidemic_sim/core/sampled_contact_location.h"
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 #include "agent_based_epidemic_sim/core/simulation.h"
 #include "agent_based_epidemic_sim/core/uuid_generator.h"
@@ -271,12 +276,53 @@ void RunSimulation(
                 agent.population_profile_id()))),
         policy_generator->NextRiskScore()));
   }
+  // The learning observers need every contact.
+  const auto contact_mode =
+      config.infectious_contacts_only() && learning_output_base.empty()
+          ? LocationDiscreteEventSimulator::ContactMode::kInfectiousContactsOnly
+          : LocationDiscreteEventSimulator::ContactMode::kAllContacts;
+  if (config.infectious_contacts_only() && !learning_output_base.empty()) {
+    LOG(WARNING) << "Ignoring infectious_contacts_only, since learning output "
+                    "requires all contacts.";
+  }
+  const bool sample_contacts =
+      config.sampled_contacts_occupancy_threshold() > 0 &&
+      learning_output_base.empty();
+  if (config.sampled_contacts_occupancy_threshold() > 0 &&
+      !learning_output_base.empty()) {
+    LOG(WARNING) << "Ignoring sampled_contacts_occupancy_threshold, since "
+                    "learning output requires all contacts.";
+  }
+  const bool coalesce_contacts =
+      config.coalesce_contacts() && learning_output_base.empty();
+  if (config.coalesce_contacts() && !learning_output_base.empty()) {
+    LOG(WARNING) << "Ignoring coalesce_contacts, since learning output "
+                    "requires unmerged contacts.";
+  }
+  SampledContactLocation::Options sampling_options;
+  sampling_options.occupancy_threshold =
+      config.sampled_contacts_occupancy_threshold();
+  if (config.sampled_contacts_per_visit() > 0) {
+    sampling_options.contacts_per_visit = config.sampled_contacts_per_visit();
+  }
+  sampling_options.contact_mode = contact_mode;
   MicroExposureGeneratorBuilder meg_builder;
   std::vector<std::unique_ptr<Location>> location_des;
   location_des.reserve(context.locations.size());
   for (const auto& location : context.locations) {
-    location_des.push_back(absl::make_unique<LocationDiscreteEventSimulator>(
-        location.reference().uuid(), meg_builder.Build()));
+    std::unique_ptr<Location> location_des_entry;
+    if (sample_contacts) {
+      location_des_entry = absl::make_unique<SampledContactLocation>(
+          location.reference().uuid(), meg_builder, sampling_options);
+    } else {
+      location_des_entry = absl::make_unique<LocationDiscreteEventSimulator>(
+          location.reference().uuid(), meg_builder.Build(), contact_mode);
+    }
+    if (coalesce_contacts) {
+      location_des_entry = absl::make_unique<CoalescingLocation>(
+          std::move(location_des_entry), config.transmissibility());
+    }
+    location_des.push_back(std::move(location_des_entry));
   }
   // Initializes Simulation.
   auto sim = num_workers > 1
@@ -290,22 +336,29 @@ void RunSimulation(
   // TODO: Check if file exists.
   std::unique_ptr<file::FileWriter> output_file =
       file::OpenOrDie(output_file_path);
+  std::vector<int64> agent_uuids;
+  agent_uuids.reserve(context.agents.size());
+  for (const auto& agent : context.agents) agent_uuids.push_back(agent.uuid());
   HomeWorkSimulationObserverFactory observer_factory(
-      output_file.get(), context.location_type, passthrough);
+      output_file.get(), context.location_type, agent_uuids, passthrough);
   sim->AddObserverFactory(&observer_factory);
+  const LearningOutputFormat learning_output_format =
+      config.columnar_learning_output() ? LearningOutputFormat::kColumnar
+                                        : LearningOutputFormat::kCsv;
   LearningContactsObserverFactory learning_contacts_observer_factory(
-      learning_output_base);
+      learning_output_base, learning_output_format);
   if (!learning_output_base.empty()) {
     sim->AddObserverFactory(&learning_contacts_observer_factory);
   }
   sim->Step(config.num_steps() - 1, step_size);
   // Do the last step to get agent history and tests.
   LearningHistoryAndTestingObserverFactory hist_and_test_observer_factory(
-      learning_output_base);
+      learning_output_base, learning_output_format);
   if (!learning_output_base.empty()) {
     sim->AddObserverFactory(&hist_and_test_observer_factory);
   }
   sim->Step(1, step_size);
+  learning_contacts_observer_factory.Close();
   LOG(INFO) << observer_factory.status();
   LOG(INFO) << learning_contacts_observer_factory.status();
   LOG(INFO) << hist_and_test_observer_factory.status();
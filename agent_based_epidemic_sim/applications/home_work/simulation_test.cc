@@ -17,6 +17,7 @@
 #include "absl/flags/flag.h"
 #include "absl/strings/str_split.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/applications/home_work/columnar_file.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
 #include "agent_based_epidemic_sim/core/parse_text_proto.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
@@ -72,5 +73,41 @@ TEST(SimulationTest, RunsSimulation) {
   EXPECT_EQ(kExpectedContentsLength, first_row.size());
 }
 
+TEST(SimulationTest, WritesColumnarLearningOutput) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_num_steps(2);
+  config.set_columnar_learning_output(true);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "columnar_output.csv");
+  const std::string learning_output_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "learning");
+  RunSimulation(output_file_path, learning_output_base, config,
+                /*num_workers=*/1);
+
+  std::string contacts;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(learning_output_base, "_contacts.columnar"), &contacts));
+  const auto contact_blocks = ReadColumnarBlocks(contacts);
+  PANDEMIC_ASSERT_OK(contact_blocks);
+  // A block for each step.
+  ASSERT_EQ(contact_blocks->size(), 2);
+  EXPECT_LT((*contact_blocks)[0].time(), (*contact_blocks)[1].time());
+  PANDEMIC_EXPECT_OK((*contact_blocks)[0].TimeColumn("start_time"));
+
+  std::string tests;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(learning_output_base, "_tests.columnar"), &tests));
+  const auto test_blocks = ReadColumnarBlocks(tests);
+  PANDEMIC_ASSERT_OK(test_blocks);
+  ASSERT_EQ(test_blocks->size(), 1);
+  // A test result for every agent.
+  EXPECT_EQ((*test_blocks)[0].num_rows(), config.population_size());
+  PANDEMIC_EXPECT_OK((*test_blocks)[0].FloatColumn("probability"));
+}
+
 }  // namespace
 }  // namespace abesim
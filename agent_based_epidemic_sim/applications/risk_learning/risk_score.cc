@@ -55,7 +55,8 @@ class LearningRiskScore : public RiskScore {
   }
   void AddExposures(absl::Span<const Exposure* const> exposures) override {}
   void AddExposureNotification(const Contact& contact,
-                               const TestResult& result) override {
+                               const TestResult& result,
+                               const int hops) override {
     // We don't take action on negative tests.
     if (result.probability < 1.0) return;
 
@@ -17,6 +17,9 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_AGENT_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_AGENT_H_
 
+#include <memory>
+#include <vector>
+
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
@@ -28,6 +31,9 @@
 
 namespace abesim {
 
+class AgentGroup;
+class AgentInfectionObserver;
+
 // A simulated agent. Represents an individual that travels to locations and
 // has a health state.
 // Possibly, ComputeVisits should be separated from ProcessInfectionOutcomes
@@ -78,15 +84,59 @@ class Agent {
       const Timestep& timestep, absl::Span<const ContactReport> symptom_reports,
       Broker<ContactReport>* contact_broker) = 0;
 
+  // Returns true if the agent has nothing to do in the given timestep other
+  // than compute its visits, provided it receives no InfectionOutcomes and no
+  // ContactReports.  That is, calling ProcessInfectionOutcomes and
+  // UpdateContactReports with no messages would neither change the agent's
+  // state nor send any ContactReports.  The simulation skips those calls for
+  // quiescent agents without messages.  Agents that do not implement this are
+  // never quiescent.
+  virtual bool IsQuiescent(const Timestep& timestep) const { return false; }
+
+  // Appends the uuids of every location the agent may ever visit to
+  // location_uuids and returns true, or returns false if the agent may visit
+  // any location.  Simulations may use this to process a location as soon as
+  // every agent that may visit it has computed its visits.
+  virtual bool GetPossibleLocations(std::vector<int64>* location_uuids) const {
+    return false;
+  }
+
   virtual HealthState::State CurrentHealthState() const = 0;
 
   virtual TestResult CurrentTestResult(const Timestep& timestep) const = 0;
 
   virtual absl::Span<const HealthTransition> HealthTransitions() const = 0;
 
+  // Returns the group that stores this agent, if any.
+  virtual AgentGroup* group() const { return nullptr; }
+
   virtual ~Agent() = default;
 };
 
+// An AgentGroup stores the state of many agents together, so that it can step
+// a run of them in a single call rather than with several virtual calls per
+// agent.
+class AgentGroup {
+ public:
+  // Steps the longest prefix of agents that belongs to this group.  This is
+  // equivalent to calling, for each agent in turn, observer->Observe,
+  // ProcessInfectionOutcomes, UpdateContactReports and ComputeVisits, skipping
+  // the middle two for quiescent agents without messages.  outcomes and
+  // reports hold the messages for agents sorted by destination uuid, and the
+  // messages for the stepped agents are removed from their front.  Returns the
+  // number of agents stepped, which is at least one if agents[0] belongs to
+  // this group.
+  virtual int StepAgents(const Timestep& timestep,
+                         absl::Span<const std::unique_ptr<Agent>> agents,
+                         absl::Span<const InfectionOutcome>* outcomes,
+                         absl::Span<const ContactReport>* reports,
+                         AgentInfectionObserver* observer,
+                         Broker<Visit>* visit_broker,
+                         Broker<ContactReport>* contact_report_broker) = 0;
+
+  virtual ~AgentGroup() = default;
+};
+
 }  // namespace abesim
 
 #endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_AGENT_H_
@@ -22,29 +22,39 @@ namespace {
 constexpr float kSusceptibility = 1;
 constexpr double kEpsilon = 1e-8;
 
-float ProbabilityExposureInfects(const Exposure& exposure,
-                                 const float transmissibility) {
-  return std::log(1 -
+}  // namespace
+
+float ExposureLogSurvival(const Exposure& exposure,
+                          const float transmissibility) {
+  return exposure.weight *
+         std::log(1 -
                   exposure.infectivity *
                       absl::ToDoubleHours(exposure.duration) / 24.0f *
                       kSusceptibility * transmissibility +
                   kEpsilon);
 }
 
-}  // namespace
+float AggregatedTransmissionModel::InfectionProbability(
+    absl::Span<const Exposure* const> exposures) const {
+  float sum_exposures = 0.0f;
+  for (const Exposure* exposure : exposures) {
+    if (exposure->infectivity > 0) {
+      sum_exposures += ExposureLogSurvival(*exposure, transmissibility_);
+    }
+  }
+  return 1 - std::exp(sum_exposures);
+}
 
 HealthTransition AggregatedTransmissionModel::GetInfectionOutcome(
     absl::Span<const Exposure* const> exposures) {
   absl::Time latest_exposure_time = absl::InfinitePast();
-  float sum_exposures = 0.0f;
   for (const Exposure* exposure : exposures) {
     if (exposure->infectivity > 0) {
       latest_exposure_time = std::max(
           latest_exposure_time, exposure->start_time + exposure->duration);
-      sum_exposures += ProbabilityExposureInfects(*exposure, transmissibility_);
     }
   }
-  const float prob_infection = 1 - std::exp(sum_exposures);
+  const float prob_infection = InfectionProbability(exposures);
   HealthTransition health_transition;
   health_transition.time = latest_exposure_time;
   health_transition.health_state = absl::Bernoulli(gen_, prob_infection)
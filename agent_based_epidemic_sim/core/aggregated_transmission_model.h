@@ -25,8 +25,13 @@
 
 namespace abesim {
 
+// Returns the log of the probability that exposure does not infect a host under
+// AggregatedTransmissionModel, scaled by the exposure's weight.
+float ExposureLogSurvival(const Exposure& exposure, float transmissibility);
+
 // Models transmission between hosts as an exponential of sum of logs
-// of visit infectivity/susceptibility.
+// of visit infectivity/susceptibility.  Each exposure's log term is scaled by
+// its weight.
 class AggregatedTransmissionModel : public TransmissionModel {
  public:
   explicit AggregatedTransmissionModel(const float transmissibility)
@@ -36,6 +41,10 @@ class AggregatedTransmissionModel : public TransmissionModel {
   HealthTransition GetInfectionOutcome(
       absl::Span<const Exposure* const> exposures) override;
 
+  // Returns the probability that GetInfectionOutcome returns EXPOSED for the
+  // given exposures.
+  float InfectionProbability(absl::Span<const Exposure* const> exposures) const;
+
  private:
   const float transmissibility_;
   absl::BitGen gen_;
@@ -49,5 +49,19 @@ TEST(AggregatedTransmissionModelTest, GetsInfectionOutcomes) {
                                   .health_state = HealthState::SUSCEPTIBLE}));
 }
 
+TEST(AggregatedTransmissionModelTest, CountsWeightedExposuresRepeatedly) {
+  AggregatedTransmissionModel transmission_model(0.95);
+  const std::vector<Exposure> repeated(
+      3, {.duration = absl::Hours(3), .infectivity = 1});
+  const std::vector<Exposure> weighted{
+      {.duration = absl::Hours(3), .infectivity = 1, .weight = 3}};
+  EXPECT_FLOAT_EQ(
+      transmission_model.InfectionProbability(MakePointers(weighted)),
+      transmission_model.InfectionProbability(MakePointers(repeated)));
+  // The exposure keeps its own duration, so it ends when the visit does.
+  EXPECT_EQ(transmission_model.GetInfectionOutcome(MakePointers(weighted)).time,
+            absl::UnixEpoch() + absl::Hours(3));
+}
+
 }  // namespace
 }  // namespace abesim
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "agent_based_epidemic_sim/core/coalescing_location.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+
+namespace abesim {
+namespace {
+
+// Collects the outcomes sent by a location.
+class BufferBroker : public Broker<InfectionOutcome> {
+ public:
+  explicit BufferBroker(std::vector<InfectionOutcome>* outcomes)
+      : outcomes_(outcomes) {}
+  void Send(absl::Span<const InfectionOutcome> outcomes) override {
+    outcomes_->insert(outcomes_->end(), outcomes.begin(), outcomes.end());
+  }
+
+ private:
+  std::vector<InfectionOutcome>* const outcomes_;
+};
+
+bool IsContact(const InfectionOutcome& outcome) {
+  return outcome.exposure_type == InfectionOutcomeProto::CONTACT;
+}
+
+// Returns the term exposure adds to the log of the probability that its host
+// escapes infection under AggregatedTransmissionModel.
+double LogSurvival(const Exposure& exposure, const float transmissibility) {
+  return exposure.infectivity > 0
+             ? ExposureLogSurvival(exposure, transmissibility)
+             : 0.0;
+}
+
+// Adds the exposure b to a, and returns true, if the model can compose the
+// result exactly.  Otherwise leaves a unchanged and returns false.
+bool Merge(const Exposure& b, const float transmissibility, Exposure* a) {
+  Exposure merged = *a;
+  const absl::Time a_end = a->start_time + a->duration;
+  const absl::Time b_end = b.start_time + b.duration;
+  // The model dates an infection by the end of the latest infectious exposure,
+  // so a non-infectious exposure must not extend an infectious one.
+  absl::Time end = std::max(a_end, b_end);
+  if (a->infectivity > 0 && b.infectivity <= 0) {
+    end = a_end;
+  } else if (b.infectivity > 0 && a->infectivity <= 0) {
+    end = b_end;
+  }
+  merged.start_time = std::min(a->start_time, b.start_time);
+  merged.duration = end - merged.start_time;
+  const double a_hours = absl::ToDoubleHours(a->duration);
+  const double b_hours = absl::ToDoubleHours(b.duration);
+  if (a_hours + b_hours > 0) {
+    merged.infectivity = (a->infectivity * a_hours + b.infectivity * b_hours) /
+                         (a_hours + b_hours);
+    merged.symptom_factor =
+        (a->symptom_factor * a_hours + b.symptom_factor * b_hours) /
+        (a_hours + b_hours);
+  }
+  merged.weight = 1.0f;
+  if (a->infectivity > 0 || b.infectivity > 0) {
+    // An infectious exposure with no duration cannot be merged into one
+    // without infectivity, since it still dates an infection.
+    if (merged.infectivity <= 0) return false;
+    const double log_survival =
+        LogSurvival(*a, transmissibility) + LogSurvival(b, transmissibility);
+    const double merged_log_survival =
+        ExposureLogSurvival(merged, transmissibility);
+    // The merged exposure is outside the model's domain when its probability
+    // of infection reaches one.
+    if (!std::isfinite(log_survival) || !std::isfinite(merged_log_survival) ||
+        merged_log_survival >= 0) {
+      return false;
+    }
+    merged.weight = log_survival / merged_log_survival;
+  }
+  for (int i = 0; i < kNumberMicroExposureBuckets; ++i) {
+    merged.micro_exposure_counts[i] = std::min<int>(
+        kuint8max, a->micro_exposure_counts[i] + b.micro_exposure_counts[i]);
+  }
+  *a = merged;
+  return true;
+}
+
+}  // namespace
+
+void CoalesceInfectionOutcomes(const float transmissibility,
+                               std::vector<InfectionOutcome>* outcomes) {
+  // Move contacts to the front, grouped by agent and source.
+  const auto contacts_end =
+      std::partition(outcomes->begin(), outcomes->end(), IsContact);
+  std::sort(outcomes->begin(), contacts_end,
+            [](const InfectionOutcome& a, const InfectionOutcome& b) {
+              if (a.agent_uuid != b.agent_uuid) {
+                return a.agent_uuid < b.agent_uuid;
+              }
+              return a.source_uuid < b.source_uuid;
+            });
+  auto out = outcomes->begin();
+  for (auto in = outcomes->begin(); in != contacts_end; ++in) {
+    if (out != outcomes->begin() && in->agent_uuid == (out - 1)->agent_uuid &&
+        in->source_uuid == (out - 1)->source_uuid &&
+        Merge(in->exposure, transmissibility, &(out - 1)->exposure)) {
+      continue;
+    }
+    *out++ = *in;
+  }
+  out = std::move(contacts_end, outcomes->end(), out);
+  outcomes->erase(out, outcomes->end());
+}
+
+void CoalescingLocation::ProcessVisits(
+    const absl::Span<const Visit> visits,
+    Broker<InfectionOutcome>* infection_broker) {
+  thread_local std::vector<InfectionOutcome> thread_outcomes;
+  std::vector<InfectionOutcome>& outcomes = thread_outcomes;
+  outcomes.clear();
+  BufferBroker buffer(&outcomes);
+  location_->ProcessVisits(visits, &buffer);
+  CoalesceInfectionOutcomes(transmissibility_, &outcomes);
+  infection_broker->Send(outcomes);
+}
+
+}  // namespace abesim
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_COALESCING_LOCATION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_COALESCING_LOCATION_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+
+namespace abesim {
+
+// Merges the CONTACT outcomes in outcomes that share an agent and a source
+// into one, and leaves other outcomes as they are.  The merged exposure spans
+// from the earliest start to the latest end, or to the latest end of an
+// infectious exposure if there is one, and has the total micro-exposure
+// counts, saturating at kuint8max.  Its infectivity and symptom_factor are
+// averages weighted by duration, and its weight is set so that
+// AggregatedTransmissionModel with the given transmissibility gives the agent
+// the same probability of infection, at the same time, as for the unmerged
+// outcomes.  Contacts whose merged exposure the model cannot represent, because
+// it would infect with certainty, are left unmerged.  Other transmission
+// models may give different results for merged outcomes.  The order of
+// outcomes is not preserved.
+void CoalesceInfectionOutcomes(float transmissibility,
+                               std::vector<InfectionOutcome>* outcomes);
+
+// A Location that sends one CONTACT outcome for each pair of agents that meet
+// at the wrapped location in a step, rather than one for each pair of their
+// visits.  This cuts the number of outcomes where agents visit the same
+// location several times a step, as they do at home.  Outcomes are merged by
+// CoalesceInfectionOutcomes, and sent once the wrapped location has processed
+// every visit.
+class CoalescingLocation : public Location {
+ public:
+  CoalescingLocation(std::unique_ptr<Location> location,
+                     const float transmissibility)
+      : location_(std::move(location)), transmissibility_(transmissibility) {}
+
+  int64 uuid() const override { return location_->uuid(); }
+
+  void ProcessVisits(absl::Span<const Visit> visits,
+                     Broker<InfectionOutcome>* infection_broker) override;
+
+ private:
+  const std::unique_ptr<Location> location_;
+  const float transmissibility_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_COALESCING_LOCATION_H_
@@ -0,0 +1,219 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/coalescing_location.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/location_test_util.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/recording_infection_broker.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::UnorderedElementsAreArray;
+
+constexpr int64 kUuid = 42;
+
+InfectionOutcome ContactOutcome(const int64 agent_uuid, const int64 source_uuid,
+                                const int start_hour, const int hours,
+                                const float infectivity) {
+  return {
+      .agent_uuid = agent_uuid,
+      .exposure = {.start_time = absl::UnixEpoch() + absl::Hours(start_hour),
+                   .duration = absl::Hours(hours),
+                   .micro_exposure_counts = {static_cast<uint8>(hours)},
+                   .infectivity = infectivity,
+                   .symptom_factor = infectivity},
+      .exposure_type = InfectionOutcomeProto::CONTACT,
+      .source_uuid = source_uuid};
+}
+
+constexpr float kTransmissibility = 0.5f;
+
+TEST(CoalesceInfectionOutcomesTest, MergesContactsBetweenTheSameAgents) {
+  const InfectionOutcome location_outcome = {
+      .agent_uuid = 1,
+      .exposure = {.duration = absl::Hours(1), .infectivity = 1.0f},
+      .exposure_type = InfectionOutcomeProto::LOCATION,
+      .source_uuid = 2};
+  std::vector<InfectionOutcome> outcomes = {
+      ContactOutcome(1, 2, 8, 3, 0.0f), ContactOutcome(2, 1, 8, 3, 1.0f),
+      location_outcome, ContactOutcome(1, 3, 0, 2, 1.0f),
+      ContactOutcome(1, 2, 4, 1, 1.0f)};
+  CoalesceInfectionOutcomes(kTransmissibility, &outcomes);
+
+  ASSERT_EQ(outcomes.size(), 4);
+  EXPECT_THAT(outcomes, testing::IsSupersetOf(
+                            {ContactOutcome(2, 1, 8, 3, 1.0f),
+                             ContactOutcome(1, 3, 0, 2, 1.0f),
+                             location_outcome}));
+  const auto merged =
+      std::find_if(outcomes.begin(), outcomes.end(),
+                   [](const InfectionOutcome& outcome) {
+                     return outcome.agent_uuid == 1 && outcome.source_uuid == 2;
+                   });
+  ASSERT_NE(merged, outcomes.end());
+  EXPECT_EQ(merged->exposure_type, InfectionOutcomeProto::CONTACT);
+  // The later contact is not infectious, so it does not extend the merged one.
+  EXPECT_EQ(merged->exposure.start_time, absl::UnixEpoch() + absl::Hours(4));
+  EXPECT_EQ(merged->exposure.duration, absl::Hours(1));
+  EXPECT_EQ(merged->exposure.micro_exposure_counts[0], 4);
+  EXPECT_FLOAT_EQ(merged->exposure.infectivity, 0.25f);
+  EXPECT_FLOAT_EQ(ExposureLogSurvival(merged->exposure, kTransmissibility),
+                  ExposureLogSurvival(ContactOutcome(1, 2, 4, 1, 1.0f).exposure,
+                                      kTransmissibility));
+}
+
+TEST(CoalesceInfectionOutcomesTest, SaturatesMicroExposureCounts) {
+  std::vector<InfectionOutcome> outcomes = {ContactOutcome(1, 2, 0, 200, 0.0f),
+                                            ContactOutcome(1, 2, 0, 100, 0.0f)};
+  CoalesceInfectionOutcomes(kTransmissibility, &outcomes);
+
+  ASSERT_EQ(outcomes.size(), 1);
+  EXPECT_EQ(outcomes[0].exposure.duration, absl::Hours(200));
+  EXPECT_EQ(outcomes[0].exposure.micro_exposure_counts[0], kuint8max);
+}
+
+TEST(CoalesceInfectionOutcomesTest, LeavesContactsTheModelCannotMerge) {
+  // Together the contacts span 28 hours, which would infect with certainty.
+  const std::vector<InfectionOutcome> unmerged = {
+      ContactOutcome(1, 2, 0, 16, 1.0f), ContactOutcome(1, 2, 12, 16, 1.0f)};
+  std::vector<InfectionOutcome> outcomes = unmerged;
+  CoalesceInfectionOutcomes(/*transmissibility=*/1.0f, &outcomes);
+
+  EXPECT_THAT(outcomes, UnorderedElementsAreArray(unmerged));
+}
+
+Visit AtLocation(const int64 agent_uuid, const int start_minute,
+                 const int end_minute, const float infectivity) {
+  return {.location_uuid = kUuid,
+          .agent_uuid = agent_uuid,
+          .start_time = absl::UnixEpoch() + absl::Minutes(start_minute),
+          .end_time = absl::UnixEpoch() + absl::Minutes(end_minute),
+          .health_state = infectivity > 0 ? HealthState::INFECTIOUS
+                                          : HealthState::SUSCEPTIBLE,
+          .infectivity = infectivity,
+          .symptom_factor = infectivity};
+}
+
+std::vector<InfectionOutcome> ProcessVisits(absl::Span<const Visit> visits,
+                                            const bool coalesce) {
+  std::unique_ptr<Location> location =
+      absl::make_unique<LocationDiscreteEventSimulator>(
+          kUuid, MicroExposureGeneratorBuilder().Build());
+  if (coalesce) {
+    location = absl::make_unique<CoalescingLocation>(std::move(location),
+                                                     kTransmissibility);
+  }
+  RecordingInfectionBroker infection_broker;
+  location->ProcessVisits(visits, &infection_broker);
+  return infection_broker.outcomes();
+}
+
+TEST(CoalescingLocationTest, SendsOneOutcomePerPairOfAgents) {
+  // Two agents at home in the morning and the evening.
+  const std::vector<Visit> visits = {
+      AtLocation(0, 0, 8 * 60, 1.0f), AtLocation(1, 0, 9 * 60, 0.0f),
+      AtLocation(0, 18 * 60, 24 * 60, 1.0f),
+      AtLocation(1, 17 * 60, 24 * 60, 0.0f)};
+
+  RecordingInfectionBroker infection_broker;
+  CoalescingLocation location(
+      absl::make_unique<LocationDiscreteEventSimulator>(
+          kUuid, MicroExposureGeneratorBuilder().Build()),
+      kTransmissibility);
+  EXPECT_EQ(location.uuid(), kUuid);
+  location.ProcessVisits(visits, &infection_broker);
+
+  EXPECT_EQ(infection_broker.sends(), 1);
+  ASSERT_EQ(infection_broker.outcomes().size(), 2);
+  // MicroExposureGenerator starts every exposure at the epoch, so the merged
+  // exposure ends with the longer of the two.
+  for (const InfectionOutcome& outcome : infection_broker.outcomes()) {
+    EXPECT_EQ(outcome.source_uuid, 1 - outcome.agent_uuid);
+    EXPECT_EQ(outcome.exposure.start_time, absl::UnixEpoch());
+    EXPECT_EQ(outcome.exposure.duration, absl::Hours(8));
+    EXPECT_EQ(outcome.exposure.infectivity, outcome.agent_uuid == 1 ? 1 : 0);
+  }
+}
+
+TEST(CoalescingLocationTest, PreservesInfectionProbabilityAndTime) {
+  // Agents who come and go several times in a day.  An agent's infectivity can
+  // change between its visits, as it does when it turns infectious.
+  std::mt19937_64 gen(/*seed=*/1);
+  std::vector<Visit> visits;
+  for (int agent = 0; agent < 50; ++agent) {
+    int minute = absl::Uniform(gen, 0, 4 * 60);
+    for (int i = 0; i < 3; ++i) {
+      const int end_minute = minute + absl::Uniform(gen, 30, 4 * 60);
+      const float infectivity =
+          absl::Bernoulli(gen, 0.3) ? absl::Uniform(gen, 0.5f, 1.0f) : 0.0f;
+      visits.push_back(AtLocation(agent, minute, end_minute, infectivity));
+      minute = end_minute + absl::Uniform(gen, 30, 3 * 60);
+    }
+  }
+  const std::vector<InfectionOutcome> unmerged = ProcessVisits(visits, false);
+  const std::vector<InfectionOutcome> merged = ProcessVisits(visits, true);
+  ASSERT_LT(merged.size(), unmerged.size());
+
+  const absl::flat_hash_map<int64, double> expected =
+      InfectionProbabilities(unmerged, kTransmissibility);
+  const absl::flat_hash_map<int64, double> probabilities =
+      InfectionProbabilities(merged, kTransmissibility);
+  ASSERT_EQ(probabilities.size(), expected.size());
+  for (const auto& [agent, probability] : expected) {
+    EXPECT_NEAR(probabilities.at(agent), probability, 1e-5) << agent;
+  }
+
+  // The model dates an infection by the end of the latest infectious exposure.
+  auto latest_infectious_exposures = [](absl::Span<const InfectionOutcome>
+                                            outcomes) {
+    absl::flat_hash_map<int64, absl::Time> latest;
+    for (const InfectionOutcome& outcome : outcomes) {
+      if (outcome.exposure.infectivity > 0) {
+        absl::Time& time = latest.try_emplace(outcome.agent_uuid,
+                                              absl::InfinitePast())
+                               .first->second;
+        time = std::max(time,
+                        outcome.exposure.start_time + outcome.exposure.duration);
+      }
+    }
+    return latest;
+  };
+  EXPECT_EQ(latest_infectious_exposures(merged),
+            latest_infectious_exposures(unmerged));
+}
+
+}  // namespace
+}  // namespace abesim
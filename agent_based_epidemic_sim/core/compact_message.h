@@ -0,0 +1,234 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_COMPACT_MESSAGE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_COMPACT_MESSAGE_H_
+
+#include <algorithm>
+#include <array>
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+
+namespace abesim {
+
+// Compact encodings of the messages exchanged between agents and locations,
+// which a WorkQueueBroker given MessageCodec as its Codec holds while messages
+// wait in it.  Agents, locations and observers only ever see the decoded
+// messages.
+//
+// The destination of an encoded message is the dense index of the receiving
+// entity (see Chunker) rather than its uuid.  Times are whole seconds relative
+// to an epoch, normally the start of the simulation, so an encoded message
+// spans about 68 years either side of it; infinite times are preserved, and
+// finite times beyond that range are clamped.  Durations are likewise whole
+// seconds.  Times are rounded to the nearest second, except that a visit of
+// positive length never rounds down to nothing.
+
+// Returns millis, a number of milliseconds, rounded to the nearest second.
+inline int32 RoundToSeconds(const int64 millis) {
+  int64 seconds = millis / 1000;
+  const int64 remainder = millis % 1000;
+  if (remainder >= 500) {
+    ++seconds;
+  } else if (remainder < -500) {
+    --seconds;
+  }
+  return std::clamp<int64>(seconds, kint32min + 1, kint32max - 1);
+}
+
+// Returns time as whole seconds since epoch.  Working in whole milliseconds
+// is enough to round to the nearest second, and is much cheaper than
+// absl::Floor.
+inline int32 EncodeTime(const absl::Time time, const absl::Time epoch) {
+  if (time == absl::InfiniteFuture()) return kint32max;
+  if (time == absl::InfinitePast()) return kint32min;
+  return RoundToSeconds(absl::ToUnixMillis(time) - absl::ToUnixMillis(epoch));
+}
+inline absl::Time DecodeTime(const int32 seconds, const absl::Time epoch) {
+  if (seconds == kint32max) return absl::InfiniteFuture();
+  if (seconds == kint32min) return absl::InfinitePast();
+  return epoch + absl::Seconds(seconds);
+}
+
+// Returns duration as whole seconds.
+inline int32 EncodeDuration(const absl::Duration duration) {
+  if (duration == absl::InfiniteDuration()) return kint32max;
+  if (duration == -absl::InfiniteDuration()) return kint32min;
+  return RoundToSeconds(absl::ToInt64Milliseconds(duration));
+}
+inline absl::Duration DecodeDuration(const int32 seconds) {
+  if (seconds == kint32max) return absl::InfiniteDuration();
+  if (seconds == kint32min) return -absl::InfiniteDuration();
+  return absl::Seconds(seconds);
+}
+
+// 32 bytes, from 64.
+struct CompactVisit {
+  int64 agent_uuid;
+  uint32 location_index;
+  int32 start_time;
+  int32 end_time;
+  int32 health_state;
+  float infectivity;
+  float symptom_factor;
+};
+
+// 48 bytes, from 80.
+struct CompactInfectionOutcome {
+  int64 source_uuid;
+  uint32 agent_index;
+  int32 start_time;
+  int32 duration;
+  float infectivity;
+  float symptom_factor;
+  float weight;
+  std::array<uint8, kNumberMicroExposureBuckets> micro_exposure_counts;
+  uint8 exposure_type;
+};
+
+// 40 bytes, from 72.
+struct CompactContactReport {
+  int64 from_agent_uuid;
+  int64 origin_agent_uuid;
+  uint32 to_agent_index;
+  int32 hops;
+  int32 time_requested;
+  int32 time_received;
+  float probability;
+};
+
+static_assert(sizeof(CompactVisit) == 32, "CompactVisit must stay compact.");
+static_assert(sizeof(CompactInfectionOutcome) == 48,
+              "CompactInfectionOutcome must stay compact.");
+static_assert(sizeof(CompactContactReport) == 40,
+              "CompactContactReport must stay compact.");
+
+// Returns the dense index of the entity an encoded message is delivered to.
+inline int64 GetDestId(const CompactVisit& visit) {
+  return visit.location_index;
+}
+inline int64 GetDestId(const CompactInfectionOutcome& outcome) {
+  return outcome.agent_index;
+}
+inline int64 GetDestId(const CompactContactReport& report) {
+  return report.to_agent_index;
+}
+
+// MessageCodec<Msg> converts between Msg and its compact encoding, given the
+// dense index or uuid of its destination and the epoch times are relative to.
+template <typename Msg>
+struct MessageCodec;
+
+template <>
+struct MessageCodec<Visit> {
+  using Compact = CompactVisit;
+
+  static Compact Encode(const Visit& visit, const int dest_index,
+                        const absl::Time epoch) {
+    const int32 start_time = EncodeTime(visit.start_time, epoch);
+    int32 end_time = EncodeTime(visit.end_time, epoch);
+    if (end_time == start_time && visit.end_time > visit.start_time) {
+      ++end_time;
+    }
+    return {.agent_uuid = visit.agent_uuid,
+            .location_index = static_cast<uint32>(dest_index),
+            .start_time = start_time,
+            .end_time = end_time,
+            .health_state = visit.health_state,
+            .infectivity = visit.infectivity,
+            .symptom_factor = visit.symptom_factor};
+  }
+  static Visit Decode(const Compact& visit, const int64 dest_uuid,
+                      const absl::Time epoch) {
+    return {.location_uuid = dest_uuid,
+            .agent_uuid = visit.agent_uuid,
+            .start_time = DecodeTime(visit.start_time, epoch),
+            .end_time = DecodeTime(visit.end_time, epoch),
+            .health_state =
+                static_cast<HealthState::State>(visit.health_state),
+            .infectivity = visit.infectivity,
+            .symptom_factor = visit.symptom_factor};
+  }
+};
+
+template <>
+struct MessageCodec<InfectionOutcome> {
+  using Compact = CompactInfectionOutcome;
+
+  static Compact Encode(const InfectionOutcome& outcome, const int dest_index,
+                        const absl::Time epoch) {
+    return {.source_uuid = outcome.source_uuid,
+            .agent_index = static_cast<uint32>(dest_index),
+            .start_time = EncodeTime(outcome.exposure.start_time, epoch),
+            .duration = EncodeDuration(outcome.exposure.duration),
+            .infectivity = outcome.exposure.infectivity,
+            .symptom_factor = outcome.exposure.symptom_factor,
+            .weight = outcome.exposure.weight,
+            .micro_exposure_counts = outcome.exposure.micro_exposure_counts,
+            .exposure_type = static_cast<uint8>(outcome.exposure_type)};
+  }
+  static InfectionOutcome Decode(const Compact& outcome, const int64 dest_uuid,
+                                 const absl::Time epoch) {
+    return {.agent_uuid = dest_uuid,
+            .exposure = {.start_time = DecodeTime(outcome.start_time, epoch),
+                         .duration = DecodeDuration(outcome.duration),
+                         .micro_exposure_counts =
+                             outcome.micro_exposure_counts,
+                         .infectivity = outcome.infectivity,
+                         .symptom_factor = outcome.symptom_factor,
+                         .weight = outcome.weight},
+            .exposure_type = static_cast<InfectionOutcomeProto::ExposureType>(
+                outcome.exposure_type),
+            .source_uuid = outcome.source_uuid};
+  }
+};
+
+template <>
+struct MessageCodec<ContactReport> {
+  using Compact = CompactContactReport;
+
+  static Compact Encode(const ContactReport& report, const int dest_index,
+                        const absl::Time epoch) {
+    return {.from_agent_uuid = report.from_agent_uuid,
+            .origin_agent_uuid = report.origin_agent_uuid,
+            .to_agent_index = static_cast<uint32>(dest_index),
+            .hops = report.hops,
+            .time_requested =
+                EncodeTime(report.test_result.time_requested, epoch),
+            .time_received =
+                EncodeTime(report.test_result.time_received, epoch),
+            .probability = report.test_result.probability};
+  }
+  static ContactReport Decode(const Compact& report, const int64 dest_uuid,
+                              const absl::Time epoch) {
+    return {.from_agent_uuid = report.from_agent_uuid,
+            .to_agent_uuid = dest_uuid,
+            .test_result = {.time_requested =
+                                DecodeTime(report.time_requested, epoch),
+                            .time_received =
+                                DecodeTime(report.time_received, epoch),
+                            .probability = report.probability},
+            .hops = report.hops,
+            .origin_agent_uuid = report.origin_agent_uuid};
+  }
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_COMPACT_MESSAGE_H_
@@ -0,0 +1,100 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/compact_message.h"
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+const absl::Time kEpoch = absl::FromUnixSeconds(86400 * 365);
+
+// Encodes and decodes msg for delivery to the entity with dense index 7 and
+// the given uuid.
+template <typename Msg>
+Msg RoundTrip(const Msg& msg, const int64 dest_uuid) {
+  const auto compact = MessageCodec<Msg>::Encode(msg, 7, kEpoch);
+  EXPECT_EQ(GetDestId(compact), 7);
+  return MessageCodec<Msg>::Decode(compact, dest_uuid, kEpoch);
+}
+
+TEST(CompactMessageTest, RoundTripsVisits) {
+  const Visit visit = {.location_uuid = 1234,
+                       .agent_uuid = 5678,
+                       .start_time = kEpoch - absl::Hours(3),
+                       .end_time = kEpoch + absl::Hours(40),
+                       .health_state = HealthState::INFECTIOUS,
+                       .infectivity = 0.25f,
+                       .symptom_factor = 0.5f};
+  EXPECT_EQ(RoundTrip(visit, 1234), visit);
+}
+
+TEST(CompactMessageTest, RoundTripsInfectionOutcomes) {
+  const InfectionOutcome outcome = {
+      .agent_uuid = 1234,
+      .exposure = {.start_time = kEpoch + absl::Minutes(90),
+                   .duration = absl::Minutes(15),
+                   .micro_exposure_counts = {1, 2, 3, 0, 0, 0, 0, 0, 0, 255},
+                   .infectivity = 0.75f,
+                   .symptom_factor = 1.0f},
+      .exposure_type = InfectionOutcomeProto::CONTACT,
+      .source_uuid = 5678};
+  EXPECT_EQ(RoundTrip(outcome, 1234), outcome);
+}
+
+TEST(CompactMessageTest, RoundTripsContactReports) {
+  const ContactReport report = {
+      .from_agent_uuid = 5678,
+      .to_agent_uuid = 1234,
+      .test_result = {.time_requested = kEpoch + absl::Hours(1),
+                      .time_received = absl::InfiniteFuture(),
+                      .probability = 1.0f},
+      .hops = 2,
+      .origin_agent_uuid = 42};
+  EXPECT_EQ(RoundTrip(report, 1234), report);
+}
+
+TEST(CompactMessageTest, EncodesTimesAsWholeSeconds) {
+  EXPECT_EQ(EncodeTime(kEpoch + absl::Milliseconds(1499), kEpoch), 1);
+  EXPECT_EQ(EncodeTime(kEpoch + absl::Milliseconds(1500), kEpoch), 2);
+  EXPECT_EQ(EncodeTime(kEpoch - absl::Milliseconds(1499), kEpoch), -1);
+  EXPECT_EQ(EncodeDuration(absl::Milliseconds(400)), 0);
+  EXPECT_EQ(DecodeTime(EncodeTime(absl::InfinitePast(), kEpoch), kEpoch),
+            absl::InfinitePast());
+  EXPECT_EQ(DecodeDuration(EncodeDuration(absl::InfiniteDuration())),
+            absl::InfiniteDuration());
+  // Finite times beyond the encoded range are clamped, never infinite.
+  EXPECT_EQ(DecodeTime(EncodeTime(kEpoch + absl::Hours(24 * 365 * 100), kEpoch),
+                       kEpoch),
+            kEpoch + absl::Seconds(kint32max - 1));
+}
+
+TEST(CompactMessageTest, KeepsShortVisits) {
+  const Visit visit = {.location_uuid = 1,
+                       .agent_uuid = 2,
+                       .start_time = kEpoch + absl::Milliseconds(100),
+                       .end_time = kEpoch + absl::Milliseconds(200)};
+  const Visit decoded = RoundTrip(visit, 1);
+  EXPECT_EQ(decoded.start_time, kEpoch);
+  EXPECT_EQ(decoded.end_time, kEpoch + absl::Seconds(1));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "agent_based_epidemic_sim/core/contact_history.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace abesim {
+namespace {
+
+constexpr int kMinEntries = 8;
+
+uint64 Hash(const int64 other_uuid) {
+  return static_cast<uint64>(other_uuid) * 0x9E3779B97F4A7C15ULL;
+}
+
+}  // namespace
+
+void ContactHistory::Add(const Contact& contact) {
+  int slot = FindSlot(contact.other_uuid);
+  if (slot >= 0 && index_[slot].seq >= 0) {
+    // Leave a tombstone in place of the earlier contact.
+    EntryAt(index_[slot].seq).live = false;
+    --num_contacts_;
+  }
+  Reserve();
+  if (2 * (num_contacts_ + 1) > index_.size()) {
+    index_.resize(std::max<size_t>(2 * kMinEntries, 2 * index_.size()));
+    RebuildIndex();
+  }
+  // Reserve and RebuildIndex may have moved entries and slots.
+  slot = FindSlot(contact.other_uuid);
+  index_[slot] = {.other_uuid = contact.other_uuid, .seq = end_};
+  EntryAt(end_++) = {.contact = contact, .live = true};
+  ++num_contacts_;
+}
+
+const Contact* ContactHistory::Find(const int64 other_uuid) const {
+  const int slot = FindSlot(other_uuid);
+  if (slot < 0 || index_[slot].seq < 0) return nullptr;
+  return &entries_[index_[slot].seq & mask()].contact;
+}
+
+void ContactHistory::RemoveContactsBefore(const absl::Time time) {
+  while (begin_ < end_) {
+    Entry& entry = EntryAt(begin_);
+    if (entry.live) {
+      const Exposure& exposure = entry.contact.exposure;
+      if (exposure.start_time + exposure.duration >= time) break;
+      EraseSlot(FindSlot(entry.contact.other_uuid));
+      --num_contacts_;
+    }
+    ++begin_;
+  }
+}
+
+void ContactHistory::Reserve() {
+  // Drop tombstones at the front.
+  while (begin_ < end_ && !EntryAt(begin_).live) ++begin_;
+  if (end_ - begin_ < entries_.size()) return;
+
+  // Copy the live entries into a new buffer, keeping their order, and
+  // renumber them from begin_.  The new buffer has room for at least as many
+  // entries again.
+  const int64 capacity = std::max<int64>(
+      kMinEntries, int64{1} << (64 - __builtin_clzll(2 * num_contacts_ | 1)));
+  std::vector<Entry> entries(capacity);
+  int64 seq = begin_;
+  int64 reported_end = begin_;
+  for (int64 old_seq = begin_; old_seq < end_; ++old_seq) {
+    const Entry& entry = EntryAt(old_seq);
+    if (!entry.live) continue;
+    if (old_seq < reported_end_) reported_end = seq + 1;
+    entries[seq++ & (capacity - 1)] = entry;
+  }
+  entries_ = std::move(entries);
+  end_ = seq;
+  reported_end_ = reported_end;
+  RebuildIndex();
+}
+
+int ContactHistory::FindSlot(const int64 other_uuid) const {
+  if (index_.empty()) return -1;
+  const int slot_mask = index_.size() - 1;
+  for (int slot = Hash(other_uuid) >> 32 & slot_mask;;
+       slot = (slot + 1) & slot_mask) {
+    if (index_[slot].seq < 0 || index_[slot].other_uuid == other_uuid) {
+      return slot;
+    }
+  }
+}
+
+void ContactHistory::EraseSlot(int slot) {
+  // Shift later entries of the probe sequence back, so that no lookup stops
+  // early at the emptied slot.
+  const int slot_mask = index_.size() - 1;
+  int next = slot;
+  while (true) {
+    next = (next + 1) & slot_mask;
+    if (index_[next].seq < 0) break;
+    const int home = Hash(index_[next].other_uuid) >> 32 & slot_mask;
+    // The entry at next may move to slot if its home is not cyclically in
+    // (slot, next].
+    if (((next - home) & slot_mask) >= ((next - slot) & slot_mask)) {
+      index_[slot] = index_[next];
+      slot = next;
+    }
+  }
+  index_[slot].seq = -1;
+}
+
+void ContactHistory::RebuildIndex() {
+  for (Slot& slot : index_) slot.seq = -1;
+  for (int64 seq = begin_; seq < end_; ++seq) {
+    const Entry& entry = EntryAt(seq);
+    if (!entry.live) continue;
+    index_[FindSlot(entry.contact.other_uuid)] = {
+        .other_uuid = entry.contact.other_uuid, .seq = seq};
+  }
+}
+
+}  // namespace abesim
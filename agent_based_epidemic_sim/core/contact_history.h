@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_CONTACT_HISTORY_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_CONTACT_HISTORY_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// ContactHistory holds an agent's contacts with other agents, at most one per
+// other agent, in the order they were added.  Adding a contact with an agent
+// already in the history replaces the earlier contact, and moves it to the
+// end.
+//
+// Contacts are stored in a circular buffer, indexed by other_uuid in an open
+// addressing hash table, so adding and removing contacts does not allocate
+// once the buffer has grown to fit.  Replaced contacts are left in the buffer
+// as tombstones, which are dropped as they reach the front or when it grows.
+//
+// The history also keeps a report cursor, which divides the contacts into
+// those already reported and those added since.
+class ContactHistory {
+ public:
+  ContactHistory() = default;
+
+  bool empty() const { return num_contacts_ == 0; }
+  int size() const { return num_contacts_; }
+
+  // Adds a contact, replacing any earlier contact with the same agent.
+  void Add(const Contact& contact);
+
+  // Returns the contact with the given agent, or nullptr if there is none.
+  const Contact* Find(int64 other_uuid) const;
+
+  // Removes contacts from the front, oldest first, while they ended before
+  // time.
+  void RemoveContactsBefore(absl::Time time);
+
+  // Calls fn with each contact, newest first.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (int64 seq = end_; seq > begin_; --seq) {
+      const Entry& entry = entries_[(seq - 1) & mask()];
+      if (entry.live) fn(entry.contact);
+    }
+  }
+
+  // Calls fn with each contact not yet reported, newest first.  These are the
+  // contacts added since the last call to MarkAllReported, or all contacts
+  // after a call to MarkNoneReported.
+  template <typename Fn>
+  void ForEachUnreported(Fn fn) const {
+    for (int64 seq = end_; seq > std::max(begin_, reported_end_); --seq) {
+      const Entry& entry = entries_[(seq - 1) & mask()];
+      if (entry.live) fn(entry.contact);
+    }
+  }
+  void MarkAllReported() { reported_end_ = end_; }
+  void MarkNoneReported() { reported_end_ = begin_; }
+
+ private:
+  struct Entry {
+    Contact contact;
+    // False once the contact has been replaced.
+    bool live;
+  };
+  struct Slot {
+    int64 other_uuid;
+    // The sequence number of the contact, or -1 if the slot is empty.
+    int64 seq;
+  };
+
+  int64 mask() const { return static_cast<int64>(entries_.size()) - 1; }
+  Entry& EntryAt(const int64 seq) { return entries_[seq & mask()]; }
+
+  // Makes room for one more entry at the end.
+  void Reserve();
+  // Returns the slot holding other_uuid, or the empty slot where it belongs.
+  int FindSlot(int64 other_uuid) const;
+  void EraseSlot(int slot);
+  void RebuildIndex();
+
+  // Entries are numbered by sequence numbers, in the order they were added.
+  // The buffer holds entries [begin_, end_), entry seq at index
+  // seq & mask().  Its size is zero or a power of two.
+  std::vector<Entry> entries_;
+  int64 begin_ = 0;
+  int64 end_ = 0;
+  // Entries before reported_end_ have been reported.
+  int64 reported_end_ = 0;
+  int num_contacts_ = 0;
+
+  // Maps the other_uuid of each live contact to its sequence number, with
+  // linear probing.  Its size is zero or a power of two at least twice the
+  // number of contacts.
+  std::vector<Slot> index_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_CONTACT_HISTORY_H_
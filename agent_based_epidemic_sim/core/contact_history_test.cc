@@ -0,0 +1,186 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/contact_history.h"
+
+#include <iterator>
+#include <list>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+// Returns a contact with other_uuid that ended at the given hour.
+Contact ContactEndingAt(const int64 other_uuid, const int hour) {
+  return {.other_uuid = other_uuid,
+          .exposure = {.start_time = absl::UnixEpoch() + absl::Hours(hour - 1),
+                       .duration = absl::Hours(1)}};
+}
+
+std::vector<int64> Unreported(const ContactHistory& history) {
+  std::vector<int64> uuids;
+  history.ForEachUnreported([&uuids](const Contact& contact) {
+    uuids.push_back(contact.other_uuid);
+  });
+  return uuids;
+}
+
+TEST(ContactHistoryTest, ReplacesRepeatedContacts) {
+  ContactHistory history;
+  EXPECT_TRUE(history.empty());
+  history.Add(ContactEndingAt(1, 1));
+  history.Add(ContactEndingAt(2, 2));
+  history.Add(ContactEndingAt(1, 3));
+
+  EXPECT_EQ(history.size(), 2);
+  ASSERT_NE(history.Find(1), nullptr);
+  EXPECT_EQ(*history.Find(1), ContactEndingAt(1, 3));
+  EXPECT_EQ(*history.Find(2), ContactEndingAt(2, 2));
+  EXPECT_EQ(history.Find(3), nullptr);
+  // The repeated contact moves to the end.
+  EXPECT_THAT(Unreported(history), ElementsAre(1, 2));
+}
+
+TEST(ContactHistoryTest, RemovesContactsFromTheFront) {
+  ContactHistory history;
+  history.Add(ContactEndingAt(1, 1));
+  history.Add(ContactEndingAt(2, 5));
+  history.Add(ContactEndingAt(3, 2));
+  history.Add(ContactEndingAt(4, 1));
+  history.Add(ContactEndingAt(1, 6));
+
+  // Contact 3 ended before hour 3, but is retained behind contact 2.
+  history.RemoveContactsBefore(absl::UnixEpoch() + absl::Hours(3));
+  EXPECT_EQ(history.size(), 4);
+  EXPECT_THAT(Unreported(history), ElementsAre(1, 4, 3, 2));
+
+  history.RemoveContactsBefore(absl::UnixEpoch() + absl::Hours(6));
+  EXPECT_EQ(history.size(), 1);
+  EXPECT_EQ(history.Find(2), nullptr);
+  EXPECT_EQ(history.Find(4), nullptr);
+  EXPECT_THAT(Unreported(history), ElementsAre(1));
+
+  history.RemoveContactsBefore(absl::UnixEpoch() + absl::Hours(7));
+  EXPECT_TRUE(history.empty());
+  EXPECT_EQ(history.Find(1), nullptr);
+}
+
+TEST(ContactHistoryTest, TracksReportedContacts) {
+  ContactHistory history;
+  history.Add(ContactEndingAt(1, 1));
+  history.Add(ContactEndingAt(2, 1));
+  history.MarkAllReported();
+  EXPECT_THAT(Unreported(history), IsEmpty());
+
+  history.Add(ContactEndingAt(3, 1));
+  // A repeated contact is reported again.
+  history.Add(ContactEndingAt(1, 2));
+  EXPECT_THAT(Unreported(history), ElementsAre(1, 3));
+  history.MarkAllReported();
+  EXPECT_THAT(Unreported(history), IsEmpty());
+
+  history.MarkNoneReported();
+  EXPECT_THAT(Unreported(history), ElementsAre(1, 3, 2));
+}
+
+// A reference implementation of the history, as a list.
+class ListContactHistory {
+ public:
+  void Add(const Contact& contact) {
+    for (auto it = contacts_.begin(); it != contacts_.end(); ++it) {
+      if (it->other_uuid != contact.other_uuid) continue;
+      if (it == last_reported_) {
+        last_reported_ =
+            it == contacts_.begin() ? contacts_.end() : std::prev(it);
+      }
+      contacts_.erase(it);
+      break;
+    }
+    contacts_.push_back(contact);
+  }
+  void RemoveContactsBefore(const absl::Time time) {
+    while (!contacts_.empty() && contacts_.front().exposure.start_time +
+                                         contacts_.front().exposure.duration <
+                                     time) {
+      if (contacts_.begin() == last_reported_) last_reported_ = contacts_.end();
+      contacts_.pop_front();
+    }
+  }
+  std::vector<int64> Unreported() const {
+    std::vector<int64> uuids;
+    for (auto it = contacts_.rbegin(); it != contacts_.rend(); ++it) {
+      if (last_reported_ != contacts_.end() &&
+          last_reported_ == std::prev(it.base())) {
+        break;
+      }
+      uuids.push_back(it->other_uuid);
+    }
+    return uuids;
+  }
+  void MarkAllReported() {
+    last_reported_ =
+        contacts_.empty() ? contacts_.end() : std::prev(contacts_.end());
+  }
+  void MarkNoneReported() { last_reported_ = contacts_.end(); }
+  int size() const { return contacts_.size(); }
+
+ private:
+  std::list<Contact> contacts_;
+  std::list<Contact>::const_iterator last_reported_ = contacts_.end();
+};
+
+TEST(ContactHistoryTest, MatchesListImplementation) {
+  absl::BitGen gen;
+  ContactHistory history;
+  ListContactHistory expected;
+  // Agents meet a few regular contacts every day, and others at random.
+  for (int hour = 0; hour < 24 * 60; ++hour) {
+    const int64 other_uuid = absl::Bernoulli(gen, 0.5)
+                                 ? absl::Uniform(gen, 0, 5)
+                                 : absl::Uniform(gen, 0, 1000);
+    const Contact contact = ContactEndingAt(
+        other_uuid, hour + absl::Uniform(gen, 0, 24));
+    history.Add(contact);
+    expected.Add(contact);
+    if (hour % 24 == 0) {
+      const absl::Time time = absl::UnixEpoch() + absl::Hours(hour - 24 * 7);
+      history.RemoveContactsBefore(time);
+      expected.RemoveContactsBefore(time);
+    }
+    if (absl::Bernoulli(gen, 0.1)) {
+      history.MarkAllReported();
+      expected.MarkAllReported();
+    }
+    if (absl::Bernoulli(gen, 0.01)) {
+      history.MarkNoneReported();
+      expected.MarkNoneReported();
+    }
+    ASSERT_EQ(history.size(), expected.size()) << hour;
+    ASSERT_EQ(Unreported(history), expected.Unreported()) << hour;
+  }
+}
+
+}  // namespace
+}  // namespace abesim
@@ -14,28 +14,22 @@
 
 #include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
 
+#include <algorithm>
+#include <numeric>
+
 #include "absl/random/distributions.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
 
-void DurationSpecifiedVisitGenerator::GenerateVisits(
-    const Timestep& timestep, const RiskScore& risk_score,
-    std::vector<Visit>* visits) {
+void AppendScheduledVisits(const Timestep& timestep,
+                           const absl::Span<const int64> location_uuids,
+                           const absl::Span<float> durations,
+                           std::vector<Visit>* const visits) {
   DCHECK(visits != nullptr);
-  std::vector<float> durations;
-  for (const LocationDuration& location_duration : location_durations_) {
-    auto adjustment = risk_score.GetVisitAdjustment(
-        timestep, location_duration.location_uuid);
-    if (!absl::Bernoulli(gen_, adjustment.frequency_adjustment)) {
-      durations.push_back(0.0);
-    } else {
-      float sample =
-          location_duration.sample_duration(adjustment.duration_adjustment);
-      durations.push_back(std::max(0.0f, sample));
-    }
-  }
+  DCHECK_EQ(location_uuids.size(), durations.size());
+  for (float& duration : durations) duration = std::max(0.0f, duration);
   float normalizer = std::accumulate(durations.begin(), durations.end(), 0.0f);
   if (normalizer == 0.0f) {
     // Agents have to be somewhere.  If they don't sample any location, then
@@ -43,9 +37,9 @@ void DurationSpecifiedVisitGenerator::GenerateVisits(
     normalizer = durations[0] = 1.0f;
   }
   absl::Time start_time = timestep.start_time();
-  for (int i = 0; i < location_durations_.size(); ++i) {
+  for (int i = 0; i < location_uuids.size(); ++i) {
     absl::Time end_time;
-    if (i == location_durations_.size() - 1) {
+    if (i == location_uuids.size() - 1) {
       end_time = timestep.end_time();
     } else {
       end_time = std::min(
@@ -53,7 +47,7 @@ void DurationSpecifiedVisitGenerator::GenerateVisits(
           start_time + (durations[i] / normalizer) * timestep.duration());
     }
     if (end_time <= start_time) continue;
-    Visit visit{.location_uuid = location_durations_[i].location_uuid,
+    Visit visit{.location_uuid = location_uuids[i],
                 .start_time = start_time,
                 .end_time = end_time};
     start_time = end_time;
@@ -61,4 +55,39 @@ void DurationSpecifiedVisitGenerator::GenerateVisits(
   }
 }
 
+DurationSpecifiedVisitGenerator::DurationSpecifiedVisitGenerator(
+    const std::vector<LocationDuration>& location_durations)
+    : location_durations_(location_durations) {
+  for (const LocationDuration& location_duration : location_durations_) {
+    location_uuids_.push_back(location_duration.location_uuid);
+  }
+}
+
+void DurationSpecifiedVisitGenerator::GenerateVisits(
+    const Timestep& timestep, const RiskScore& risk_score,
+    std::vector<Visit>* visits) {
+  DCHECK(visits != nullptr);
+  thread_local std::vector<float> durations;
+  durations.clear();
+  for (const LocationDuration& location_duration : location_durations_) {
+    auto adjustment = risk_score.GetVisitAdjustment(
+        timestep, location_duration.location_uuid);
+    if (!absl::Bernoulli(gen_, adjustment.frequency_adjustment)) {
+      durations.push_back(0.0);
+    } else {
+      durations.push_back(
+          location_duration.sample_duration(adjustment.duration_adjustment));
+    }
+  }
+  AppendScheduledVisits(timestep, location_uuids_, absl::MakeSpan(durations),
+                        visits);
+}
+
+bool DurationSpecifiedVisitGenerator::GetPossibleLocations(
+    std::vector<int64>* const location_uuids) const {
+  location_uuids->insert(location_uuids->end(), location_uuids_.begin(),
+                         location_uuids_.end());
+  return true;
+}
+
 }  // namespace abesim
@@ -17,8 +17,12 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_DURATION_SPECIFIED_VISIT_GENERATOR_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_DURATION_SPECIFIED_VISIT_GENERATOR_H_
 
+#include <functional>
+#include <vector>
+
 #include "absl/random/random.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
@@ -40,17 +44,30 @@ struct LocationDuration {
   std::function<float(float adjustment)> sample_duration;
 };
 
+// Appends a visit to each of location_uuids in turn, covering timestep, where
+// durations holds the sampled duration of each visit.  Negative durations are
+// treated as zero, and the rest are scaled to sum to the timestep duration.
+// Visits that are left empty are skipped.  If every duration is zero the
+// agent spends the whole timestep at its first location.  durations is
+// modified.
+void AppendScheduledVisits(const Timestep& timestep,
+                           absl::Span<const int64> location_uuids,
+                           absl::Span<float> durations,
+                           std::vector<Visit>* visits);
+
 class DurationSpecifiedVisitGenerator : public VisitGenerator {
  public:
   explicit DurationSpecifiedVisitGenerator(
-      const std::vector<LocationDuration>& location_durations)
-      : location_durations_(location_durations) {}
+      const std::vector<LocationDuration>& location_durations);
 
   void GenerateVisits(const Timestep& timestep, const RiskScore& risk_score,
                       std::vector<Visit>* visits) override;
 
+  bool GetPossibleLocations(std::vector<int64>* location_uuids) const override;
+
  private:
   std::vector<LocationDuration> location_durations_;
+  std::vector<int64> location_uuids_;
   absl::BitGen gen_;
 };
 
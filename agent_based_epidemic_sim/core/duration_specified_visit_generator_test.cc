@@ -117,7 +117,8 @@ class MockRiskScore : public RiskScore {
   MOCK_METHOD(void, AddExposures, (absl::Span<const Exposure* const> exposures),
               (override));
   MOCK_METHOD(void, AddExposureNotification,
-              (const Contact& contact, const TestResult& result), (override));
+              (const Contact& contact, const TestResult& result, int hops),
+              (override));
   MOCK_METHOD(VisitAdjustment, GetVisitAdjustment,
               (const Timestep& timestep, int64 location_uuid),
               (const, override));
@@ -196,5 +197,14 @@ TEST(DurationSpecifiedVisitGeneratorTest, GeneratesDurationAdjustedVisits) {
   EXPECT_EQ(timestep.end_time(), visits[1].end_time);
 }
 
+TEST(DurationSpecifiedVisitGeneratorTest, ReportsPossibleLocations) {
+  const std::vector<float> durations{8, 6, 2};
+  DurationSpecifiedVisitGenerator visit_generator(
+      MakeLocationDurationVector(durations));
+  std::vector<int64> location_uuids = {42};
+  EXPECT_TRUE(visit_generator.GetPossibleLocations(&location_uuids));
+  EXPECT_THAT(location_uuids, testing::ElementsAre(42, 0, 1, 2));
+}
+
 }  // namespace
 }  // namespace abesim
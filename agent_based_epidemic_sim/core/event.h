@@ -75,17 +75,22 @@ static_assert(absl::is_trivially_copy_constructible<HealthTransition>::value,
 //   entity.
 // Each count in micro_exposure_counts represents a duration in minutes that the
 // two entities spent at a particular distance (as represented by the index).
+// An exposure may stand for several like it, for example when a location only
+// samples some of the contacts that occurred.  The transmission model then
+// counts it weight times over.
 struct Exposure {
   absl::Time start_time;
   absl::Duration duration;
   std::array<uint8, kNumberMicroExposureBuckets> micro_exposure_counts = {};
   float infectivity;
   float symptom_factor;
+  float weight = 1.0f;
 
   friend bool operator==(const Exposure& a, const Exposure& b) {
     return (a.start_time == b.start_time && a.duration == b.duration &&
             a.infectivity == b.infectivity &&
-            a.micro_exposure_counts == b.micro_exposure_counts);
+            a.micro_exposure_counts == b.micro_exposure_counts &&
+            a.weight == b.weight);
   }
 
   friend bool operator!=(const Exposure& a, const Exposure& b) {
@@ -238,11 +243,18 @@ struct ContactReport {
   int64 from_agent_uuid;
   int64 to_agent_uuid;
   TestResult test_result;
+  // The number of contacts the report has passed along to reach
+  // to_agent_uuid: 1 for a report sent by the tested agent itself, 2 for one
+  // forwarded by a contact of that agent, and so on.
+  int32 hops = 1;
+  // The tested agent whose test_result is reported.
+  int64 origin_agent_uuid = from_agent_uuid;
 
   friend bool operator==(const ContactReport& a, const ContactReport& b) {
     return (a.from_agent_uuid == b.from_agent_uuid &&
             a.to_agent_uuid == b.to_agent_uuid &&
-            a.test_result == b.test_result);
+            a.test_result == b.test_result && a.hops == b.hops &&
+            a.origin_agent_uuid == b.origin_agent_uuid);
   }
 
   friend bool operator!=(const ContactReport& a, const ContactReport& b) {
@@ -253,7 +265,8 @@ struct ContactReport {
                                   const ContactReport& contact_report) {
     return strm << "{" << contact_report.from_agent_uuid << ", "
                 << contact_report.to_agent_uuid << ", "
-                << contact_report.test_result << "}";
+                << contact_report.test_result << ", " << contact_report.hops
+                << ", " << contact_report.origin_agent_uuid << "}";
   }
 };
 
@@ -14,96 +14,182 @@
 
 #include "agent_based_epidemic_sim/core/graph_location.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
-#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
 
 namespace abesim {
 
 namespace {
 
+// Outcomes are sent in batches of about this size, which amortizes the cost
+// of sending without holding every outcome of a dense graph in memory.
+constexpr int kMaxBufferedOutcomes = 1024;
+
 class GraphLocation : public Location {
  public:
   GraphLocation(int64 uuid, float drop_probability,
-                std::vector<std::pair<int64, int64>> graph,
+                const std::vector<std::pair<int64, int64>>& graph,
                 absl::Duration visit_length_mean,
                 absl::Duration visit_length_stddev,
                 std::unique_ptr<ExposureGenerator> exposure_generator)
       : uuid_(uuid),
         drop_probability_(drop_probability),
-        graph_(std::move(graph)),
-        visit_length_mean_(visit_length_mean),
-        visit_length_stddev_(visit_length_stddev),
-        exposure_generator_(std::move(exposure_generator)) {}
+        log_drop_probability_(std::log(drop_probability)),
+        visit_length_mean_hours_(absl::ToDoubleHours(visit_length_mean)),
+        visit_length_stddev_hours_(absl::ToDoubleHours(visit_length_stddev)),
+        exposure_generator_(std::move(exposure_generator)) {
+    BuildAdjacency(graph);
+  }
 
   int64 uuid() const override { return uuid_; }
 
   void ProcessVisits(absl::Span<const Visit> visits,
                      Broker<InfectionOutcome>* infection_broker) override {
-    thread_local absl::flat_hash_map<int64, float> infectivity;
-    thread_local absl::flat_hash_map<int64, float> symptom_factor;
-    infectivity.clear();
+    // Mark the nodes present.  An agent visiting more than once is exposed
+    // with the infectivity of its last visit.
     for (const Visit& visit : visits) {
-      infectivity[visit.agent_uuid] = visit.infectivity;
-      symptom_factor[visit.agent_uuid] = visit.symptom_factor;
+      const auto node = node_index_.find(visit.agent_uuid);
+      if (node == node_index_.end()) continue;
+      const int n = node->second;
+      if (!IsPresent(n)) {
+        SetPresent(n, true);
+        present_.push_back(n);
+      }
+      infectivity_[n] = visit.infectivity;
+      symptom_factor_[n] = visit.symptom_factor;
     }
-
-    for (const std::pair<int64, int64>& edge : graph_) {
-      // Randomly drop some potential contacts.
-      if (absl::Bernoulli(gen_, drop_probability_)) continue;
-
-      // If either of the participants are not present, no contact is generated.
-      auto first_infectivity = infectivity.find(edge.first);
-      if (first_infectivity == infectivity.end()) continue;
-      auto second_infectivity = infectivity.find(edge.second);
-      if (second_infectivity == infectivity.end()) continue;
-      auto first_symptom_factor = symptom_factor.find(edge.first);
-      if (first_symptom_factor == symptom_factor.end()) continue;
-      auto second_symptom_factor = symptom_factor.find(edge.second);
-      if (second_symptom_factor == symptom_factor.end()) continue;
-
-      // If two agents are connected by an edge, we  randomly generate a
-      // duration and the corresponding micro exposures that result.
-      const float mean = absl::FDivDuration(visit_length_mean_, absl::Hours(1));
-      const float stdev =
-          absl::FDivDuration(visit_length_stddev_, absl::Hours(1));
-      const absl::Duration overlap =
-          absl::Hours(absl::Gaussian(gen_, mean, stdev));
-
-      infection_broker->Send(
-          {{
-               .agent_uuid = edge.first,
-               .exposure = exposure_generator_->Generate(
-                   absl::UnixEpoch(), overlap, second_infectivity->second,
-                   second_symptom_factor->second),
-               .exposure_type = InfectionOutcomeProto::CONTACT,
-               .source_uuid = edge.second,
-           },
-           {
-               .agent_uuid = edge.second,
-               .exposure = exposure_generator_->Generate(
-                   absl::UnixEpoch(), overlap, first_infectivity->second,
-                   first_symptom_factor->first),
-               .exposure_type = InfectionOutcomeProto::CONTACT,
-               .source_uuid = edge.first,
-           }});
+    // Nodes are visited in index order so that, for a given random sequence,
+    // the outcomes only depend on which agents are present.
+    std::sort(present_.begin(), present_.end());
+
+    // Edges are kept independently, so instead of drawing for each edge
+    // whether it is dropped, draw the number of edges dropped before the next
+    // one kept.  Only the edges of present nodes are considered at all.
+    outcomes_.clear();
+    int64 skip = EdgesToSkip();
+    for (const int first : present_) {
+      const int64 end = edge_offsets_[first + 1];
+      int64 edge = edge_offsets_[first] + skip;
+      for (; edge < end; edge += 1 + EdgesToSkip()) {
+        const int second = edge_targets_[edge];
+        if (!IsPresent(second)) continue;
+        // If two agents are connected by an edge, we randomly generate a
+        // duration and the corresponding micro exposures that result.
+        const absl::Duration overlap = absl::Hours(absl::Gaussian(
+            gen_, visit_length_mean_hours_, visit_length_stddev_hours_));
+        AddContact(first, second, overlap);
+        AddContact(second, first, overlap);
+        if (outcomes_.size() >= kMaxBufferedOutcomes) {
+          infection_broker->Send(outcomes_);
+          outcomes_.clear();
+        }
+      }
+      skip = edge - end;
     }
+    infection_broker->Send(outcomes_);
+
+    for (const int n : present_) SetPresent(n, false);
+    present_.clear();
   }
 
  private:
+  // Stores each edge once, with the endpoint of lower index as its source, in
+  // compressed sparse row form.
+  void BuildAdjacency(const std::vector<std::pair<int64, int64>>& graph) {
+    auto index = [this](const int64 uuid) {
+      const auto [node, inserted] =
+          node_index_.try_emplace(uuid, node_uuids_.size());
+      if (inserted) node_uuids_.push_back(uuid);
+      return node->second;
+    };
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(graph.size());
+    for (const auto& [a, b] : graph) {
+      const int first = index(a);
+      const int second = index(b);
+      edges.emplace_back(std::min(first, second), std::max(first, second));
+    }
+    const int num_nodes = node_uuids_.size();
+    edge_offsets_.assign(num_nodes + 1, 0);
+    for (const auto& edge : edges) ++edge_offsets_[edge.first + 1];
+    for (int n = 0; n < num_nodes; ++n) {
+      edge_offsets_[n + 1] += edge_offsets_[n];
+    }
+    edge_targets_.resize(edges.size());
+    std::vector<int64> filled(edge_offsets_.begin(), edge_offsets_.end() - 1);
+    for (const auto& edge : edges) {
+      edge_targets_[filled[edge.first]++] = edge.second;
+    }
+    presence_.assign((num_nodes + 63) / 64, 0);
+    infectivity_.resize(num_nodes);
+    symptom_factor_.resize(num_nodes);
+  }
+
+  // Returns the number of edges dropped before the next one kept.
+  int64 EdgesToSkip() {
+    if (drop_probability_ <= 0) return 0;
+    if (drop_probability_ >= 1) return std::numeric_limits<int64>::max() / 2;
+    const double skip = std::floor(
+        std::log(absl::Uniform(absl::IntervalOpenClosed, gen_, 0.0, 1.0)) /
+        log_drop_probability_);
+    return std::min<double>(skip, std::numeric_limits<int64>::max() / 2);
+  }
+
+  void AddContact(const int agent, const int source,
+                  const absl::Duration overlap) {
+    outcomes_.push_back({
+        .agent_uuid = node_uuids_[agent],
+        .exposure = exposure_generator_->Generate(absl::UnixEpoch(), overlap,
+                                                  infectivity_[source],
+                                                  symptom_factor_[source]),
+        .exposure_type = InfectionOutcomeProto::CONTACT,
+        .source_uuid = node_uuids_[source],
+    });
+  }
+
+  bool IsPresent(const int n) const {
+    return presence_[n / 64] >> (n % 64) & 1;
+  }
+  void SetPresent(const int n, const bool present) {
+    const uint64 bit = uint64{1} << (n % 64);
+    presence_[n / 64] = present ? presence_[n / 64] | bit
+                                : presence_[n / 64] & ~bit;
+  }
+
   const int64 uuid_;
   const float drop_probability_;
-  const std::vector<std::pair<int64, int64>> graph_;
-  const absl::Duration visit_length_mean_;
-  const absl::Duration visit_length_stddev_;
+  const double log_drop_probability_;
+  const double visit_length_mean_hours_;
+  const double visit_length_stddev_hours_;
   std::unique_ptr<ExposureGenerator> exposure_generator_;
   absl::BitGen gen_;
+
+  // Agents in the graph are numbered by local node indices.
+  absl::flat_hash_map<int64, int> node_index_;
+  std::vector<int64> node_uuids_;
+  // The edges of node n lead to edge_targets_[edge_offsets_[n],
+  // edge_offsets_[n + 1]), each of which has an index no lower than n.
+  std::vector<int64> edge_offsets_;
+  std::vector<int> edge_targets_;
+
+  // Per call state, by node index.  Only the entries of present nodes are
+  // meaningful, and the presence bits are cleared after each call.
+  std::vector<uint64> presence_;
+  std::vector<float> infectivity_;
+  std::vector<float> symptom_factor_;
+  std::vector<int> present_;
+  std::vector<InfectionOutcome> outcomes_;
 };
 
 }  // namespace
@@ -113,9 +199,10 @@ std::unique_ptr<Location> NewGraphLocation(
     std::vector<std::pair<int64, int64>> graph,
     absl::Duration visit_length_mean, absl::Duration visit_length_stddev,
     std::unique_ptr<ExposureGenerator> exposure_generator) {
-  return absl::make_unique<GraphLocation>(
-      uuid, drop_probability, std::move(graph), visit_length_mean,
-      visit_length_stddev, std::move(exposure_generator));
+  return absl::make_unique<GraphLocation>(uuid, drop_probability, graph,
+                                          visit_length_mean,
+                                          visit_length_stddev,
+                                          std::move(exposure_generator));
 }
 
 }  // namespace abesim
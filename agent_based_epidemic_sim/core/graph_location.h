@@ -18,7 +18,10 @@
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_GRAPH_LOCATION_H_
 
 #include <memory>
+#include <utility>
+#include <vector>
 
+#include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/location.h"
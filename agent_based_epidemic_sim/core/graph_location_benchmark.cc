@@ -0,0 +1,87 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures GraphLocation::ProcessVisits on a random graph of range(0) edges
+// between range(0) / 10 agents, of whom range(1) percent visit, with half of
+// the edges dropped on each call.
+
+#include <utility>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/graph_location.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+class CountingBroker : public Broker<InfectionOutcome> {
+ public:
+  void Send(absl::Span<const InfectionOutcome> msgs) override {
+    count_ += msgs.size();
+  }
+  int64 count() const { return count_; }
+
+ private:
+  int64 count_ = 0;
+};
+
+void BM_ProcessVisits(benchmark::State& state) {
+  const int num_edges = state.range(0);
+  const int num_agents = num_edges / 10;
+  absl::BitGen gen;
+  std::vector<std::pair<int64, int64>> graph;
+  graph.reserve(num_edges);
+  for (int i = 0; i < num_edges; ++i) {
+    graph.emplace_back(absl::Uniform(gen, 0, num_agents),
+                       absl::Uniform(gen, 0, num_agents));
+  }
+  std::vector<Visit> visits;
+  for (int i = 0; i < num_agents; ++i) {
+    if (absl::Uniform(gen, 0, 100) >= state.range(1)) continue;
+    visits.push_back({.location_uuid = 0,
+                      .agent_uuid = i,
+                      .start_time = absl::UnixEpoch(),
+                      .end_time = absl::UnixEpoch() + absl::Hours(8),
+                      .health_state = HealthState::SUSCEPTIBLE,
+                      .infectivity = 0.0f,
+                      .symptom_factor = 0.0f});
+  }
+  auto location = NewGraphLocation(0, 0.5, std::move(graph), absl::Hours(8),
+                                   absl::Hours(2),
+                                   MicroExposureGeneratorBuilder().Build());
+  CountingBroker broker;
+  for (auto _ : state) {
+    location->ProcessVisits(visits, &broker);
+  }
+  state.counters["outcomes"] =
+      static_cast<double>(broker.count()) / state.iterations();
+}
+
+BENCHMARK(BM_ProcessVisits)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgPair(1 << 14, 10)
+    ->ArgPair(1 << 14, 100)
+    ->ArgPair(1 << 20, 10)
+    ->ArgPair(1 << 20, 100);
+
+}  // namespace
+}  // namespace abesim
@@ -42,6 +42,7 @@ class FakeExposureGenerator : public ExposureGenerator {
                     const float infectivity, const float symptom_factor) {
     return {
         .infectivity = infectivity,
+        .symptom_factor = symptom_factor,
     };
   }
 };
@@ -49,11 +50,13 @@ class FakeExposureGenerator : public ExposureGenerator {
 static constexpr int kLocationUUID = 1;
 
 Visit GenerateVisit(int64 agent, HealthState::State health_state) {
+  const bool infectious = health_state == HealthState::INFECTIOUS;
   return {
       .location_uuid = kLocationUUID,
       .agent_uuid = agent,
       .health_state = health_state,
-      .infectivity = (health_state == HealthState::INFECTIOUS) ? 1.0f : 0.0f,
+      .infectivity = infectious ? 1.0f : 0.0f,
+      .symptom_factor = infectious ? 0.5f : 0.0f,
   };
 }
 InfectionOutcome ExpectedOutcome(int64 agent, int64 source, float infectivity) {
@@ -115,5 +118,76 @@ TEST(GraphLocationTest, AllSamplesDropped) {
   EXPECT_TRUE(broker.visits().empty());
 }
 
+TEST(GraphLocationTest, PassesSymptomFactorOfSource) {
+  auto location = NewGraphLocation(kLocationUUID, 0.0, {{0, 1}, {2, 1}},
+                                   absl::Hours(8), absl::Hours(2),
+                                   std::make_unique<FakeExposureGenerator>());
+  FakeBroker broker;
+  location->ProcessVisits(
+      {
+          GenerateVisit(0, HealthState::SUSCEPTIBLE),
+          GenerateVisit(1, HealthState::INFECTIOUS),
+          GenerateVisit(2, HealthState::SUSCEPTIBLE),
+      },
+      &broker);
+  ASSERT_EQ(broker.visits().size(), 4);
+  for (const InfectionOutcome& outcome : broker.visits()) {
+    EXPECT_EQ(outcome.exposure.symptom_factor,
+              outcome.source_uuid == 1 ? 0.5f : 0.0f)
+        << outcome.agent_uuid << " " << outcome.source_uuid;
+  }
+}
+
+TEST(GraphLocationTest, ForgetsVisitsOfPreviousCalls) {
+  auto location = NewGraphLocation(kLocationUUID, 0.0, {{0, 1}, {1, 2}},
+                                   absl::Hours(8), absl::Hours(2),
+                                   std::make_unique<FakeExposureGenerator>());
+  {
+    FakeBroker broker;
+    location->ProcessVisits(
+        {
+            GenerateVisit(0, HealthState::INFECTIOUS),
+            GenerateVisit(1, HealthState::SUSCEPTIBLE),
+        },
+        &broker);
+    EXPECT_THAT(broker.visits(), testing::UnorderedElementsAreArray({
+                                     ExpectedOutcome(0, 1, 0.0),  //
+                                     ExpectedOutcome(1, 0, 1.0),  //
+                                 }));
+  }
+  {
+    FakeBroker broker;
+    location->ProcessVisits(
+        {
+            GenerateVisit(1, HealthState::SUSCEPTIBLE),
+            GenerateVisit(2, HealthState::SUSCEPTIBLE),
+        },
+        &broker);
+    EXPECT_THAT(broker.visits(), testing::UnorderedElementsAreArray({
+                                     ExpectedOutcome(1, 2, 0.0),  //
+                                     ExpectedOutcome(2, 1, 0.0),  //
+                                 }));
+  }
+}
+
+TEST(GraphLocationTest, DropsEdgesWithDropProbability) {
+  // A star of kEdges edges around agent 0, with every agent present.
+  constexpr int kEdges = 100000;
+  std::vector<std::pair<int64, int64>> graph;
+  std::vector<Visit> visits = {GenerateVisit(0, HealthState::SUSCEPTIBLE)};
+  for (int i = 1; i <= kEdges; ++i) {
+    graph.emplace_back(i, 0);
+    visits.push_back(GenerateVisit(i, HealthState::SUSCEPTIBLE));
+  }
+  auto location = NewGraphLocation(kLocationUUID, 0.75, graph, absl::Hours(8),
+                                   absl::Hours(2),
+                                   std::make_unique<FakeExposureGenerator>());
+  FakeBroker broker;
+  location->ProcessVisits(visits, &broker);
+  // Two outcomes for each of the roughly 25000 edges kept, give or take a few
+  // standard deviations.
+  EXPECT_NEAR(broker.visits().size(), 2 * 0.25 * kEdges, 2 * 1000);
+}
+
 }  // namespace
 }  // namespace abesim
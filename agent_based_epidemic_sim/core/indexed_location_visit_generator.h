@@ -39,6 +39,10 @@ class IndexedLocationVisitGenerator : public VisitGenerator {
   void GenerateVisits(const Timestep& timestep, const RiskScore& risk_score,
                       std::vector<Visit>* visits) override;
 
+  bool GetPossibleLocations(std::vector<int64>* location_uuids) const override {
+    return visit_generator_->GetPossibleLocations(location_uuids);
+  }
+
  private:
   absl::BitGen gen_;
   std::unique_ptr<VisitGenerator> visit_generator_;
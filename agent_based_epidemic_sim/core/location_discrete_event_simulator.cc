@@ -14,10 +14,9 @@
 
 #include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
 
-#include <memory>
-#include <queue>
+#include <algorithm>
+#include <vector>
 
-#include "absl/random/random.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
 #include "agent_based_epidemic_sim/port/logging.h"
@@ -28,48 +27,56 @@ namespace {
 // TODO: Move  into an event message about visiting infectious agents.
 constexpr float kInfectivity = 1;
 
-// Corresponds to the record of a visiting agent in a location.
-struct VisitNode {
-  const Visit* visit;
-  std::list<VisitNode*>::iterator pos;
-  std::vector<Contact> contacts;
-
-  VisitNode() = default;
-  explicit VisitNode(const Visit* node_visit) : visit(node_visit) {}
+// The arrival or departure time of a visit.
+struct VisitTime {
+  absl::Time time;
+  int visit;
 };
 
-// The type of event.
-enum class EventType { ARRIVAL = 0, DEPARTURE = 1 };
+// Orders by time, breaking ties by visit index so that the order of events,
+// and hence of contacts, only depends on the input.
+bool IsEarlier(const VisitTime& a, const VisitTime& b) {
+  if (a.time != b.time) return a.time < b.time;
+  return a.visit < b.visit;
+}
 
-// An event corresponding to an arrival or departure of an individual with some
-// state of health.
-struct Event {
-  EventType type;
-  VisitNode* node;
+// Scratch space for ProcessVisits.  It is reused across calls on each thread,
+// so that once its buffers have grown, processing visits does not allocate.
+struct ContactSweep {
+  std::vector<VisitTime> arrivals;
+  std::vector<VisitTime> departures;
+  // Whether each visit exposes others to infection.
+  std::vector<bool> is_source;
+  // The visits present at the location, in no particular order, split by
+  // is_source, and the position of each visit in its list.
+  std::vector<int> active_sources;
+  std::vector<int> active_others;
+  std::vector<int> active_pos;
+  // The outcomes for visit i are outcomes[offsets[i], offsets[i + 1]), in the
+  // order they are recorded.  filled[i] counts those recorded so far.
+  std::vector<int> offsets;
+  std::vector<int> filled;
+  std::vector<InfectionOutcome> outcomes;
+  // The number of sources that arrived before each visit.
+  std::vector<int> sources_before;
 };
 
-// Sorts the event list by time in ascending order.
-bool IsEventEarlier(const Event& a, const Event& b) {
-  auto event_time_fn = [](const Event& event) {
-    return event.type == EventType::ARRIVAL ? event.node->visit->start_time
-                                            : event.node->visit->end_time;
-  };
-  return event_time_fn(a) < event_time_fn(b);
-}
-
-void ConvertVisitsToEvents(
-    const absl::Span<const Visit> visits, std::vector<Event>* events,
-    std::vector<std::unique_ptr<VisitNode>>* visit_nodes) {
-  for (const Visit& visit : visits) {
-    if (visit.start_time >= visit.end_time) {
-      LOG(DFATAL) << "Skipping visit end_time <= start_time: " << visit;
-      continue;
+// Calls on_arrival and on_departure with the index of each visit in turn, in
+// order of arrival and departure times.  Visits that end when another starts
+// do not overlap it, so they depart first.
+template <typename ArrivalFn, typename DepartureFn>
+void Sweep(absl::Span<const VisitTime> arrivals,
+           absl::Span<const VisitTime> departures, ArrivalFn on_arrival,
+           DepartureFn on_departure) {
+  int next_departure = 0;
+  for (const VisitTime& arrival : arrivals) {
+    while (departures[next_departure].time <= arrival.time) {
+      on_departure(departures[next_departure++].visit);
     }
-    visit_nodes->push_back(absl::make_unique<VisitNode>(&visit));
-    events->push_back(
-        {.type = EventType::ARRIVAL, .node = visit_nodes->back().get()});
-    events->push_back(
-        {.type = EventType::DEPARTURE, .node = visit_nodes->back().get()});
+    on_arrival(arrival.visit);
+  }
+  for (; next_departure < departures.size(); ++next_departure) {
+    on_departure(departures[next_departure].visit);
   }
 }
 
@@ -78,22 +85,6 @@ absl::Duration Overlap(const Visit& a, const Visit& b) {
          std::max(a.start_time, b.start_time);
 }
 
-void RecordContact(VisitNode* a, VisitNode* b,
-                   ExposureGenerator* exposure_generator) {
-  const absl::Duration overlap = Overlap(*a->visit, *b->visit);
-
-  a->contacts.push_back({.other_uuid = b->visit->agent_uuid,
-                         .other_state = b->visit->health_state,
-                         .exposure = exposure_generator->Generate(
-                             b->visit->start_time, overlap,
-                             b->visit->infectivity, b->visit->symptom_factor)});
-  b->contacts.push_back({.other_uuid = a->visit->agent_uuid,
-                         .other_state = a->visit->health_state,
-                         .exposure = exposure_generator->Generate(
-                             a->visit->start_time, overlap,
-                             a->visit->infectivity, a->visit->symptom_factor)});
-}
-
 }  // namespace
 
 void LocationDiscreteEventSimulator::ProcessVisits(
@@ -111,34 +102,109 @@ void LocationDiscreteEventSimulator::ProcessVisits(
                        });
   };
   DCHECK(matches_uuid_fn(visits)) << "Found incorrect Visit uuid.";
-  thread_local std::vector<Event> events(2 * visits.size());
-  events.clear();
-  thread_local std::vector<std::unique_ptr<VisitNode>> visit_nodes(
-      visits.size());
-  visit_nodes.clear();
-  ConvertVisitsToEvents(visits, &events, &visit_nodes);
-  std::sort(events.begin(), events.end(), IsEventEarlier);
-  std::list<VisitNode*> active_visits;
-  for (Event& event : events) {
-    if (event.type == EventType::ARRIVAL) {
-      for (VisitNode* node : active_visits) {
-        RecordContact(event.node, node, exposure_generator_.get());
-      }
-      event.node->pos = active_visits.insert(active_visits.end(), event.node);
-    } else {
-      std::vector<InfectionOutcome> infection_outcomes;
-      infection_outcomes.reserve(event.node->contacts.size());
-      for (const Contact& contact : event.node->contacts) {
-        infection_outcomes.push_back(
-            {.agent_uuid = event.node->visit->agent_uuid,
-             .exposure = contact.exposure,
-             .exposure_type = InfectionOutcomeProto::CONTACT,
-             .source_uuid = contact.other_uuid});
-      }
-      infection_broker->Send(infection_outcomes);
-      active_visits.erase(event.node->pos);
+  thread_local ContactSweep thread_sweep;
+  // Accessing a thread_local is not free, so the loops below use a reference.
+  ContactSweep& sweep = thread_sweep;
+  sweep.arrivals.clear();
+  sweep.departures.clear();
+  for (int i = 0; i < visits.size(); ++i) {
+    const Visit& visit = visits[i];
+    if (visit.start_time >= visit.end_time) {
+      LOG(DFATAL) << "Skipping visit end_time <= start_time: " << visit;
+      continue;
     }
+    sweep.arrivals.push_back({.time = visit.start_time, .visit = i});
+    sweep.departures.push_back({.time = visit.end_time, .visit = i});
   }
+  std::sort(sweep.arrivals.begin(), sweep.arrivals.end(), IsEarlier);
+  std::sort(sweep.departures.begin(), sweep.departures.end(), IsEarlier);
+
+  // In kInfectiousContactsOnly mode, visits with no infectivity cannot
+  // expose anyone, so their contacts are skipped.
+  sweep.is_source.resize(visits.size());
+  for (int i = 0; i < visits.size(); ++i) {
+    sweep.is_source[i] = contact_mode_ == ContactMode::kAllContacts ||
+                         visits[i].infectivity > 0.0f;
+  }
+
+  // A visit receives an outcome from every source present when it arrives and
+  // from every source that arrives before it departs.  A first sweep counts
+  // these to lay out the outcomes of each visit contiguously.
+  sweep.offsets.assign(visits.size() + 1, 0);
+  sweep.sources_before.resize(visits.size());
+  int sources_present = 0;
+  int sources_arrived = 0;
+  Sweep(
+      sweep.arrivals, sweep.departures,
+      [&sweep, &sources_present, &sources_arrived](const int visit) {
+        sweep.offsets[visit + 1] = sources_present;
+        sweep.sources_before[visit] = sources_arrived;
+        if (sweep.is_source[visit]) {
+          ++sources_present;
+          ++sources_arrived;
+        }
+      },
+      [&sweep, &sources_present, &sources_arrived](const int visit) {
+        const bool is_source = sweep.is_source[visit];
+        sweep.offsets[visit + 1] +=
+            sources_arrived - sweep.sources_before[visit] - is_source;
+        sources_present -= is_source;
+      });
+  for (int i = 0; i < visits.size(); ++i) {
+    sweep.offsets[i + 1] += sweep.offsets[i];
+  }
+  sweep.outcomes.resize(sweep.offsets.back());
+  sweep.filled.assign(visits.size(), 0);
+  sweep.active_sources.clear();
+  sweep.active_others.clear();
+  sweep.active_pos.resize(visits.size());
+
+  // Records the exposure of one visit to a source.
+  auto expose = [&sweep, &visits, this](const int visit, const int source,
+                                const absl::Duration overlap) {
+    const Visit& source_visit = visits[source];
+    sweep.outcomes[sweep.offsets[visit] + sweep.filled[visit]++] = {
+        .agent_uuid = visits[visit].agent_uuid,
+        .exposure = exposure_generator_->Generate(
+            source_visit.start_time, overlap, source_visit.infectivity,
+            source_visit.symptom_factor),
+        .exposure_type = InfectionOutcomeProto::CONTACT,
+        .source_uuid = source_visit.agent_uuid};
+  };
+  Sweep(
+      sweep.arrivals, sweep.departures,
+      [&sweep, &visits, &expose](const int visit) {
+        const bool is_source = sweep.is_source[visit];
+        for (const int other : sweep.active_sources) {
+          const absl::Duration overlap = Overlap(visits[visit], visits[other]);
+          expose(visit, other, overlap);
+          if (is_source) expose(other, visit, overlap);
+        }
+        if (is_source) {
+          for (const int other : sweep.active_others) {
+            expose(other, visit, Overlap(visits[visit], visits[other]));
+          }
+        }
+        std::vector<int>& active =
+            is_source ? sweep.active_sources : sweep.active_others;
+        sweep.active_pos[visit] = active.size();
+        active.push_back(visit);
+      },
+      [&sweep, infection_broker](const int visit) {
+        DCHECK_EQ(sweep.filled[visit],
+                  sweep.offsets[visit + 1] - sweep.offsets[visit]);
+        infection_broker->Send(absl::MakeConstSpan(sweep.outcomes)
+                                   .subspan(sweep.offsets[visit],
+                                            sweep.filled[visit]));
+        // Swap the last active visit into the departing visit's place.
+        std::vector<int>& active = sweep.is_source[visit]
+                                       ? sweep.active_sources
+                                       : sweep.active_others;
+        const int pos = sweep.active_pos[visit];
+        active[pos] = active.back();
+        sweep.active_pos[active[pos]] = pos;
+        active.pop_back();
+      });
 }
 
 }  // namespace abesim
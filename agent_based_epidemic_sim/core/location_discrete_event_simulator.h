@@ -32,9 +32,23 @@ namespace abesim {
 // Implements a sequential discrete event simulator for a Location.
 class LocationDiscreteEventSimulator : public Location {
  public:
+  // Which co-present visitors generate InfectionOutcomes for each other.
+  enum class ContactMode {
+    // Every visitor receives an outcome for every other co-present visitor.
+    kAllContacts,
+    // Visitors only receive outcomes for co-present visitors with nonzero
+    // infectivity, the only ones that can transmit.  This is cheaper when few
+    // visitors are infectious, but contacts between non-infectious visitors
+    // are invisible to contact tracing, risk scores and observers.
+    kInfectiousContactsOnly,
+  };
+
   explicit LocationDiscreteEventSimulator(
-      const int64 uuid, std::unique_ptr<ExposureGenerator> exposure_generator)
-      : uuid_(uuid), exposure_generator_(std::move(exposure_generator)) {}
+      const int64 uuid, std::unique_ptr<ExposureGenerator> exposure_generator,
+      const ContactMode contact_mode = ContactMode::kAllContacts)
+      : uuid_(uuid),
+        exposure_generator_(std::move(exposure_generator)),
+        contact_mode_(contact_mode) {}
 
   int64 uuid() const override { return uuid_; }
 
@@ -44,6 +58,7 @@ class LocationDiscreteEventSimulator : public Location {
  private:
   const int64 uuid_;
   const std::unique_ptr<ExposureGenerator> exposure_generator_;
+  const ContactMode contact_mode_;
 };
 
 }  // namespace abesim
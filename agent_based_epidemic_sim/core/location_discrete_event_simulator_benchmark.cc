@@ -0,0 +1,102 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures ProcessVisits of LocationDiscreteEventSimulator and
+// SampledContactLocation for a single location receiving range(0) visits
+// spread over a day, one in ten of them infectious.
+
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/sampled_contact_location.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+template <typename Msg>
+class CountingBroker : public Broker<Msg> {
+ public:
+  void Send(absl::Span<const Msg> msgs) override { count_ += msgs.size(); }
+  int64 count() const { return count_; }
+
+ private:
+  int64 count_ = 0;
+};
+
+std::vector<Visit> MakeVisits(const int num_visits) {
+  absl::BitGen gen;
+  std::vector<Visit> visits(num_visits);
+  for (int i = 0; i < num_visits; ++i) {
+    const absl::Time start =
+        absl::UnixEpoch() + absl::Minutes(absl::Uniform(gen, 0, 16 * 60));
+    visits[i] = {
+        .location_uuid = 0,
+        .agent_uuid = i,
+        .start_time = start,
+        .end_time = start + absl::Minutes(absl::Uniform(gen, 30, 8 * 60)),
+        .health_state = i % 10 == 0 ? HealthState::INFECTIOUS
+                                    : HealthState::SUSCEPTIBLE,
+        .infectivity = i % 10 == 0 ? 1.0f : 0.0f,
+        .symptom_factor = i % 10 == 0 ? 1.0f : 0.0f,
+    };
+  }
+  return visits;
+}
+
+void RunProcessVisits(benchmark::State& state, Location* location) {
+  const std::vector<Visit> visits = MakeVisits(state.range(0));
+  CountingBroker<InfectionOutcome> broker;
+  for (auto _ : state) {
+    location->ProcessVisits(visits, &broker);
+  }
+  state.SetItemsProcessed(state.iterations() * visits.size());
+  state.counters["outcomes_per_visit"] =
+      static_cast<double>(broker.count()) /
+      (state.iterations() * visits.size());
+}
+
+void BM_ProcessVisits(benchmark::State& state) {
+  LocationDiscreteEventSimulator location(
+      0, MicroExposureGeneratorBuilder().Build(),
+      LocationDiscreteEventSimulator::ContactMode::kAllContacts);
+  RunProcessVisits(state, &location);
+}
+void BM_ProcessVisitsInfectiousOnly(benchmark::State& state) {
+  LocationDiscreteEventSimulator location(
+      0, MicroExposureGeneratorBuilder().Build(),
+      LocationDiscreteEventSimulator::ContactMode::kInfectiousContactsOnly);
+  RunProcessVisits(state, &location);
+}
+// Samples at most 50 contacts per visit at every occupancy.
+void BM_ProcessVisitsSampled(benchmark::State& state) {
+  SampledContactLocation location(0, MicroExposureGeneratorBuilder(),
+                                  {.occupancy_threshold = 0});
+  RunProcessVisits(state, &location);
+}
+
+BENCHMARK(BM_ProcessVisits)->RangeMultiplier(4)->Range(2, 2048);
+BENCHMARK(BM_ProcessVisitsInfectiousOnly)->RangeMultiplier(4)->Range(2, 2048);
+BENCHMARK(BM_ProcessVisitsSampled)->RangeMultiplier(4)->Range(2, 8192);
+
+}  // namespace
+}  // namespace abesim
@@ -14,13 +14,19 @@
 
 #include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location_test_util.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator.h"
 #include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
 #include "agent_based_epidemic_sim/core/observer.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/recording_infection_broker.h"
 #include "agent_based_epidemic_sim/core/visit.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -28,6 +34,7 @@
 namespace abesim {
 namespace {
 
+using testing::ElementsAreArray;
 using testing::UnorderedElementsAreArray;
 
 class MockInfectionBroker : public Broker<InfectionOutcome> {
@@ -167,6 +174,71 @@ TEST(LocationDiscreteEventSimulatorTest, ContactTracing) {
   location.ProcessVisits(visits, &infection_broker);
 }
 
+// Returns the outcomes expected from visits, computed pairwise.  Visitors are
+// exposed to every visitor they overlap for a positive duration, or only to
+// infectious ones if infectious_only.
+std::vector<InfectionOutcome> PairwiseOutcomes(absl::Span<const Visit> visits,
+                                               const bool infectious_only) {
+  MicroExposureGenerator exposure_generator;
+  std::vector<InfectionOutcome> expected;
+  for (const Visit& visit : visits) {
+    for (const Visit& other : visits) {
+      const absl::Duration overlap =
+          std::min(visit.end_time, other.end_time) -
+          std::max(visit.start_time, other.start_time);
+      if (visit.agent_uuid == other.agent_uuid ||
+          overlap <= absl::ZeroDuration() ||
+          (infectious_only && other.infectivity == 0.0f)) {
+        continue;
+      }
+      expected.push_back({.agent_uuid = visit.agent_uuid,
+                          .exposure = exposure_generator.Generate(
+                              other.start_time, overlap, other.infectivity,
+                              other.symptom_factor),
+                          .exposure_type = InfectionOutcomeProto::CONTACT,
+                          .source_uuid = other.agent_uuid});
+    }
+  }
+  return expected;
+}
+
+TEST(LocationDiscreteEventSimulatorTest, RecordsContactsForAllOverlaps) {
+  const int64 kUuid = 42LL;
+  const std::vector<Visit> visits = RandomVisits(kUuid, 200, absl::Hours(1));
+  std::vector<InfectionOutcome> expected =
+      PairwiseOutcomes(visits, /*infectious_only=*/false);
+
+  RecordingInfectionBroker infection_broker;
+  MicroExposureGeneratorBuilder meg_builder;
+  LocationDiscreteEventSimulator location(kUuid, meg_builder.Build());
+  location.ProcessVisits(visits, &infection_broker);
+
+  // Each visitor's outcomes are sent together on departure.
+  EXPECT_EQ(infection_broker.sends(), visits.size());
+  SortByAgents(&expected);
+  SortByAgents(&infection_broker.outcomes());
+  EXPECT_THAT(infection_broker.outcomes(), ElementsAreArray(expected));
+}
+
+TEST(LocationDiscreteEventSimulatorTest, RecordsOnlyInfectiousContacts) {
+  const int64 kUuid = 42LL;
+  const std::vector<Visit> visits = RandomVisits(kUuid, 200, absl::Hours(1));
+  std::vector<InfectionOutcome> expected =
+      PairwiseOutcomes(visits, /*infectious_only=*/true);
+
+  RecordingInfectionBroker infection_broker;
+  MicroExposureGeneratorBuilder meg_builder;
+  LocationDiscreteEventSimulator location(
+      kUuid, meg_builder.Build(),
+      LocationDiscreteEventSimulator::ContactMode::kInfectiousContactsOnly);
+  location.ProcessVisits(visits, &infection_broker);
+
+  EXPECT_EQ(infection_broker.sends(), visits.size());
+  SortByAgents(&expected);
+  SortByAgents(&infection_broker.outcomes());
+  EXPECT_THAT(infection_broker.outcomes(), ElementsAreArray(expected));
+}
+
 TEST(LocationDiscreteEventSimulatorTest, ProcessVisitsRejectsWrongUuid) {
   auto infection_broker = absl::make_unique<MockInfectionBroker>();
   const int64 kUuid = 42LL;
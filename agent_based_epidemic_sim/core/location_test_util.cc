@@ -0,0 +1,76 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/location_test_util.h"
+
+#include <algorithm>
+#include <random>
+
+#include "absl/random/distributions.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+
+namespace abesim {
+
+std::vector<Visit> RandomVisits(const int64 location_uuid,
+                                const int num_visits,
+                                const absl::Duration time_unit,
+                                const double infectious_fraction) {
+  const int64 units_per_hour = absl::Hours(1) / time_unit;
+  std::mt19937_64 gen(/*seed=*/1);
+  std::vector<Visit> visits;
+  for (int i = 0; i < num_visits; ++i) {
+    const int64 start = absl::Uniform<int64>(gen, 0, 20 * units_per_hour);
+    const int64 end =
+        start + absl::Uniform<int64>(gen, units_per_hour, 5 * units_per_hour);
+    const bool infectious = absl::Bernoulli(gen, infectious_fraction);
+    visits.push_back({.location_uuid = location_uuid,
+                      .agent_uuid = i,
+                      .start_time = absl::UnixEpoch() + start * time_unit,
+                      .end_time = absl::UnixEpoch() + end * time_unit,
+                      .health_state = infectious ? HealthState::INFECTIOUS
+                                                 : HealthState::SUSCEPTIBLE,
+                      .infectivity = infectious ? 1.0f : 0.0f,
+                      .symptom_factor = infectious ? 1.0f : 0.0f});
+  }
+  return visits;
+}
+
+void SortByAgents(std::vector<InfectionOutcome>* outcomes) {
+  std::sort(outcomes->begin(), outcomes->end(),
+            [](const InfectionOutcome& a, const InfectionOutcome& b) {
+              if (a.agent_uuid != b.agent_uuid) {
+                return a.agent_uuid < b.agent_uuid;
+              }
+              return a.source_uuid < b.source_uuid;
+            });
+}
+
+absl::flat_hash_map<int64, double> InfectionProbabilities(
+    const absl::Span<const InfectionOutcome> outcomes,
+    const float transmissibility) {
+  absl::flat_hash_map<int64, std::vector<const Exposure*>> exposures;
+  for (const InfectionOutcome& outcome : outcomes) {
+    exposures[outcome.agent_uuid].push_back(&outcome.exposure);
+  }
+  const AggregatedTransmissionModel transmission_model(transmissibility);
+  absl::flat_hash_map<int64, double> probabilities;
+  for (const auto& [agent, agent_exposures] : exposures) {
+    probabilities[agent] =
+        transmission_model.InfectionProbability(agent_exposures);
+  }
+  return probabilities;
+}
+
+}  // namespace abesim
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_LOCATION_TEST_UTIL_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_LOCATION_TEST_UTIL_H_
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+
+namespace abesim {
+
+// Returns num_visits visits to the given location, one by each of the agents
+// 0 to num_visits - 1, that start within the first 20 hours after the epoch
+// and last from 1 to 5 hours.  Visit times are whole multiples of time_unit,
+// so coarse units give many visits that start or end at the same time.  Each
+// visit is infectious with probability infectious_fraction.  The visits are
+// the same on every call.
+std::vector<Visit> RandomVisits(int64 location_uuid, int num_visits,
+                                absl::Duration time_unit,
+                                double infectious_fraction = 0.2);
+
+// Sorts outcomes by agent, and then by source.
+void SortByAgents(std::vector<InfectionOutcome>* outcomes);
+
+// Returns the probability that each agent exposed by outcomes is infected,
+// under AggregatedTransmissionModel with the given transmissibility.
+absl::flat_hash_map<int64, double> InfectionProbabilities(
+    absl::Span<const InfectionOutcome> outcomes, float transmissibility);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_LOCATION_TEST_UTIL_H_
@@ -14,29 +14,89 @@
 
 #include "agent_based_epidemic_sim/core/observer.h"
 
+#include <algorithm>
+
+#include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+
 namespace abesim {
 
+ObserverManager::ObserverManager(const int max_pending_aggregations)
+    : max_pending_aggregations_(max_pending_aggregations) {
+  if (max_pending_aggregations_ > 0) {
+    executor_ = NewExecutor(1);
+    execution_ = executor_->NewExecution();
+  }
+}
+
+ObserverManager::~ObserverManager() {
+  if (execution_ != nullptr) execution_->Wait();
+}
+
 void ObserverManager::AddFactory(ObserverFactoryBase* factory) {
   factories_.insert(factory);
 }
 
 void ObserverManager::RemoveFactory(ObserverFactoryBase* factory) {
+  AwaitAggregation();
   factories_.erase(factory);
 }
 
 void ObserverManager::AggregateForTimestep(const Timestep& timestep) {
-  for (auto& factory : factories_) {
-    factory->Aggregate(timestep);
+  PendingAggregation aggregation{timestep};
+  for (ObserverFactoryBase* factory : factories_) {
+    factory->FinishTimestep();
+    aggregation.factories.push_back(factory);
+  }
+  num_active_shards_ = 0;
+  {
+    absl::MutexLock l(&mu_);
+    mu_.Await(absl::Condition(this, &ObserverManager::CanQueueAggregation));
+    pending_.push_back(std::move(aggregation));
   }
-  shards_.clear();
+  if (execution_ == nullptr) {
+    AggregateNext();
+  } else {
+    execution_->Add([this]() { AggregateNext(); });
+  }
+}
+
+void ObserverManager::AwaitAggregation() {
+  absl::MutexLock l(&mu_);
+  mu_.Await(absl::Condition(this, &ObserverManager::AggregationDone));
+}
+
+bool ObserverManager::CanQueueAggregation() {
+  return pending_.size() < std::max(max_pending_aggregations_, 1);
+}
+
+bool ObserverManager::AggregationDone() { return pending_.empty(); }
+
+void ObserverManager::AggregateNext() {
+  // The aggregation stays pending until it finishes, so that it counts
+  // towards max_pending_aggregations_ while it runs.
+  const PendingAggregation* aggregation;
+  {
+    absl::MutexLock l(&mu_);
+    aggregation = &pending_.front();
+  }
+  for (ObserverFactoryBase* factory : aggregation->factories) {
+    factory->Aggregate(aggregation->timestep);
+  }
+  absl::MutexLock l(&mu_);
+  pending_.pop_front();
 }
 
 ObserverShard* ObserverManager::MakeShard(const Timestep& timestep) {
-  shards_.push_back(absl::make_unique<ObserverShard>());
+  if (num_active_shards_ == shards_.size()) {
+    shards_.push_back(absl::make_unique<ObserverShard>());
+  }
+  ObserverShard* const shard = shards_[num_active_shards_++].get();
+  shard->ClearObservers();
   for (ObserverFactoryBase* factory : factories_) {
-    factory->MakeObserverForShard(timestep, shards_.back().get());
+    factory->MakeObserverForShard(timestep, shard);
   }
-  return shards_.back().get();
+  return shard;
 }
 
 void ObserverManager::RegisterObservers(const Timestep& timestep,
@@ -46,6 +106,11 @@ void ObserverManager::RegisterObservers(const Timestep& timestep,
   }
 }
 
+void ObserverShard::ClearObservers() {
+  agent_infection_observers_.clear();
+  location_visit_observers_.clear();
+}
+
 void ObserverShard::Observe(const Agent& agent,
                             absl::Span<const InfectionOutcome> outcomes) {
   for (AgentInfectionObserver* observer : agent_infection_observers_) {
@@ -17,13 +17,17 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_OBSERVER_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_OBSERVER_H_
 
+#include <deque>
 #include <memory>
+#include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/executor.h"
 
 // This file defines interfaces for observing the simulation for output and
 // recording of statistics.  Recording output from a simulation is a three step
@@ -33,8 +37,9 @@
 // Step 1: Implement the Observer.
 // Write a class that implements one or more of the obsever interfaces.  This is
 // the code that will actually look at data as the simulation progresses.
-// Simulators may create multiple instances of these observers for each timestep
-// of the simulation, but a single observer will only live for one timestep.
+// Simulators may use multiple instances of these observers for each timestep
+// of the simulation.  Each observer observes a single timestep at a time, but
+// may be reset and reused for later timesteps.
 //
 // class LocationVisitHistogramObserver : public LocationVisitObserver {
 //  public:
@@ -43,6 +48,7 @@
 //     hist_.resize(std::max(hist_.size(), visits.size() + 1));
 //     hist_[visits.size()]++;
 //   }
+//   void Reset() { std::fill(hist_.begin(), hist_.end(), 0); }
 //
 //  private:
 //   friend void AggregateLocationVisitHistograms(
@@ -55,7 +61,8 @@
 // As stated above, the simulator may need to instantiate multiple observers per
 // timestep of simulation, we do this so we can record statistics efficiently
 // in a multi-threaded environment.  The factory is responsable not only for
-// creating the observers, but also aggregating them at the end of a timestep.
+// creating the observers, but also aggregating them at the end of a timestep,
+// and optionally resetting them so they can be reused for a later timestep.
 //
 // class LocationVisitHistogramFactory : public ObserverFactory {
 //  public:
@@ -63,6 +70,11 @@
 //   std::unique_ptr<LocationVisitHistoryObserver> MakeObserver() override {
 //     return absl::make_unique<LocationVisitHistoryObserver>();
 //   }
+//   bool ResetObserver(const Timestep& timestep,
+//                      LocationVisitHistogramObserver* observer) override {
+//     observer->Reset();
+//     return true;
+//   }
 //   void Aggregate(
 //     const Timestep& timestep,
 //     absl::Span<const ObserverPtr> observers) override {
@@ -90,8 +102,12 @@
 // The interfaces here are designed so users need not understand the
 // threading model of the simulation they are observing. The methods of objects
 // deriving from one or more Observer interfaces will not be called concurrently
-// by multiple threads. Similarly ObserverFactory methods will not be called
-// concurrently by multiple threads.
+// by multiple threads. Similarly ObserverFactory::Aggregate calls are never
+// concurrent, and are made in timestep order.  However, simulations may
+// aggregate a timestep in the background while observing the next, so
+// Aggregate may run concurrently with MakeObserver and ResetObserver for a
+// later timestep.  Those are const, and must not read state that Aggregate
+// modifies.  All aggregation has finished when Simulation::Step returns.
 
 namespace abesim {
 
@@ -123,21 +139,34 @@ class ObserverFactoryBase {
  private:
   friend class ObserverManager;
   virtual void MakeObserverForShard(const Timestep&, ObserverShard*) = 0;
+  // Queues the observers made for the current timestep for aggregation.
+  virtual void FinishTimestep() = 0;
+  // Aggregates the oldest queued timestep.
   virtual void Aggregate(const Timestep&) = 0;
 };
 
 template <typename Observer>
 class ObserverFactory : public ObserverFactoryBase {
  public:
-  // Makes a new Observer instance.  Observers only live for a single timestep.
-  // Many observer instances may be produced for a given timestep, and all
-  // the observers that are produced will be passed to Aggregate at the end of
-  // the timestep.
+  // Makes a new Observer instance.  Many observer instances may be used for a
+  // given timestep, and all the observers that are used will be passed to
+  // Aggregate at the end of the timestep.
   virtual std::unique_ptr<Observer> MakeObserver(
       const Timestep& timestep) const = 0;
 
-  // Aggregates the data from many Observers.  This is called at the end of each
-  // timestep.
+  // Prepares an observer that was aggregated for an earlier timestep to
+  // observe the given timestep, as if newly made by MakeObserver.  Observers
+  // are kept across timesteps, so one that is reset here can keep the capacity
+  // of its containers rather than regrowing them every timestep.  Returns
+  // false if the observer was not reset, in which case it is replaced by a new
+  // observer from MakeObserver.
+  virtual bool ResetObserver(const Timestep& timestep,
+                             Observer* observer) const {
+    return false;
+  }
+
+  // Aggregates the data from many Observers.  This is called after the end of
+  // each timestep, possibly while the next timestep is being observed.
   virtual void Aggregate(
       const Timestep& timestep,
       absl::Span<std::unique_ptr<Observer> const> observers) = 0;
@@ -145,9 +174,17 @@ class ObserverFactory : public ObserverFactoryBase {
  private:
   void MakeObserverForShard(const Timestep& timestep,
                             ObserverShard* shard) override;
+  void FinishTimestep() override;
   void Aggregate(const Timestep& timestep) override;
 
-  std::vector<std::unique_ptr<Observer>> observers_;
+  // The observers in use by shards for the current timestep.
+  std::vector<std::unique_ptr<Observer>> active_;
+  absl::Mutex mu_;
+  // The observers of each timestep awaiting aggregation, oldest first.
+  std::deque<std::vector<std::unique_ptr<Observer>>> pending_
+      ABSL_GUARDED_BY(mu_);
+  // Aggregated observers, available for reuse.
+  std::vector<std::unique_ptr<Observer>> free_ ABSL_GUARDED_BY(mu_);
 };
 
 // An ObserverShard is a view onto the set of observers being used in a
@@ -162,11 +199,13 @@ class ObserverShard : public AgentInfectionObserver,
                absl::Span<const Visit> visits) override;
 
  private:
+  friend class ObserverManager;
   template <typename Observer>
   friend class ObserverFactory;
 
   template <typename Observer>
   void RegisterObserver(Observer* observer);
+  void ClearObservers();
 
   std::vector<AgentInfectionObserver*> agent_infection_observers_;
   std::vector<LocationVisitObserver*> location_visit_observers_;
@@ -179,40 +218,105 @@ class ObserverShard : public AgentInfectionObserver,
 // threads, but no single ObserverShard should be used concurrently by multiple
 // threads. This is used by Simulator implementations to manage observers, and
 // is only interesting to Simulator authors.
+//
+// Aggregation may be moved off the simulation's critical path: up to
+// max_pending_aggregations timesteps are aggregated in order by a background
+// thread while later timesteps are observed.  Each pending timestep holds its
+// own observers, so this bounds the memory they use; once the bound is
+// reached, AggregateForTimestep blocks until the oldest pending timestep has
+// been aggregated.  With the default of zero, timesteps are aggregated before
+// AggregateForTimestep returns.
 class ObserverManager {
  public:
+  explicit ObserverManager(int max_pending_aggregations = 0);
+  // Waits for pending aggregations.
+  ~ObserverManager();
+
   // Adds an ObserverFactory.  factory->Aggregate will be called
   // for all following simulation steps until the factory is removed.
   void AddFactory(ObserverFactoryBase* factory);
-  // Removes an ObserverFactory.
+  // Removes an ObserverFactory, after waiting for pending aggregations.
   void RemoveFactory(ObserverFactoryBase* factory);
-  // Calls ObserverFactory::Aggregate for all added factories.
+  // Calls ObserverFactory::Aggregate for all added factories, possibly in the
+  // background.
   void AggregateForTimestep(const Timestep& timestep);
-  // Make a new ObserverShard that can be used by a worker thread to report
+  // Waits until every timestep passed to AggregateForTimestep has been
+  // aggregated.
+  void AwaitAggregation();
+  // Returns an ObserverShard that can be used by a worker thread to report
   // observations.  Note that the manager retains ownership and that the
   // returned pointer will only be valid until the next call to
-  // AggregateTimestep.
+  // AggregateForTimestep.  Shards, and the observers they hold, are reused
+  // from earlier timesteps where possible.
   ObserverShard* MakeShard(const Timestep& timestep);
 
  private:
   friend class ObserverShard;
   void RegisterObservers(const Timestep& timestep, ObserverShard* shard);
 
+  // A timestep awaiting aggregation, and the factories that observed it.
+  struct PendingAggregation {
+    Timestep timestep;
+    std::vector<ObserverFactoryBase*> factories;
+  };
+  // Aggregates the oldest pending timestep.
+  void AggregateNext();
+  bool CanQueueAggregation() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  bool AggregationDone() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   absl::flat_hash_set<ObserverFactoryBase*> factories_;
+  // Every shard made so far.  The first num_active_shards_ are in use for the
+  // current timestep.
   std::vector<std::unique_ptr<ObserverShard>> shards_;
+  int num_active_shards_ = 0;
+
+  const int max_pending_aggregations_;
+  absl::Mutex mu_;
+  // Timesteps handed to AggregateForTimestep but not yet fully aggregated,
+  // oldest first.
+  std::deque<PendingAggregation> pending_ ABSL_GUARDED_BY(mu_);
+  // Runs AggregateNext once for every pending timestep.  Its single thread
+  // ensures aggregations never overlap.
+  std::unique_ptr<Executor> executor_;
+  std::unique_ptr<Execution> execution_;
 };
 
 template <typename Observer>
-void ObserverFactory<Observer>::Aggregate(const Timestep& timestep) {
-  Aggregate(timestep, observers_);
-  observers_.clear();
+void ObserverFactory<Observer>::MakeObserverForShard(const Timestep& timestep,
+                                                     ObserverShard* shard) {
+  std::unique_ptr<Observer> observer;
+  {
+    absl::MutexLock l(&mu_);
+    if (!free_.empty()) {
+      observer = std::move(free_.back());
+      free_.pop_back();
+    }
+  }
+  if (observer == nullptr || !ResetObserver(timestep, observer.get())) {
+    observer = MakeObserver(timestep);
+  }
+  shard->RegisterObserver(observer.get());
+  active_.push_back(std::move(observer));
 }
 
 template <typename Observer>
-void ObserverFactory<Observer>::MakeObserverForShard(const Timestep& timestep,
-                                                     ObserverShard* shard) {
-  observers_.push_back(MakeObserver(timestep));
-  shard->RegisterObserver(observers_.back().get());
+void ObserverFactory<Observer>::FinishTimestep() {
+  absl::MutexLock l(&mu_);
+  pending_.push_back(std::move(active_));
+  active_.clear();
+}
+
+template <typename Observer>
+void ObserverFactory<Observer>::Aggregate(const Timestep& timestep) {
+  std::vector<std::unique_ptr<Observer>> observers;
+  {
+    absl::MutexLock l(&mu_);
+    observers = std::move(pending_.front());
+    pending_.pop_front();
+  }
+  Aggregate(timestep, observers);
+  absl::MutexLock l(&mu_);
+  for (auto& observer : observers) free_.push_back(std::move(observer));
 }
 
 template <typename Observer>
@@ -0,0 +1,185 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/observer.h"
+
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+
+class FakeLocation : public Location {
+ public:
+  int64 uuid() const override { return 0; }
+  void ProcessVisits(absl::Span<const Visit> visits,
+                     Broker<InfectionOutcome>* infection_broker) override {}
+};
+
+class VisitCountingObserver : public LocationVisitObserver {
+ public:
+  void Observe(const Location& location,
+               absl::Span<const Visit> visits) override {
+    visits_ += visits.size();
+  }
+
+  int visits_ = 0;
+};
+
+// Records the visits seen by each observer aggregated at each timestep.
+class VisitCountingFactory : public ObserverFactory<VisitCountingObserver> {
+ public:
+  explicit VisitCountingFactory(const bool reset) : reset_(reset) {}
+
+  std::unique_ptr<VisitCountingObserver> MakeObserver(
+      const Timestep& timestep) const override {
+    ++made_;
+    return absl::make_unique<VisitCountingObserver>();
+  }
+  bool ResetObserver(const Timestep& timestep,
+                     VisitCountingObserver* observer) const override {
+    if (!reset_) return false;
+    observer->visits_ = 0;
+    return true;
+  }
+  void Aggregate(const Timestep& timestep,
+                 absl::Span<std::unique_ptr<VisitCountingObserver> const>
+                     observers) override {
+    if (block_ != nullptr) block_->WaitForNotification();
+    std::vector<int> visits;
+    for (const auto& observer : observers) visits.push_back(observer->visits_);
+    aggregated_.push_back(visits);
+  }
+
+  const bool reset_;
+  // If set, Aggregate waits for it to be notified.
+  absl::Notification* block_ = nullptr;
+  mutable int made_ = 0;
+  std::vector<std::vector<int>> aggregated_;
+};
+
+// Observes the given number of visits in a new shard of manager.
+ObserverShard* ObserveVisits(const Timestep& timestep,
+                             ObserverManager& manager, const int num_visits) {
+  ObserverShard* const shard = manager.MakeShard(timestep);
+  const std::vector<Visit> visits(num_visits);
+  shard->Observe(FakeLocation(), visits);
+  return shard;
+}
+
+TEST(ObserverManagerTest, ReusesShardsAndObservers) {
+  VisitCountingFactory factory(/*reset=*/true);
+  ObserverManager manager;
+  manager.AddFactory(&factory);
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+
+  ObserverShard* const shard = ObserveVisits(timestep, manager, 1);
+  ObserveVisits(timestep, manager, 2);
+  manager.AggregateForTimestep(timestep);
+  timestep.Advance();
+  EXPECT_EQ(ObserveVisits(timestep, manager, 3), shard);
+  manager.AggregateForTimestep(timestep);
+  timestep.Advance();
+  ObserveVisits(timestep, manager, 4);
+  ObserveVisits(timestep, manager, 5);
+  ObserveVisits(timestep, manager, 6);
+  manager.AggregateForTimestep(timestep);
+
+  EXPECT_EQ(factory.made_, 3);
+  EXPECT_THAT(factory.aggregated_,
+              ElementsAre(ElementsAre(1, 2), ElementsAre(3),
+                          ElementsAre(4, 5, 6)));
+}
+
+TEST(ObserverManagerTest, ReplacesObserversThatAreNotReset) {
+  VisitCountingFactory factory(/*reset=*/false);
+  ObserverManager manager;
+  manager.AddFactory(&factory);
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+
+  ObserveVisits(timestep, manager, 1);
+  ObserveVisits(timestep, manager, 2);
+  manager.AggregateForTimestep(timestep);
+  timestep.Advance();
+  ObserveVisits(timestep, manager, 3);
+  manager.AggregateForTimestep(timestep);
+
+  EXPECT_EQ(factory.made_, 3);
+  EXPECT_THAT(factory.aggregated_,
+              ElementsAre(ElementsAre(1, 2), ElementsAre(3)));
+}
+
+TEST(ObserverManagerTest, RegistersOnlyCurrentFactories) {
+  VisitCountingFactory kept(/*reset=*/true);
+  VisitCountingFactory removed(/*reset=*/true);
+  ObserverManager manager;
+  manager.AddFactory(&kept);
+  manager.AddFactory(&removed);
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+
+  ObserveVisits(timestep, manager, 1);
+  manager.AggregateForTimestep(timestep);
+  manager.RemoveFactory(&removed);
+  timestep.Advance();
+  ObserveVisits(timestep, manager, 2);
+  manager.AggregateForTimestep(timestep);
+
+  EXPECT_THAT(kept.aggregated_, ElementsAre(ElementsAre(1), ElementsAre(2)));
+  EXPECT_THAT(removed.aggregated_, ElementsAre(ElementsAre(1)));
+}
+
+TEST(ObserverManagerTest, AggregatesInTheBackground) {
+  VisitCountingFactory factory(/*reset=*/true);
+  absl::Notification unblock;
+  factory.block_ = &unblock;
+  ObserverManager manager(/*max_pending_aggregations=*/2);
+  manager.AddFactory(&factory);
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+
+  // The next timesteps are observed while the first is still aggregating.
+  ObserveVisits(timestep, manager, 1);
+  manager.AggregateForTimestep(timestep);
+  timestep.Advance();
+  ObserveVisits(timestep, manager, 2);
+  ObserveVisits(timestep, manager, 3);
+  manager.AggregateForTimestep(timestep);
+  timestep.Advance();
+  ObserveVisits(timestep, manager, 4);
+  unblock.Notify();
+  manager.AggregateForTimestep(timestep);
+  manager.AwaitAggregation();
+
+  // Observers still waiting to be aggregated cannot be reused.
+  EXPECT_EQ(factory.made_, 4);
+  EXPECT_THAT(factory.aggregated_,
+              ElementsAre(ElementsAre(1), ElementsAre(2, 3), ElementsAre(4)));
+}
+
+}  // namespace
+}  // namespace abesim
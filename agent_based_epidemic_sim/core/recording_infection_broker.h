@@ -0,0 +1,48 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_RECORDING_INFECTION_BROKER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_RECORDING_INFECTION_BROKER_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+
+namespace abesim {
+
+// A Broker for tests that keeps every InfectionOutcome sent to it, in order.
+class RecordingInfectionBroker : public Broker<InfectionOutcome> {
+ public:
+  void Send(absl::Span<const InfectionOutcome> infection_outcomes) override {
+    ++sends_;
+    outcomes_.insert(outcomes_.end(), infection_outcomes.begin(),
+                     infection_outcomes.end());
+  }
+  // The number of calls to Send.
+  int sends() const { return sends_; }
+  std::vector<InfectionOutcome>& outcomes() { return outcomes_; }
+  const std::vector<InfectionOutcome>& outcomes() const { return outcomes_; }
+
+ private:
+  int sends_ = 0;
+  std::vector<InfectionOutcome> outcomes_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_RECORDING_INFECTION_BROKER_H_
@@ -26,7 +26,8 @@ class NullRiskScore : public RiskScore {
   void AddHealthStateTransistion(HealthTransition transition) override {}
   void AddExposures(absl::Span<const Exposure* const> exposures) override {}
   void AddExposureNotification(const Contact& contact,
-                               const TestResult& result) override {}
+                               const TestResult& result,
+                               const int hops) override {}
 
   VisitAdjustment GetVisitAdjustment(const Timestep& timestep,
                                      int64 location_uuid) const override {
@@ -30,9 +30,12 @@ class RiskScore {
   virtual void AddHealthStateTransistion(HealthTransition transition) = 0;
   // Informs the RiskScore of new exposures.
   virtual void AddExposures(absl::Span<const Exposure* const> exposures) = 0;
-  // Informs the RiskScore of received exposure notifications.
+  // Informs the RiskScore of received exposure notifications.  hops is the
+  // number of contacts the notification passed along, as in ContactReport: 1
+  // when the contact itself tested.
   virtual void AddExposureNotification(const Contact& contact,
-                                       const TestResult& result) = 0;
+                                       const TestResult& result,
+                                       int hops) = 0;
 
   struct VisitAdjustment {
     float frequency_adjustment;
@@ -67,13 +70,17 @@ class RiskScore {
 
   // Encapsulates which contact reports to forward.
   struct ContactTracingPolicy {
+    // Whether to forward received reports to this agent's own contacts.
     bool report_recursively;
     bool send_report;
+    // The maximum hops of a forwarded report: reports are forwarded only while
+    // they have travelled fewer hops.  2 traces the contacts of contacts.
+    int max_hops = 2;
 
     friend bool operator==(const ContactTracingPolicy& a,
                            const ContactTracingPolicy& b) {
       return (a.report_recursively == b.report_recursively &&
-              a.send_report == b.send_report);
+              a.send_report == b.send_report && a.max_hops == b.max_hops);
     }
 
     friend bool operator!=(const ContactTracingPolicy& a,
@@ -85,7 +92,8 @@ class RiskScore {
         std::ostream& strm,
         const ContactTracingPolicy& contact_tracing_policy) {
       return strm << "{" << contact_tracing_policy.report_recursively << ", "
-                  << contact_tracing_policy.send_report << "}";
+                  << contact_tracing_policy.send_report << ", "
+                  << contact_tracing_policy.max_hops << "}";
     }
   };
   // Gets the policy to be used when sending contact reports.
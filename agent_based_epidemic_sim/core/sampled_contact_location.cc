@@ -0,0 +1,213 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "agent_based_epidemic_sim/core/sampled_contact_location.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// The arrival or departure time of a visit.
+struct VisitTime {
+  absl::Time time;
+  int visit;
+};
+
+// Orders by time, breaking ties by visit index, as the exact simulation does.
+bool IsEarlier(const VisitTime& a, const VisitTime& b) {
+  if (a.time != b.time) return a.time < b.time;
+  return a.visit < b.visit;
+}
+
+// The visits that expose others, in one of the strata that contacts are
+// sampled from.
+struct SourceSet {
+  // The arrivals of the sources, in order.
+  std::vector<VisitTime> arrivals;
+  // The index in arrivals of the next source to arrive.
+  int next_arrival;
+  // The sources present at the location, in no particular order.
+  std::vector<int> active;
+};
+
+// The strata that contacts are sampled from.  Only infectious sources can
+// infect, so they are sampled first, and apart from the others, so that the
+// sample of them is as large as possible.
+enum Stratum { kInfectious = 0, kNonInfectious = 1, kNumStrata = 2 };
+constexpr int kNotSource = -1;
+
+// Scratch space for SampleContacts, reused across calls on each thread.
+struct SampleSweep {
+  std::vector<VisitTime> arrivals;
+  std::vector<VisitTime> departures;
+  // The stratum of each visit, or kNotSource for visits that expose no one.
+  std::vector<int> stratum;
+  std::array<SourceSet, kNumStrata> sources;
+  // The position of each active source in its SourceSet::active.
+  std::vector<int> active_pos;
+  std::vector<InfectionOutcome> outcomes;
+};
+
+absl::Duration Overlap(const Visit& a, const Visit& b) {
+  return std::min(a.end_time, b.end_time) -
+         std::max(a.start_time, b.start_time);
+}
+
+}  // namespace
+
+SampledContactLocation::SampledContactLocation(
+    const int64 uuid, const ExposureGeneratorBuilder& exposure_generators,
+    const Options& options)
+    : exact_(uuid, exposure_generators.Build(), options.contact_mode),
+      exposure_generator_(exposure_generators.Build()),
+      options_(options),
+      gen_(options.seed.has_value() ? *options.seed
+                                    : absl::Uniform<uint64>(absl::BitGen())) {
+  DCHECK_GT(options_.contacts_per_visit, 0);
+}
+
+void SampledContactLocation::ProcessVisits(
+    const absl::Span<const Visit> visits,
+    Broker<InfectionOutcome>* infection_broker) {
+  if (visits.size() <= options_.occupancy_threshold) {
+    exact_.ProcessVisits(visits, infection_broker);
+  } else {
+    SampleContacts(visits, infection_broker);
+  }
+}
+
+void SampledContactLocation::SampleContacts(
+    const absl::Span<const Visit> visits,
+    Broker<InfectionOutcome>* infection_broker) {
+  thread_local SampleSweep thread_sweep;
+  SampleSweep& sweep = thread_sweep;
+  sweep.arrivals.clear();
+  sweep.departures.clear();
+  sweep.stratum.resize(visits.size());
+  const bool all_contacts =
+      options_.contact_mode ==
+      LocationDiscreteEventSimulator::ContactMode::kAllContacts;
+  for (int i = 0; i < visits.size(); ++i) {
+    const Visit& visit = visits[i];
+    if (visit.start_time >= visit.end_time) {
+      LOG(DFATAL) << "Skipping visit end_time <= start_time: " << visit;
+      continue;
+    }
+    DCHECK_EQ(visit.location_uuid, uuid());
+    sweep.arrivals.push_back({.time = visit.start_time, .visit = i});
+    sweep.departures.push_back({.time = visit.end_time, .visit = i});
+    if (visit.infectivity > 0.0f) {
+      sweep.stratum[i] = kInfectious;
+    } else {
+      sweep.stratum[i] = all_contacts ? kNonInfectious : kNotSource;
+    }
+  }
+  std::sort(sweep.arrivals.begin(), sweep.arrivals.end(), IsEarlier);
+  std::sort(sweep.departures.begin(), sweep.departures.end(), IsEarlier);
+  for (SourceSet& sources : sweep.sources) {
+    sources.arrivals.clear();
+    sources.next_arrival = 0;
+    sources.active.clear();
+  }
+  for (const VisitTime& arrival : sweep.arrivals) {
+    const int stratum = sweep.stratum[arrival.visit];
+    if (stratum != kNotSource) {
+      sweep.sources[stratum].arrivals.push_back(arrival);
+    }
+  }
+  sweep.active_pos.resize(visits.size());
+  sweep.outcomes.clear();
+
+  auto expose = [&sweep, &visits, this](const int visit, const int source,
+                                        const float weight) {
+    const Visit& v = visits[visit];
+    const Visit& source_visit = visits[source];
+    InfectionOutcome outcome = {
+        .agent_uuid = v.agent_uuid,
+        .exposure = exposure_generator_->Generate(
+            source_visit.start_time, Overlap(v, source_visit),
+            source_visit.infectivity, source_visit.symptom_factor),
+        .exposure_type = InfectionOutcomeProto::CONTACT,
+        .source_uuid = source_visit.agent_uuid};
+    outcome.exposure.weight = weight;
+    sweep.outcomes.push_back(outcome);
+  };
+
+  // Each visit overlaps the sources present when it arrives, and the sources
+  // that arrive after it and before it departs, which are a contiguous range
+  // of the arrivals of each SourceSet.  Exposures are drawn from these
+  // candidates, infectious ones first.
+  int next_departure = 0;
+  for (const VisitTime& arrival : sweep.arrivals) {
+    while (sweep.departures[next_departure].time <= arrival.time) {
+      const int departed = sweep.departures[next_departure++].visit;
+      const int stratum = sweep.stratum[departed];
+      if (stratum == kNotSource) continue;
+      std::vector<int>& active = sweep.sources[stratum].active;
+      const int pos = sweep.active_pos[departed];
+      active[pos] = active.back();
+      sweep.active_pos[active[pos]] = pos;
+      active.pop_back();
+    }
+    const int visit = arrival.visit;
+    const Visit& v = visits[visit];
+    const int own_stratum = sweep.stratum[visit];
+    if (own_stratum != kNotSource) ++sweep.sources[own_stratum].next_arrival;
+    int budget = options_.contacts_per_visit;
+    for (const SourceSet& sources : sweep.sources) {
+      const int present = sources.active.size();
+      const auto later_begin = sources.arrivals.begin() + sources.next_arrival;
+      const auto later_end = std::lower_bound(
+          later_begin, sources.arrivals.end(), v.end_time,
+          [](const VisitTime& a, const absl::Time t) { return a.time < t; });
+      const int candidates = present + (later_end - later_begin);
+      auto candidate = [&](const int c) {
+        return c < present ? sources.active[c]
+                           : later_begin[c - present].visit;
+      };
+      if (candidates <= budget) {
+        for (int c = 0; c < candidates; ++c) {
+          expose(visit, candidate(c), /*weight=*/1.0f);
+        }
+        budget -= candidates;
+      } else if (budget > 0) {
+        // Each draw stands for candidates / budget overlaps.
+        const float weight = static_cast<float>(candidates) / budget;
+        for (int k = 0; k < budget; ++k) {
+          expose(visit, candidate(absl::Uniform<int>(gen_, 0, candidates)),
+                 weight);
+        }
+        budget = 0;
+      }
+    }
+    if (own_stratum != kNotSource) {
+      std::vector<int>& active = sweep.sources[own_stratum].active;
+      sweep.active_pos[visit] = active.size();
+      active.push_back(visit);
+    }
+  }
+  infection_broker->Send(sweep.outcomes);
+}
+
+}  // namespace abesim
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_SAMPLED_CONTACT_LOCATION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_SAMPLED_CONTACT_LOCATION_H_
+
+#include <memory>
+#include <random>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/exposure_generator.h"
+#include "agent_based_epidemic_sim/core/exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+
+namespace abesim {
+
+// A Location that bounds the cost of very large gatherings.  Steps in which it
+// receives few visits are simulated exactly by a
+// LocationDiscreteEventSimulator.  Above the occupancy threshold, each visitor
+// is instead exposed to a bounded sample of the visitors it overlaps, drawn
+// uniformly with replacement.  Infectious visitors are sampled first, and any
+// remaining budget is spent on the others, which cannot infect anyone.
+// Sampled exposures keep their real times and durations, and carry the
+// inverse of their sampling fraction as their weight, so the expected log
+// probability of each visitor escaping infection under
+// AggregatedTransmissionModel is the same as in the exact simulation, while
+// the work per visit is bounded by contacts_per_visit.  Visitors that overlap
+// at most contacts_per_visit others are exposed to all of them exactly.
+//
+// Sampled contacts may repeat, and contacts that are not sampled are never
+// reported, so contact tracing and contact observers see fewer contacts than
+// occurred.
+class SampledContactLocation : public Location {
+ public:
+  struct Options {
+    // Steps with at most this many visits are simulated exactly.
+    int occupancy_threshold = 1000;
+    // The maximum number of exposures generated for each visit.
+    int contacts_per_visit = 50;
+    LocationDiscreteEventSimulator::ContactMode contact_mode =
+        LocationDiscreteEventSimulator::ContactMode::kAllContacts;
+    // If set, contacts are sampled from a generator with this seed, so that
+    // the same visits are always sampled alike.  Otherwise the generator is
+    // seeded randomly.
+    absl::optional<uint64> seed;
+  };
+
+  SampledContactLocation(int64 uuid,
+                         const ExposureGeneratorBuilder& exposure_generators,
+                         const Options& options);
+
+  int64 uuid() const override { return exact_.uuid(); }
+
+  void ProcessVisits(absl::Span<const Visit> visits,
+                     Broker<InfectionOutcome>* infection_broker) override;
+
+ private:
+  void SampleContacts(absl::Span<const Visit> visits,
+                      Broker<InfectionOutcome>* infection_broker);
+
+  LocationDiscreteEventSimulator exact_;
+  const std::unique_ptr<ExposureGenerator> exposure_generator_;
+  const Options options_;
+  std::mt19937_64 gen_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_SAMPLED_CONTACT_LOCATION_H_
@@ -0,0 +1,173 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/sampled_contact_location.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/location_test_util.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/recording_infection_broker.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAreArray;
+
+constexpr int64 kUuid = 42LL;
+constexpr float kTransmissibility = 0.2;
+
+std::vector<InfectionOutcome> ExactOutcomes(
+    absl::Span<const Visit> visits,
+    const LocationDiscreteEventSimulator::ContactMode contact_mode) {
+  RecordingInfectionBroker infection_broker;
+  MicroExposureGeneratorBuilder meg_builder;
+  LocationDiscreteEventSimulator location(kUuid, meg_builder.Build(),
+                                          contact_mode);
+  location.ProcessVisits(visits, &infection_broker);
+  return infection_broker.outcomes();
+}
+
+std::vector<InfectionOutcome> SampledOutcomes(
+    absl::Span<const Visit> visits,
+    const SampledContactLocation::Options& options) {
+  RecordingInfectionBroker infection_broker;
+  MicroExposureGeneratorBuilder meg_builder;
+  SampledContactLocation location(kUuid, meg_builder, options);
+  location.ProcessVisits(visits, &infection_broker);
+  return infection_broker.outcomes();
+}
+
+TEST(SampledContactLocationTest, IsExactUpToOccupancyThreshold) {
+  const std::vector<Visit> visits = RandomVisits(kUuid, 200, absl::Minutes(1));
+  std::vector<InfectionOutcome> expected = ExactOutcomes(
+      visits, LocationDiscreteEventSimulator::ContactMode::kAllContacts);
+  std::vector<InfectionOutcome> outcomes = SampledOutcomes(
+      visits, {.occupancy_threshold = 200, .contacts_per_visit = 1});
+
+  SortByAgents(&expected);
+  SortByAgents(&outcomes);
+  EXPECT_THAT(outcomes, ElementsAreArray(expected));
+}
+
+TEST(SampledContactLocationTest, IsExactForVisitsWithFewContacts) {
+  const std::vector<Visit> visits = RandomVisits(kUuid, 200, absl::Minutes(1));
+  for (const auto contact_mode :
+       {LocationDiscreteEventSimulator::ContactMode::kAllContacts,
+        LocationDiscreteEventSimulator::ContactMode::kInfectiousContactsOnly}) {
+    std::vector<InfectionOutcome> expected =
+        ExactOutcomes(visits, contact_mode);
+    std::vector<InfectionOutcome> outcomes =
+        SampledOutcomes(visits, {.occupancy_threshold = 0,
+                                 .contacts_per_visit = 200,
+                                 .contact_mode = contact_mode});
+
+    SortByAgents(&expected);
+    SortByAgents(&outcomes);
+    EXPECT_THAT(outcomes, ElementsAreArray(expected));
+  }
+}
+
+TEST(SampledContactLocationTest, BoundsContactsPerVisit) {
+  const std::vector<Visit> visits = RandomVisits(kUuid, 2000, absl::Minutes(1));
+  const std::vector<InfectionOutcome> outcomes =
+      SampledOutcomes(visits, {.occupancy_threshold = 1000,
+                               .contacts_per_visit = 10,
+                               .seed = 1});
+
+  absl::flat_hash_map<int64, int> contacts;
+  for (const InfectionOutcome& outcome : outcomes) {
+    EXPECT_EQ(outcome.exposure_type, InfectionOutcomeProto::CONTACT);
+    EXPECT_NE(outcome.agent_uuid, outcome.source_uuid);
+    ++contacts[outcome.agent_uuid];
+  }
+  EXPECT_EQ(contacts.size(), visits.size());
+  for (const auto& [agent, count] : contacts) {
+    EXPECT_EQ(count, 10) << agent;
+  }
+}
+
+TEST(SampledContactLocationTest, KeepsTheTimesOfSampledContacts) {
+  const std::vector<Visit> visits = RandomVisits(kUuid, 2000, absl::Minutes(1));
+  const std::vector<InfectionOutcome> outcomes =
+      SampledOutcomes(visits, {.occupancy_threshold = 1000,
+                               .contacts_per_visit = 5,
+                               .seed = 1});
+
+  for (const InfectionOutcome& outcome : outcomes) {
+    const Visit& visit = visits[outcome.agent_uuid];
+    const Visit& source = visits[outcome.source_uuid];
+    EXPECT_EQ(outcome.exposure.duration,
+              std::min(visit.end_time, source.end_time) -
+                  std::max(visit.start_time, source.start_time));
+    EXPECT_LE(outcome.exposure.start_time + outcome.exposure.duration,
+              visit.end_time);
+    EXPECT_GE(outcome.exposure.weight, 1.0f);
+  }
+}
+
+TEST(SampledContactLocationTest, PreservesInfectionProbability) {
+  // Each visitor overlaps hundreds of others, a dozen or so of them
+  // infectious, so most of the infectious contacts are sampled.
+  const std::vector<Visit> visits =
+      RandomVisits(kUuid, 2000, absl::Minutes(1),
+                   /*infectious_fraction=*/0.05);
+  const absl::flat_hash_map<int64, double> expected =
+      InfectionProbabilities(
+          ExactOutcomes(
+              visits,
+              LocationDiscreteEventSimulator::ContactMode::kAllContacts),
+          kTransmissibility);
+
+  // Average the infection probability of each agent over repeated samples.
+  constexpr int kTrials = 20;
+  absl::flat_hash_map<int64, double> mean;
+  for (int trial = 0; trial < kTrials; ++trial) {
+    const std::vector<InfectionOutcome> outcomes =
+        SampledOutcomes(visits, {.occupancy_threshold = 1000,
+                                 .contacts_per_visit = 5,
+                                 .seed = static_cast<uint64>(trial)});
+    for (const auto& [agent, probability] :
+         InfectionProbabilities(outcomes, kTransmissibility)) {
+      ASSERT_GE(probability, 0.0) << agent;
+      ASSERT_LE(probability, 1.0) << agent;
+      mean[agent] += probability / kTrials;
+    }
+  }
+
+  // Weighting preserves the expected log probability of escaping infection,
+  // so the probability of infection is slightly underestimated.
+  double expected_total = 0;
+  double mean_total = 0;
+  for (const auto& [agent, probability] : expected) {
+    expected_total += probability;
+    mean_total += mean[agent];
+    EXPECT_NEAR(mean[agent], probability, 0.1) << agent;
+  }
+  EXPECT_NEAR(mean_total, expected_total, 0.02 * expected_total);
+}
+
+}  // namespace
+}  // namespace abesim
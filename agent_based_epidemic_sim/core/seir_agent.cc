@@ -25,10 +25,6 @@
 namespace abesim {
 namespace {
 
-bool ContactFromBefore(const Contact& contact, const absl::Time time) {
-  return contact.exposure.start_time + contact.exposure.duration < time;
-}
-
 // TODO: Move to a more appropriate location when this gets more
 // sophisticated like taking into account covariates.
 float SymptomFactor(const HealthState::State health_state) {
@@ -80,14 +76,41 @@ std::unique_ptr<SEIRAgent> SEIRAgent::Create(
       std::move(visit_generator), std::move(risk_score)));
 }
 
-void SEIRAgent::SplitAndAssignHealthStates(std::vector<Visit>* visits) const {
-  auto interval = health_transitions_.rbegin();
-  for (int i = visits->size() - 1; i >= 0;) {
+float SEIRInfectivity(const HealthState::State health_state,
+                      const absl::optional<absl::Time> initial_infection_time,
+                      const absl::Time time) {
+  if (!IsInfectedState(health_state) || !initial_infection_time.has_value() ||
+      time < initial_infection_time) {
+    return 0;
+  }
+
+  const absl::Duration duration_since_infection =
+      time - initial_infection_time.value();
+  const int discrete_days_since_infection =
+      (int)std::round(absl::ToDoubleHours(duration_since_infection) / 24.0f);
+
+  if (discrete_days_since_infection > 14) return 0;
+
+  return kInfectivityArray[discrete_days_since_infection];
+}
+
+void AssignSEIRHealthStates(
+    const int64 uuid, const absl::Span<const HealthTransition> transitions,
+    const absl::optional<absl::Time> initial_infection_time,
+    const int first_visit, std::vector<Visit>* visits) {
+  const HealthState::State current_health_state =
+      transitions.back().health_state;
+  auto infectivity = [current_health_state,
+                      initial_infection_time](const absl::Time time) {
+    return SEIRInfectivity(current_health_state, initial_infection_time, time);
+  };
+  auto interval = transitions.rbegin();
+  for (int i = visits->size() - 1; i >= first_visit;) {
     Visit& visit = (*visits)[i];
     visit.health_state = interval->health_state;
-    visit.infectivity = CurrentInfectivity(visit.start_time);
+    visit.infectivity = infectivity(visit.start_time);
     visit.symptom_factor = SymptomFactor(interval->health_state);
-    visit.agent_uuid = uuid_;
+    visit.agent_uuid = uuid;
     if (visit.start_time >= interval->time) {
       --i;
       continue;
@@ -98,7 +121,7 @@ void SEIRAgent::SplitAndAssignHealthStates(std::vector<Visit>* visits) const {
       // No visit should ever come before the first health transition.
       visit.symptom_factor = SymptomFactor((interval + 1)->health_state);
       split_visit.start_time = interval->time;
-      split_visit.infectivity = CurrentInfectivity(split_visit.start_time);
+      split_visit.infectivity = infectivity(split_visit.start_time);
       split_visit.symptom_factor = SymptomFactor(interval->health_state);
       visits->push_back(split_visit);
     }
@@ -133,7 +156,8 @@ void SEIRAgent::ComputeVisits(const Timestep& timestep,
   thread_local std::vector<Visit> visits;
   visits.clear();
   visit_generator_->GenerateVisits(timestep, *risk_score_, &visits);
-  SplitAndAssignHealthStates(&visits);
+  AssignSEIRHealthStates(uuid_, health_transitions_, initial_infection_time_,
+                         0, &visits);
   visit_broker->Send(visits);
 }
 
@@ -156,58 +180,134 @@ void SEIRAgent::UpdateContactReports(
   DCHECK(matches_uuid_fn(contact_reports))
       << "Found incorrect ContactReport uuid.";
   for (const ContactReport& contact_report : contact_reports) {
-    auto contact = contact_set_.find(contact_report.from_agent_uuid);
-    if (contact == contact_set_.end()) continue;
-    risk_score_->AddExposureNotification(**contact, contact_report.test_result);
+    const Contact* contact = contacts_.Find(contact_report.from_agent_uuid);
+    if (contact == nullptr) continue;
+    risk_score_->AddExposureNotification(*contact, contact_report.test_result,
+                                         contact_report.hops);
   }
   SendContactReports(timestep, contact_reports, broker);
 }
 
+// Reports are sent in chunks of at most kReportChunkSize, from a buffer reused
+// across agents on each thread, so that an agent reporting to a long contact
+// history does not build a vector of all of its reports.
+constexpr int kReportChunkSize = 256;
+
+class SEIRAgent::ReportWriter {
+ public:
+  explicit ReportWriter(Broker<ContactReport>* const broker)
+      : broker_(broker), buffer_(ThreadBuffer()) {
+    buffer_.clear();
+  }
+
+  void Write(const ContactReport& report) {
+    buffer_.push_back(report);
+    if (buffer_.size() >= kReportChunkSize) SendBuffer();
+  }
+
+  // Sends any buffered reports.  With send_empty, a batch is sent even if no
+  // reports were written.
+  void Flush(const bool send_empty) {
+    if (!buffer_.empty() || (send_empty && !sent_)) SendBuffer();
+  }
+
+ private:
+  static std::vector<ContactReport>& ThreadBuffer() {
+    thread_local std::vector<ContactReport> buffer;
+    return buffer;
+  }
+
+  void SendBuffer() {
+    broker_->Send(buffer_);
+    buffer_.clear();
+    sent_ = true;
+  }
+
+  Broker<ContactReport>* const broker_;
+  std::vector<ContactReport>& buffer_;
+  bool sent_ = false;
+};
+
 void SEIRAgent::SendContactReports(
     const Timestep& timestep, absl::Span<const ContactReport> received_reports,
     Broker<ContactReport>* broker) {
   const RiskScore::ContactTracingPolicy& contact_tracing_policy =
       risk_score_->GetContactTracingPolicy(timestep);
-  if (contact_tracing_policy.report_recursively) {
-    LOG(DFATAL) << "Recursive contact tracing not yet supported.";
+  if (!contact_tracing_policy.send_report &&
+      !contact_tracing_policy.report_recursively) {
+    return;
   }
-  if (!contact_tracing_policy.send_report) return;
 
-  const TestResult test_result = risk_score_->GetTestResult(timestep);
-  if (test_result != last_test_result_sent_) {
-    // We want to avoid re-sending ContactReports for contacts we've already
-    // sent a ContactReport for.  We keep track of
-    // last_contact_report_considered_ which tells us the last contact we sent
-    // last_test_result_sent_ for.  If we get a new test result, though, we
-    // need to send that even for contacts we sent the previous result for.
-    // For that reason we reset last_contact_report_consiered_ to an invalid
-    // value here so we send the new test result to all our contacts.
-    last_contact_report_considered_ = contacts_.end();
-    last_test_result_sent_ = test_result;
+  ReportWriter writer(broker);
+  if (contact_tracing_policy.send_report) {
+    const TestResult test_result = risk_score_->GetTestResult(timestep);
+    if (test_result != last_test_result_sent_) {
+      // We want to avoid re-sending ContactReports for contacts we've already
+      // sent a ContactReport for, so contacts_ tracks those we sent
+      // last_test_result_sent_ to.  If we get a new test result, though, we
+      // need to send that even for contacts we sent the previous result for.
+      contacts_.MarkNoneReported();
+      last_test_result_sent_ = test_result;
+    }
+    contacts_.ForEachUnreported(
+        [this, &writer, &test_result](const Contact& contact) {
+          writer.Write({.from_agent_uuid = uuid(),
+                        .to_agent_uuid = contact.other_uuid,
+                        .test_result = test_result});
+        });
+    contacts_.MarkAllReported();
   }
+  if (contact_tracing_policy.report_recursively) {
+    ForwardContactReports(timestep, contact_tracing_policy, received_reports,
+                          &writer);
+  }
+  writer.Flush(/*send_empty=*/contact_tracing_policy.send_report);
+}
 
-  std::vector<ContactReport> contact_reports;
-  for (auto contact = contacts_.rbegin(); contact != contacts_.rend();
-       ++contact) {
-    if (last_contact_report_considered_ != contacts_.end() &&
-        last_contact_report_considered_ == std::prev(contact.base())) {
-      break;
+void SEIRAgent::ForwardContactReports(
+    const Timestep& timestep,
+    const RiskScore::ContactTracingPolicy& contact_tracing_policy,
+    absl::Span<const ContactReport> received_reports,
+    ReportWriter* const writer) {
+  const absl::Time earliest_retained_result_time =
+      timestep.start_time() - risk_score_->ContactRetentionDuration();
+  for (auto it = forwarded_reports_.begin(); it != forwarded_reports_.end();) {
+    if (it->second.test_result.time_received < earliest_retained_result_time) {
+      forwarded_reports_.erase(it++);
+    } else {
+      ++it;
     }
-    contact_reports.push_back({.from_agent_uuid = uuid(),
-                               .to_agent_uuid = contact->other_uuid,
-                               .test_result = test_result});
   }
-  last_contact_report_considered_ = std::prev(contacts_.end());
-
-  broker->Send(contact_reports);
-}
 
-absl::Duration SEIRAgent::DurationSinceFirstInfection(
-    const absl::Time& current_time) const {
-  if (initial_infection_time_.has_value()) {
-    return current_time - initial_infection_time_.value();
+  for (const ContactReport& report : received_reports) {
+    if (report.hops >= contact_tracing_policy.max_hops ||
+        report.origin_agent_uuid == uuid()) {
+      continue;
+    }
+    auto [it, inserted] = forwarded_reports_.try_emplace(
+        report.origin_agent_uuid,
+        ForwardedReport{.test_result = report.test_result,
+                        .hops = report.hops});
+    if (!inserted) {
+      ForwardedReport& forwarded = it->second;
+      if (forwarded.test_result == report.test_result &&
+          forwarded.hops <= report.hops) {
+        continue;
+      }
+      forwarded = {.test_result = report.test_result, .hops = report.hops};
+    }
+    contacts_.ForEach([this, &report, writer](const Contact& contact) {
+      if (contact.other_uuid == report.from_agent_uuid ||
+          contact.other_uuid == report.origin_agent_uuid) {
+        return;
+      }
+      writer->Write({.from_agent_uuid = uuid(),
+                     .to_agent_uuid = contact.other_uuid,
+                     .test_result = report.test_result,
+                     .hops = report.hops + 1,
+                     .origin_agent_uuid = report.origin_agent_uuid});
+    });
   }
-  return absl::InfiniteDuration();
 }
 
 void SEIRAgent::ProcessInfectionOutcomes(
@@ -233,20 +333,8 @@ void SEIRAgent::ProcessInfectionOutcomes(
   for (const InfectionOutcome& infection_outcome : infection_outcomes) {
     // TODO: Record background exposures.
     if (infection_outcome.exposure_type == InfectionOutcomeProto::CONTACT) {
-      const Contact contact{.other_uuid = infection_outcome.source_uuid,
-                            .exposure = infection_outcome.exposure};
-      const auto previous_contact =
-          contact_set_.find(infection_outcome.source_uuid);
-      if (previous_contact != contact_set_.end()) {
-        std::list<Contact>::iterator iter = *previous_contact;
-        if (iter == last_contact_report_considered_) {
-          last_contact_report_considered_ =
-              iter == contacts_.begin() ? contacts_.end() : std::prev(iter);
-        }
-        contact_set_.erase(previous_contact);
-        contacts_.erase(iter);
-      }
-      contact_set_.insert(contacts_.insert(contacts_.end(), contact));
+      contacts_.Add({.other_uuid = infection_outcome.source_uuid,
+                     .exposure = infection_outcome.exposure});
       exposures.push_back(&infection_outcome.exposure);
     }
   }
@@ -261,33 +349,8 @@ void SEIRAgent::ProcessInfectionOutcomes(
   }
   const absl::Time earliest_retained_contact_time =
       timestep.start_time() - risk_score_->ContactRetentionDuration();
-  while (
-      !contacts_.empty() &&
-      ContactFromBefore(*contacts_.begin(), earliest_retained_contact_time)) {
-    if (contacts_.begin() == last_contact_report_considered_) {
-      last_contact_report_considered_ = contacts_.end();
-    }
-    contact_set_.erase(contacts_.begin());
-    contacts_.erase(contacts_.begin());
-  }
+  contacts_.RemoveContactsBefore(earliest_retained_contact_time);
   MaybeUpdateHealthTransitions(timestep);
 }
 
-float SEIRAgent::CurrentInfectivity(const absl::Time& current_time) const {
-  if (!IsInfectedState(CurrentHealthState()) ||
-      !initial_infection_time_.has_value() ||
-      current_time < initial_infection_time_) {
-    return 0;
-  }
-
-  const absl::Duration duration_since_infection =
-      DurationSinceFirstInfection(current_time);
-  const int discrete_days_since_infection =
-      (int)std::round(absl::ToDoubleHours(duration_since_infection) / 24.0f);
-
-  if (discrete_days_since_infection > 14) return 0;
-
-  return kInfectivityArray[discrete_days_since_infection];
-}
-
 }  // namespace abesim
@@ -18,12 +18,15 @@
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_SEIR_AGENT_H_
 
 #include <algorithm>
+#include <vector>
 
-#include "absl/container/flat_hash_set.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/contact_history.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
@@ -43,6 +46,22 @@ inline bool IsInfectedState(const HealthState::State& subject_health_state) {
                    subject_health_state) == kNotInfectedHealthStates.end();
 }
 
+// Returns the infectivity at the given time of an agent currently in the given
+// health state, that was first infected at initial_infection_time, if ever.
+float SEIRInfectivity(HealthState::State health_state,
+                      absl::optional<absl::Time> initial_infection_time,
+                      absl::Time time);
+
+// Assigns the agent uuid, health state, infectivity and symptom factor to each
+// of the visits from first_visit on.  Visits are split on HealthTransition
+// boundaries so that a unique HealthState can be assigned to each visit, and
+// split visits are appended to visits.  transitions holds the health
+// transitions of the agent in chronological order, and must cover the visits.
+void AssignSEIRHealthStates(int64 uuid,
+                            absl::Span<const HealthTransition> transitions,
+                            absl::optional<absl::Time> initial_infection_time,
+                            int first_visit, std::vector<Visit>* visits);
+
 // An agent that implements a stochastic SEIR model.
 class SEIRAgent : public Agent {
  public:
@@ -83,6 +102,18 @@ class SEIRAgent : public Agent {
       const Timestep& timestep,
       absl::Span<const InfectionOutcome> infection_outcomes) override;
 
+  // A SEIRAgent is quiescent while it has no retained contacts, which it would
+  // otherwise expire or report to, and no health transition due before the
+  // end of the timestep.
+  bool IsQuiescent(const Timestep& timestep) const override {
+    return contacts_.empty() &&
+           next_health_transition_.time >= timestep.end_time();
+  }
+
+  bool GetPossibleLocations(std::vector<int64>* location_uuids) const override {
+    return visit_generator_->GetPossibleLocations(location_uuids);
+  }
+
   HealthState::State CurrentHealthState() const override {
     return health_transitions_.back().health_state;
   }
@@ -108,7 +139,6 @@ class SEIRAgent : public Agent {
             std::unique_ptr<VisitGenerator> visit_generator,
             std::unique_ptr<RiskScore> risk_score)
       : uuid_(uuid),
-        last_contact_report_considered_(contacts_.end()),
         last_test_result_sent_({
             .time_requested = absl::InfiniteFuture(),
             .time_received = absl::InfiniteFuture(),
@@ -124,21 +154,18 @@ class SEIRAgent : public Agent {
     risk_score_->AddHealthStateTransistion(health_transitions_.back());
   }
 
-  // Computes infectivity of agent at a given time.
-  float CurrentInfectivity(const absl::Time& current_time) const;
-
   // Advances the health state transitions.
   void MaybeUpdateHealthTransitions(const Timestep& timestep);
-  // Splits visits on HealthTransition boundaries so that a unique HealthState
-  // can be assigned to each visit.
-  void SplitAndAssignHealthStates(std::vector<Visit>* visits) const;
-
   void SendContactReports(const Timestep& timestep,
                           absl::Span<const ContactReport> received_reports,
                           Broker<ContactReport>* broker);
-
-  absl::Duration DurationSinceFirstInfection(
-      const absl::Time& current_time) const;
+  // Streams contact reports to a broker in bounded chunks.
+  class ReportWriter;
+  // Writes the received reports to forward to contacts.
+  void ForwardContactReports(
+      const Timestep& timestep,
+      const RiskScore::ContactTracingPolicy& contact_tracing_policy,
+      absl::Span<const ContactReport> received_reports, ReportWriter* writer);
 
   const int64 uuid_;
   // The health state changes this agent has observed. Ordered in chronological
@@ -149,47 +176,21 @@ class SEIRAgent : public Agent {
   HealthTransition next_health_transition_;
   absl::optional<absl::Time> initial_infection_time_;
 
-  using ContactList = std::list<Contact>;
-  struct ContactHasher {
-    using is_transparent = void;
-    size_t operator()(ContactList::iterator contact) const {
-      return contact->other_uuid;
-    }
-    size_t operator()(int64 other_uuid) const { return other_uuid; }
-  };
-  struct ContactEq {
-    using is_transparent = void;
-    bool operator()(ContactList::iterator left,
-                    ContactList::iterator right) const {
-      return left->other_uuid == right->other_uuid;
-    }
-    bool operator()(int64 left, ContactList::iterator right) const {
-      return left == right->other_uuid;
-    }
-    bool operator()(ContactList::iterator left, int64 right) const {
-      return left->other_uuid == right;
-    }
-    bool operator()(int64 left, int64 right) const { return left == right; }
-  };
-  ContactList contacts_;
-  absl::flat_hash_set<ContactList::iterator, ContactHasher, ContactEq>
-      contact_set_;
-
-  // This is the last contact that we sent last_test_result_sent_ to.
-  // Before we send any test results, or if we remove all considered contacts
-  // last_contact_report_considered_ is set to contacts_.end() which is a
-  // special value that means none of the current contacts have been considered.
-  // Before any test has been sent last_test_result_sent_ is sent to a test that
-  // was administered at infinite future.
-  // Note also that if a previous contact with the same source exists, and if
-  // that contact was also the last_contact_report_considered, we reset
-  // last_contact_report_considered_ so it points to the position prior to the
-  // one about to be deleted, since in this case subsequent contacts are
-  // guaranteed not to be the last_contact_report_considered_ (or if there is
-  // not previous contact, then again to the special value contacts_.end()).
-  ContactList::iterator last_contact_report_considered_;
+  // The retained contacts, whose report cursor marks those last sent
+  // last_test_result_sent_.  A new test result is sent to every contact.
+  ContactHistory contacts_;
   TestResult last_test_result_sent_;
 
+  // The reports forwarded for each tested agent, with report_recursively.  A
+  // report is forwarded again only if it carries a new test result or has
+  // reached this agent in fewer hops, so each test result spreads at most once
+  // through each agent.
+  struct ForwardedReport {
+    TestResult test_result;
+    int32 hops;
+  };
+  absl::flat_hash_map<int64, ForwardedReport> forwarded_reports_;
+
   // Unowned (shared between agents at risk for the given disease).
   TransmissionModel* const transmission_model_;
   // TODO: It may be possible to share the transition_model. The
@@ -0,0 +1,134 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures SEIRAgent::ProcessInfectionOutcomes for an agent receiving range(0)
+// contact outcomes each day, retaining its contacts for range(1) days.
+
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/risk_score.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/transition_model.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
+#include "agent_based_epidemic_sim/core/visit_generator.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+// Never infects the agent, so it keeps processing outcomes as susceptible.
+class NoTransmissionModel : public TransmissionModel {
+ public:
+  HealthTransition GetInfectionOutcome(
+      absl::Span<const Exposure* const> exposures) override {
+    return {.time = absl::InfiniteFuture(),
+            .health_state = HealthState::SUSCEPTIBLE};
+  }
+};
+
+class NoTransitionModel : public TransitionModel {
+ public:
+  HealthTransition GetNextHealthTransition(
+      const HealthTransition& latest_transition) override {
+    return {.time = absl::InfiniteFuture(),
+            .health_state = latest_transition.health_state};
+  }
+};
+
+class NoVisitGenerator : public VisitGenerator {
+ public:
+  void GenerateVisits(const Timestep& timestep, const RiskScore& risk_score,
+                      std::vector<Visit>* visits) override {}
+};
+
+// A null risk score that retains contacts for a fixed duration.
+class RetainingRiskScore : public RiskScore {
+ public:
+  explicit RetainingRiskScore(const absl::Duration retention)
+      : null_(NewNullRiskScore()), retention_(retention) {}
+
+  void AddHealthStateTransistion(HealthTransition transition) override {}
+  void AddExposures(absl::Span<const Exposure* const> exposures) override {}
+  void AddExposureNotification(const Contact& contact,
+                               const TestResult& result,
+                               const int hops) override {}
+  VisitAdjustment GetVisitAdjustment(const Timestep& timestep,
+                                     int64 location_uuid) const override {
+    return null_->GetVisitAdjustment(timestep, location_uuid);
+  }
+  TestResult GetTestResult(const Timestep& timestep) const override {
+    return null_->GetTestResult(timestep);
+  }
+  ContactTracingPolicy GetContactTracingPolicy(
+      const Timestep& timestep) const override {
+    return null_->GetContactTracingPolicy(timestep);
+  }
+  absl::Duration ContactRetentionDuration() const override {
+    return retention_;
+  }
+
+ private:
+  const std::unique_ptr<RiskScore> null_;
+  const absl::Duration retention_;
+};
+
+void BM_ProcessInfectionOutcomes(benchmark::State& state) {
+  const int outcomes_per_day = state.range(0);
+  NoTransmissionModel transmission_model;
+  auto agent = SEIRAgent::CreateSusceptible(
+      0, &transmission_model, absl::make_unique<NoTransitionModel>(),
+      absl::make_unique<NoVisitGenerator>(),
+      absl::make_unique<RetainingRiskScore>(absl::Hours(24) * state.range(1)));
+
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  std::vector<InfectionOutcome> outcomes(outcomes_per_day);
+  int64 next_source = 1;
+  for (auto _ : state) {
+    // Filling in the outcomes is cheap compared to processing them, and much
+    // cheaper than pausing the timer.
+    for (int i = 0; i < outcomes_per_day; ++i) {
+      // Sources repeat every few days, as household and work contacts do.
+      outcomes[i] = {
+          .agent_uuid = 0,
+          .exposure = {.start_time = timestep.start_time() + absl::Minutes(i),
+                       .duration = absl::Minutes(30)},
+          .exposure_type = InfectionOutcomeProto::CONTACT,
+          .source_uuid = next_source++ % (3 * outcomes_per_day),
+      };
+    }
+    agent->ProcessInfectionOutcomes(timestep, outcomes);
+    timestep.Advance();
+  }
+  state.SetItemsProcessed(state.iterations() * outcomes_per_day);
+}
+
+void OutcomeVolumes(benchmark::internal::Benchmark* b) {
+  for (int outcomes : {1, 16, 256}) {
+    for (int retention_days : {0, 14}) {
+      b->Args({outcomes, retention_days});
+    }
+  }
+}
+
+BENCHMARK(BM_ProcessInfectionOutcomes)
+    ->Apply(OutcomeVolumes)
+    ->ArgNames({"outcomes", "retention_days"});
+
+}  // namespace
+}  // namespace abesim
@@ -79,7 +79,8 @@ class MockRiskScore : public RiskScore {
   MOCK_METHOD(void, AddExposures, (absl::Span<const Exposure* const> exposures),
               (override));
   MOCK_METHOD(void, AddExposureNotification,
-              (const Contact& contact, const TestResult& result), (override));
+              (const Contact& contact, const TestResult& result, int hops),
+              (override));
   MOCK_METHOD(VisitAdjustment, GetVisitAdjustment,
               (const Timestep& timestep, int64 location_uuid),
               (const, override));
@@ -485,10 +486,12 @@ TEST(SEIRAgentTest,
   // risk score.
   // Only the contact_report form agents 12 and 15 are reported because the
   // agent had no matching exposure for agent 13.
-  EXPECT_CALL(*risk_score, AddExposureNotification(
-                               contacts[0], contact_reports[0].test_result));
-  EXPECT_CALL(*risk_score, AddExposureNotification(
-                               contacts[1], contact_reports[2].test_result));
+  EXPECT_CALL(*risk_score,
+              AddExposureNotification(
+                  contacts[0], contact_reports[0].test_result, /*hops=*/1));
+  EXPECT_CALL(*risk_score,
+              AddExposureNotification(
+                  contacts[1], contact_reports[2].test_result, /*hops=*/1));
 
   auto agent = SEIRAgent::CreateSusceptible(
       kUuid, &transmission_model, std::move(transition_model),
@@ -588,8 +591,8 @@ TEST(SEIRAgentTest, NegativeTestResult) {
       OutcomesFromContacts(kUuid, contacts);
   EXPECT_CALL(*risk_score,
               AddExposures(testing::ElementsAre(&outcomes[0].exposure)));
-  EXPECT_CALL(*risk_score,
-              AddExposureNotification(contacts[0], contact_test_result));
+  EXPECT_CALL(*risk_score, AddExposureNotification(
+                               contacts[0], contact_test_result, /*hops=*/1));
 
   EXPECT_CALL(*risk_score, GetContactTracingPolicy(_))
       .WillOnce(Return(RiskScore::ContactTracingPolicy{.send_report = false}));
@@ -818,6 +821,234 @@ TEST(SEIRAgentTest, SendContactReports) {
   agent->UpdateContactReports(timestep6, {}, contact_report_broker.get());
 }
 
+TEST(SEIRAgentTest, SendsContactReportsForLongHistories) {
+  const int64 kUuid = 42LL;
+  constexpr int kNumContacts = 1000;
+  MockTransmissionModel transmission_model;
+  EXPECT_CALL(transmission_model, GetInfectionOutcome)
+      .WillRepeatedly(
+          Return(HealthTransition{.health_state = HealthState::SUSCEPTIBLE}));
+  auto risk_score = absl::make_unique<MockRiskScore>();
+  EXPECT_CALL(*risk_score, AddHealthStateTransistion)
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*risk_score, AddExposures).Times(testing::AnyNumber());
+  EXPECT_CALL(*risk_score, ContactRetentionDuration)
+      .WillRepeatedly(Return(absl::Hours(24 * 7)));
+  EXPECT_CALL(*risk_score, GetContactTracingPolicy(_))
+      .WillRepeatedly(
+          Return(RiskScore::ContactTracingPolicy{.send_report = true}));
+  const TestResult test_result{.time_requested = TimeFromDay(0),
+                               .time_received = TimeFromDay(1),
+                               .probability = 1.0f};
+  EXPECT_CALL(*risk_score, GetTestResult).WillRepeatedly(Return(test_result));
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, absl::make_unique<MockTransitionModel>(),
+      absl::make_unique<MockVisitGenerator>(), std::move(risk_score));
+
+  std::vector<Contact> contacts;
+  std::vector<ContactReport> expected_reports;
+  for (int64 other_uuid = 0; other_uuid < kNumContacts; ++other_uuid) {
+    contacts.push_back(
+        {.other_uuid = other_uuid,
+         .exposure = {.start_time = TimeFromDay(0),
+                      .duration = absl::Hours(1)}});
+    expected_reports.push_back({.from_agent_uuid = kUuid,
+                                .to_agent_uuid = other_uuid,
+                                .test_result = test_result});
+  }
+  const Timestep timestep(TimeFromDay(1), absl::Hours(24));
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, contacts));
+
+  // The reports may be sent in several batches, but each is sent once.
+  std::vector<ContactReport> reports;
+  MockBroker<ContactReport> broker;
+  EXPECT_CALL(broker, Send)
+      .WillRepeatedly([&reports](absl::Span<const ContactReport> batch) {
+        EXPECT_THAT(batch, testing::Not(testing::IsEmpty()));
+        reports.insert(reports.end(), batch.begin(), batch.end());
+      });
+  agent->UpdateContactReports(timestep, {}, &broker);
+  EXPECT_THAT(reports, testing::UnorderedElementsAreArray(expected_reports));
+}
+
+TEST(SEIRAgentTest, ForwardsContactReports) {
+  const int64 kUuid = 42LL;
+  MockTransmissionModel transmission_model;
+  EXPECT_CALL(transmission_model, GetInfectionOutcome)
+      .WillRepeatedly(
+          Return(HealthTransition{.health_state = HealthState::SUSCEPTIBLE}));
+  auto risk_score = absl::make_unique<MockRiskScore>();
+  EXPECT_CALL(*risk_score, AddHealthStateTransistion)
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*risk_score, AddExposures).Times(testing::AnyNumber());
+  // The risk score is told how far each report has travelled.
+  std::vector<int> notified_hops;
+  EXPECT_CALL(*risk_score, AddExposureNotification)
+      .WillRepeatedly([&notified_hops](const Contact& contact,
+                                       const TestResult& result,
+                                       const int hops) {
+        notified_hops.push_back(hops);
+      });
+  EXPECT_CALL(*risk_score, ContactRetentionDuration)
+      .WillRepeatedly(Return(absl::Hours(24 * 7)));
+  EXPECT_CALL(*risk_score, GetContactTracingPolicy(_))
+      .WillRepeatedly(Return(RiskScore::ContactTracingPolicy{
+          .report_recursively = true, .send_report = false, .max_hops = 3}));
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, absl::make_unique<MockTransitionModel>(),
+      absl::make_unique<MockVisitGenerator>(), std::move(risk_score));
+
+  Timestep timestep(TimeFromDay(1), absl::Hours(24));
+  std::vector<Contact> contacts;
+  for (const int64 other_uuid : {1LL, 2LL, 3LL}) {
+    contacts.push_back(
+        {.other_uuid = other_uuid,
+         .exposure = {.start_time = TimeFromDayAndHour(0, other_uuid),
+                      .duration = absl::Hours(1)}});
+  }
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, contacts));
+
+  const TestResult test_result1{.time_requested = TimeFromDay(0),
+                                .time_received = TimeFromDay(1),
+                                .probability = 1.0f};
+  const TestResult test_result2{.time_requested = TimeFromDay(1),
+                                .time_received = TimeFromDay(2),
+                                .probability = 0.0f};
+  // Reports are forwarded to every contact other than the agent they came
+  // from and the tested agent.
+  MockBroker<ContactReport> broker;
+  EXPECT_CALL(broker, Send(testing::UnorderedElementsAreArray(
+                          std::vector<ContactReport>{
+                              {.from_agent_uuid = kUuid,
+                               .to_agent_uuid = 2LL,
+                               .test_result = test_result1,
+                               .hops = 2,
+                               .origin_agent_uuid = 1LL},
+                              {.from_agent_uuid = kUuid,
+                               .to_agent_uuid = 3LL,
+                               .test_result = test_result1,
+                               .hops = 2,
+                               .origin_agent_uuid = 1LL},
+                              {.from_agent_uuid = kUuid,
+                               .to_agent_uuid = 1LL,
+                               .test_result = test_result1,
+                               .hops = 3,
+                               .origin_agent_uuid = 7LL},
+                              {.from_agent_uuid = kUuid,
+                               .to_agent_uuid = 3LL,
+                               .test_result = test_result1,
+                               .hops = 3,
+                               .origin_agent_uuid = 7LL}})))
+      .Times(1);
+  agent->UpdateContactReports(
+      timestep,
+      std::vector<ContactReport>{{.from_agent_uuid = 1LL,
+                                  .to_agent_uuid = kUuid,
+                                  .test_result = test_result1},
+                                 {.from_agent_uuid = 2LL,
+                                  .to_agent_uuid = kUuid,
+                                  .test_result = test_result1,
+                                  .hops = 2,
+                                  .origin_agent_uuid = 7LL}},
+      &broker);
+  testing::Mock::VerifyAndClearExpectations(&broker);
+
+  // A test result already forwarded, reports at the hop limit, and reports of
+  // this agent's own test result are not forwarded.
+  timestep.Advance();
+  EXPECT_CALL(broker, Send).Times(0);
+  agent->UpdateContactReports(
+      timestep,
+      std::vector<ContactReport>{{.from_agent_uuid = 3LL,
+                                  .to_agent_uuid = kUuid,
+                                  .test_result = test_result1,
+                                  .hops = 2,
+                                  .origin_agent_uuid = 1LL},
+                                 {.from_agent_uuid = 2LL,
+                                  .to_agent_uuid = kUuid,
+                                  .test_result = test_result1,
+                                  .hops = 3,
+                                  .origin_agent_uuid = 8LL},
+                                 {.from_agent_uuid = 2LL,
+                                  .to_agent_uuid = kUuid,
+                                  .test_result = test_result1,
+                                  .hops = 2,
+                                  .origin_agent_uuid = kUuid}},
+      &broker);
+  testing::Mock::VerifyAndClearExpectations(&broker);
+
+  // A new test result is forwarded again.
+  EXPECT_CALL(broker, Send(testing::UnorderedElementsAreArray(
+                          std::vector<ContactReport>{
+                              {.from_agent_uuid = kUuid,
+                               .to_agent_uuid = 2LL,
+                               .test_result = test_result2,
+                               .hops = 2,
+                               .origin_agent_uuid = 1LL},
+                              {.from_agent_uuid = kUuid,
+                               .to_agent_uuid = 3LL,
+                               .test_result = test_result2,
+                               .hops = 2,
+                               .origin_agent_uuid = 1LL}})))
+      .Times(1);
+  agent->UpdateContactReports(
+      timestep,
+      std::vector<ContactReport>{{.from_agent_uuid = 1LL,
+                                  .to_agent_uuid = kUuid,
+                                  .test_result = test_result2}},
+      &broker);
+  EXPECT_THAT(notified_hops, testing::ElementsAre(1, 2, 2, 3, 2, 1));
+}
+
+TEST(SEIRAgentTest, IsNotQuiescentWithRetainedContacts) {
+  MockTransmissionModel transmission_model;
+  auto risk_score = absl::make_unique<MockRiskScore>();
+  EXPECT_CALL(*risk_score, ContactRetentionDuration())
+      .WillRepeatedly(Return(absl::Hours(24)));
+  EXPECT_CALL(transmission_model, GetInfectionOutcome)
+      .WillOnce(
+          Return(HealthTransition{.health_state = HealthState::SUSCEPTIBLE}));
+  const int64 kUuid = 42LL;
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, absl::make_unique<MockTransitionModel>(),
+      absl::make_unique<MockVisitGenerator>(), std::move(risk_score));
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  EXPECT_TRUE(agent->IsQuiescent(timestep));
+
+  const std::vector<Contact> contacts = {
+      {.other_uuid = kUuid + 1,
+       .exposure = {.start_time = absl::UnixEpoch(),
+                    .duration = absl::Hours(1),
+                    .infectivity = 1.0f}}};
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, contacts));
+  EXPECT_FALSE(agent->IsQuiescent(timestep));
+}
+
+TEST(SEIRAgentTest, IsNotQuiescentWithTransitionDueInTimestep) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  MockTransmissionModel transmission_model;
+  EXPECT_CALL(*transition_model, GetNextHealthTransition)
+      .WillOnce(
+          Return(HealthTransition{.time = absl::FromUnixSeconds(86400LL),
+                                  .health_state = HealthState::INFECTIOUS}));
+  auto agent = SEIRAgent::Create(
+      42LL,
+      {.time = absl::FromUnixSeconds(-1LL),
+       .health_state = HealthState::EXPOSED},
+      &transmission_model, std::move(transition_model),
+      absl::make_unique<MockVisitGenerator>(), NewNullRiskScore());
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  // The initial transition has yet to be applied.
+  EXPECT_FALSE(agent->IsQuiescent(timestep));
+  agent->ProcessInfectionOutcomes(timestep, {});
+  EXPECT_TRUE(agent->IsQuiescent(timestep));
+  timestep.Advance();
+  EXPECT_FALSE(agent->IsQuiescent(timestep));
+}
+
 TEST(SEIRAgentTest, UpdateContactReportsRejectsWrongUuid) {
   auto transition_model = absl::make_unique<MockTransitionModel>();
   auto visit_generator = absl::make_unique<MockVisitGenerator>();
@@ -0,0 +1,299 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/seir_population.h"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/types/optional.h"
+#include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
+#include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
+#include "agent_based_epidemic_sim/core/sort_by_dest.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// The result reported by agents without a RiskScore, as by NewNullRiskScore.
+const TestResult kNoTestResult = {
+    .time_requested = absl::InfiniteFuture(),
+    .time_received = absl::InfiniteFuture(),
+    .probability = 0.0,
+};
+
+// Returns the elements of values in the given order.
+template <typename T>
+std::vector<T> Permute(const std::vector<int>& order, std::vector<T> values) {
+  std::vector<T> permuted;
+  permuted.reserve(values.size());
+  for (const int i : order) permuted.push_back(std::move(values[i]));
+  return permuted;
+}
+
+}  // namespace
+
+// The Agent handle of a population member.  Every call is forwarded to the
+// population.
+class SEIRPopulation::Member final : public Agent {
+ public:
+  Member(SEIRPopulation* const population, const int index)
+      : population_(population), index_(index) {}
+
+  int index() const { return index_; }
+
+  int64 uuid() const override { return population_->uuids_[index_]; }
+
+  void ComputeVisits(const Timestep& timestep,
+                     Broker<Visit>* const visit_broker) const override {
+    thread_local std::vector<Visit> visits;
+    visits.clear();
+    population_->ComputeVisits(index_, timestep, &visits);
+    visit_broker->Send(visits);
+  }
+
+  void UpdateContactReports(const Timestep& timestep,
+                            absl::Span<const ContactReport> contact_reports,
+                            Broker<ContactReport>* broker) override {}
+
+  void ProcessInfectionOutcomes(
+      const Timestep& timestep,
+      const absl::Span<const InfectionOutcome> infection_outcomes) override {
+    population_->ProcessInfectionOutcomes(index_, timestep,
+                                          infection_outcomes);
+  }
+
+  bool IsQuiescent(const Timestep& timestep) const override {
+    return population_->IsQuiescent(index_, timestep);
+  }
+
+  bool GetPossibleLocations(std::vector<int64>* location_uuids) const override {
+    const absl::Span<const int64> locations = population_->Locations(index_);
+    location_uuids->insert(location_uuids->end(), locations.begin(),
+                           locations.end());
+    return true;
+  }
+
+  HealthState::State CurrentHealthState() const override {
+    return population_->health_states_[index_];
+  }
+
+  TestResult CurrentTestResult(const Timestep& timestep) const override {
+    return kNoTestResult;
+  }
+
+  absl::Span<const HealthTransition> HealthTransitions() const override {
+    return population_->health_transitions_[index_];
+  }
+
+  AgentGroup* group() const override { return population_; }
+
+ private:
+  SEIRPopulation* const population_;
+  const int index_;
+};
+
+SEIRPopulation::SEIRPopulation(TransmissionModel* const transmission_model)
+    : transmission_model_(transmission_model), location_offsets_({0}) {}
+
+SEIRPopulation::~SEIRPopulation() = default;
+
+int SEIRPopulation::AddProfile(Profile profile) {
+  profiles_.push_back(std::move(profile));
+  return profiles_.size() - 1;
+}
+
+void SEIRPopulation::AddAgent(const int64 uuid,
+                              const HealthTransition& initial_health_transition,
+                              const int profile,
+                              const absl::Span<const int64> location_uuids) {
+  DCHECK(members_.empty()) << "Agents added after MakeAgents.";
+  DCHECK_GE(profile, 0);
+  DCHECK_LT(profile, profiles_.size());
+  DCHECK_EQ(location_uuids.size(), profiles_[profile].visit_durations.size());
+  DCHECK(!location_uuids.empty()) << "Agents have to be somewhere.";
+  uuids_.push_back(uuid);
+  health_states_.push_back(HealthState::SUSCEPTIBLE);
+  transition_times_.push_back(absl::InfinitePast());
+  next_transition_times_.push_back(initial_health_transition.time);
+  next_health_states_.push_back(initial_health_transition.health_state);
+  infection_times_.push_back(absl::InfiniteFuture());
+  profile_indices_.push_back(profile);
+  location_uuids_.insert(location_uuids_.end(), location_uuids.begin(),
+                         location_uuids.end());
+  location_offsets_.push_back(location_uuids_.size());
+  health_transitions_.push_back({{.time = absl::InfinitePast(),
+                                  .health_state = HealthState::SUSCEPTIBLE}});
+}
+
+std::vector<std::unique_ptr<Agent>> SEIRPopulation::MakeAgents() {
+  DCHECK(members_.empty()) << "MakeAgents may only be called once.";
+  // Simulations step agents in uuid order, so store them in that order too.
+  std::vector<int> order(uuids_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [this](const int a, const int b) { return uuids_[a] < uuids_[b]; });
+  std::vector<int> location_offsets = {0};
+  std::vector<int64> location_uuids;
+  location_uuids.reserve(location_uuids_.size());
+  for (const int i : order) {
+    const absl::Span<const int64> locations = Locations(i);
+    location_uuids.insert(location_uuids.end(), locations.begin(),
+                          locations.end());
+    location_offsets.push_back(location_uuids.size());
+  }
+  location_offsets_ = std::move(location_offsets);
+  location_uuids_ = std::move(location_uuids);
+  uuids_ = Permute(order, std::move(uuids_));
+  health_states_ = Permute(order, std::move(health_states_));
+  transition_times_ = Permute(order, std::move(transition_times_));
+  next_transition_times_ = Permute(order, std::move(next_transition_times_));
+  next_health_states_ = Permute(order, std::move(next_health_states_));
+  infection_times_ = Permute(order, std::move(infection_times_));
+  profile_indices_ = Permute(order, std::move(profile_indices_));
+  health_transitions_ = Permute(order, std::move(health_transitions_));
+
+  std::vector<std::unique_ptr<Agent>> agents;
+  agents.reserve(uuids_.size());
+  members_.reserve(uuids_.size());
+  for (int i = 0; i < uuids_.size(); ++i) {
+    auto member = absl::make_unique<Member>(this, i);
+    members_.push_back(member.get());
+    agents.push_back(std::move(member));
+  }
+  return agents;
+}
+
+int SEIRPopulation::StepAgents(
+    const Timestep& timestep, absl::Span<const std::unique_ptr<Agent>> agents,
+    absl::Span<const InfectionOutcome>* const outcomes,
+    absl::Span<const ContactReport>* const reports,
+    AgentInfectionObserver* const observer, Broker<Visit>* const visit_broker,
+    Broker<ContactReport>* const contact_report_broker) {
+  DCHECK(!agents.empty() && agents[0]->group() == this);
+  thread_local std::vector<Visit> visits;
+  visits.clear();
+  const int first = static_cast<const Member*>(agents[0].get())->index();
+  int stepped = 0;
+  // Members of the run are consecutive in both agents and members_, so a
+  // pointer comparison tells where the run ends.
+  for (; stepped < agents.size() && first + stepped < members_.size() &&
+         agents[stepped].get() == members_[first + stepped];
+       ++stepped) {
+    const int agent = first + stepped;
+    absl::Span<const InfectionOutcome> agent_outcomes;
+    std::tie(agent_outcomes, *outcomes) =
+        SplitMessages(uuids_[agent], *outcomes);
+    // Population members never send contact reports, so they ignore any they
+    // receive, as a SEIRAgent with a null RiskScore would.
+    *reports = SplitMessages(uuids_[agent], *reports).second;
+    observer->Observe(*agents[stepped], agent_outcomes);
+    if (!agent_outcomes.empty() || !IsQuiescent(agent, timestep)) {
+      ProcessInfectionOutcomes(agent, timestep, agent_outcomes);
+    }
+    ComputeVisits(agent, timestep, &visits);
+  }
+  visit_broker->Send(visits);
+  return stepped;
+}
+
+void SEIRPopulation::ProcessInfectionOutcomes(
+    const int agent, const Timestep& timestep,
+    const absl::Span<const InfectionOutcome> outcomes) {
+  DCHECK(std::all_of(outcomes.begin(), outcomes.end(),
+                     [this, agent](const InfectionOutcome& outcome) {
+                       return outcome.agent_uuid == uuids_[agent];
+                     }))
+      << "Found incorrect InfectionOutcome uuid.";
+  if (next_health_states_[agent] == HealthState::SUSCEPTIBLE &&
+      !outcomes.empty()) {
+    thread_local std::vector<const Exposure*> exposures;
+    exposures.clear();
+    for (const InfectionOutcome& outcome : outcomes) {
+      if (outcome.exposure_type == InfectionOutcomeProto::CONTACT) {
+        exposures.push_back(&outcome.exposure);
+      }
+    }
+    if (!exposures.empty()) {
+      const HealthTransition health_transition =
+          transmission_model_->GetInfectionOutcome(exposures);
+      if (health_transition.health_state == HealthState::EXPOSED) {
+        next_transition_times_[agent] = health_transition.time;
+        next_health_states_[agent] = health_transition.health_state;
+      }
+    }
+  }
+  MaybeUpdateHealthTransitions(agent, timestep);
+}
+
+void SEIRPopulation::MaybeUpdateHealthTransitions(const int agent,
+                                                  const Timestep& timestep) {
+  TransitionModel* const transition_model =
+      profiles_[profile_indices_[agent]].transition_model;
+  while (next_transition_times_[agent] < timestep.end_time()) {
+    const HealthTransition transition = {
+        .time = next_transition_times_[agent],
+        .health_state = next_health_states_[agent]};
+    if (IsInfectedState(transition.health_state) &&
+        infection_times_[agent] == absl::InfiniteFuture()) {
+      infection_times_[agent] = transition.time;
+    }
+    health_transitions_[agent].push_back(transition);
+    health_states_[agent] = transition.health_state;
+    transition_times_[agent] = transition.time;
+    HealthTransition next =
+        transition_model->GetNextHealthTransition(transition);
+    // As in SEIRAgent, every health state lasts at least one timestep.
+    next.time = std::max(next.time, transition.time + timestep.duration());
+    next_transition_times_[agent] = next.time;
+    next_health_states_[agent] = next.health_state;
+  }
+}
+
+void SEIRPopulation::ComputeVisits(const int agent, const Timestep& timestep,
+                                   std::vector<Visit>* const visits) const {
+  // As DurationSpecifiedVisitGenerator::GenerateVisits, with the unit visit
+  // adjustment of a null RiskScore.
+  const Profile& profile = profiles_[profile_indices_[agent]];
+  thread_local std::vector<float> durations;
+  durations.clear();
+  for (const auto& sample_duration : profile.visit_durations) {
+    durations.push_back(sample_duration(1.0f));
+  }
+  const int first_visit = visits->size();
+  AppendScheduledVisits(timestep, Locations(agent), absl::MakeSpan(durations),
+                        visits);
+
+  const absl::optional<absl::Time> infection_time =
+      infection_times_[agent] == absl::InfiniteFuture()
+          ? absl::nullopt
+          : absl::make_optional(infection_times_[agent]);
+  if (transition_times_[agent] <= timestep.start_time()) {
+    // The common case: the health state is unchanged throughout the timestep,
+    // so the cold transition history need not be read.
+    const HealthTransition current = {.time = transition_times_[agent],
+                                      .health_state = health_states_[agent]};
+    AssignSEIRHealthStates(uuids_[agent], {&current, 1}, infection_time,
+                           first_visit, visits);
+  } else {
+    AssignSEIRHealthStates(uuids_[agent], health_transitions_[agent],
+                           infection_time, first_visit, visits);
+  }
+}
+
+}  // namespace abesim
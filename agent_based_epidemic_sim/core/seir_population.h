@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_SEIR_POPULATION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_SEIR_POPULATION_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/transition_model.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+
+namespace abesim {
+
+// SEIRPopulation stores a population of SEIR agents in contiguous arrays,
+// rather than as individually allocated SEIRAgents.  It covers the common
+// SEIRAgent configuration: a TransitionModel shared by agents of the same
+// profile, a DurationSpecifiedVisitGenerator, and a null RiskScore.  Each agent
+// behaves exactly as a SEIRAgent so configured, but simulations step runs of
+// agents from the same population with a single call that touches only the
+// arrays.
+//
+// The population hands out lightweight Agent handles that simulations and
+// observers use like any other agent.  The population must outlive them.
+class SEIRPopulation : public AgentGroup {
+ public:
+  // A visit schedule and disease progression shared by many agents.
+  struct Profile {
+    // Unowned, and must outlive the population.
+    TransitionModel* transition_model;
+    // Samples the duration of each visit in an agent's daily schedule, as in
+    // LocationDuration::sample_duration.  Agents with this profile supply a
+    // location for each.
+    std::vector<std::function<float(float adjustment)>> visit_durations;
+  };
+
+  // The transmission_model is unowned, and must outlive the population.
+  explicit SEIRPopulation(TransmissionModel* transmission_model);
+  ~SEIRPopulation() override;
+
+  SEIRPopulation(const SEIRPopulation&) = delete;
+  SEIRPopulation& operator=(const SEIRPopulation&) = delete;
+
+  // Adds a profile and returns its index.
+  int AddProfile(Profile profile);
+
+  // Adds an agent as SEIRAgent::Create would, visiting the given locations in
+  // the order of its profile's visit durations.
+  void AddAgent(int64 uuid, const HealthTransition& initial_health_transition,
+                int profile, absl::Span<const int64> location_uuids);
+
+  // Returns handles for every agent added, sorted by uuid.  This may only be
+  // called once, after which no more agents may be added.
+  std::vector<std::unique_ptr<Agent>> MakeAgents();
+
+  int StepAgents(const Timestep& timestep,
+                 absl::Span<const std::unique_ptr<Agent>> agents,
+                 absl::Span<const InfectionOutcome>* outcomes,
+                 absl::Span<const ContactReport>* reports,
+                 AgentInfectionObserver* observer, Broker<Visit>* visit_broker,
+                 Broker<ContactReport>* contact_report_broker) override;
+
+ private:
+  class Member;
+
+  // Per agent operations, by index.
+  void ProcessInfectionOutcomes(int agent, const Timestep& timestep,
+                                absl::Span<const InfectionOutcome> outcomes);
+  void MaybeUpdateHealthTransitions(int agent, const Timestep& timestep);
+  // Appends the visits of the given agent to visits.
+  void ComputeVisits(int agent, const Timestep& timestep,
+                     std::vector<Visit>* visits) const;
+  bool IsQuiescent(const int agent, const Timestep& timestep) const {
+    return next_transition_times_[agent] >= timestep.end_time();
+  }
+  absl::Span<const int64> Locations(const int agent) const {
+    return absl::MakeConstSpan(location_uuids_)
+        .subspan(location_offsets_[agent],
+                 location_offsets_[agent + 1] - location_offsets_[agent]);
+  }
+
+  TransmissionModel* const transmission_model_;
+  std::vector<Profile> profiles_;
+  // Handles by agent index, owned by the simulation.
+  std::vector<const Member*> members_;
+
+  // Hot state, read or written every step, by agent index.
+  std::vector<int64> uuids_;
+  std::vector<HealthState::State> health_states_;
+  // The time of the latest health transition.
+  std::vector<absl::Time> transition_times_;
+  std::vector<absl::Time> next_transition_times_;
+  std::vector<HealthState::State> next_health_states_;
+  // The time of the first transition to an infected state, or InfiniteFuture.
+  std::vector<absl::Time> infection_times_;
+  std::vector<int> profile_indices_;
+  // The locations of agent i are location_uuids_[location_offsets_[i],
+  // location_offsets_[i + 1]).
+  std::vector<int> location_offsets_;
+  std::vector<int64> location_uuids_;
+
+  // Cold state, only touched on health transitions or by observers.
+  std::vector<std::vector<HealthTransition>> health_transitions_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_SEIR_POPULATION_H_
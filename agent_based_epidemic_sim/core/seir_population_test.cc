@@ -0,0 +1,448 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/seir_population.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/risk_score.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/core/sort_by_dest.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/transition_model.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAreArray;
+
+// Progresses EXPOSED -> INFECTIOUS -> RECOVERED.  INFECTIOUS follows EXPOSED
+// after less than a timestep, so that the minimum dwell time applies.
+class FixedTransitionModel : public TransitionModel {
+ public:
+  HealthTransition GetNextHealthTransition(
+      const HealthTransition& latest_transition) override {
+    switch (latest_transition.health_state) {
+      case HealthState::EXPOSED:
+        return {.time = latest_transition.time + absl::Hours(2),
+                .health_state = HealthState::INFECTIOUS};
+      case HealthState::INFECTIOUS:
+        return {.time = latest_transition.time + absl::Hours(60),
+                .health_state = HealthState::RECOVERED};
+      default:
+        return {.time = absl::InfiniteFuture(),
+                .health_state = latest_transition.health_state};
+    }
+  }
+};
+
+// Transmits on any contact, at the start of the earliest exposure.
+class FixedTransmissionModel : public TransmissionModel {
+ public:
+  HealthTransition GetInfectionOutcome(
+      absl::Span<const Exposure* const> exposures) override {
+    absl::Time time = absl::InfiniteFuture();
+    for (const Exposure* exposure : exposures) {
+      time = std::min(time, exposure->start_time);
+    }
+    return {.time = time, .health_state = HealthState::EXPOSED};
+  }
+};
+
+template <typename T>
+class RecordingBroker : public Broker<T> {
+ public:
+  void Send(absl::Span<const T> msgs) override {
+    msgs_.insert(msgs_.end(), msgs.begin(), msgs.end());
+  }
+  std::vector<T>& msgs() { return msgs_; }
+
+ private:
+  std::vector<T> msgs_;
+};
+
+class CountingObserver : public AgentInfectionObserver {
+ public:
+  void Observe(const Agent& agent,
+               absl::Span<const InfectionOutcome> outcomes) override {
+    observed_.push_back(agent.uuid());
+  }
+  const std::vector<int64>& observed() const { return observed_; }
+
+ private:
+  std::vector<int64> observed_;
+};
+
+// Samplers that cycle through fixed durations, including steps in which no
+// location is sampled at all.
+std::vector<std::function<float(float)>> CyclingDurations() {
+  std::vector<std::function<float(float)>> durations;
+  for (int k = 1; k <= 2; ++k) {
+    durations.push_back([k, count = 0](float adjustment) mutable {
+      return adjustment * 4.0f * ((count++ * k) % 3);
+    });
+  }
+  return durations;
+}
+
+std::vector<LocationDuration> ToLocationDurations(
+    const std::vector<int64>& location_uuids,
+    std::vector<std::function<float(float)>> durations) {
+  std::vector<LocationDuration> location_durations;
+  for (int i = 0; i < location_uuids.size(); ++i) {
+    location_durations.push_back({.location_uuid = location_uuids[i],
+                                  .sample_duration = std::move(durations[i])});
+  }
+  return location_durations;
+}
+
+InfectionOutcome ContactOutcome(const int64 agent_uuid,
+                                const int64 source_uuid,
+                                const absl::Time time) {
+  return {.agent_uuid = agent_uuid,
+          .exposure = {.start_time = time, .duration = absl::Hours(1)},
+          .exposure_type = InfectionOutcomeProto::CONTACT,
+          .source_uuid = source_uuid};
+}
+
+TEST(SEIRPopulationTest, MatchesSEIRAgent) {
+  FixedTransmissionModel transmission_model;
+  FixedTransitionModel transition_model;
+  const std::vector<int64> locations = {100, 101};
+  const std::vector<HealthTransition> initial_transitions = {
+      {.time = absl::InfiniteFuture(),
+       .health_state = HealthState::SUSCEPTIBLE},
+      {.time = absl::UnixEpoch() + absl::Hours(12),
+       .health_state = HealthState::EXPOSED},
+  };
+  for (const HealthTransition& initial_transition : initial_transitions) {
+    auto seir_agent = SEIRAgent::Create(
+        7, initial_transition, &transmission_model,
+        absl::make_unique<FixedTransitionModel>(),
+        absl::make_unique<DurationSpecifiedVisitGenerator>(
+            ToLocationDurations(locations, CyclingDurations())),
+        NewNullRiskScore());
+    SEIRPopulation population(&transmission_model);
+    const int profile = population.AddProfile(
+        {.transition_model = &transition_model,
+         .visit_durations = CyclingDurations()});
+    population.AddAgent(7, initial_transition, profile, locations);
+    const std::vector<std::unique_ptr<Agent>> agents = population.MakeAgents();
+    ASSERT_EQ(agents.size(), 1);
+    EXPECT_EQ(agents[0]->group(), &population);
+
+    Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+    for (int step = 0; step < 10; ++step) {
+      std::vector<InfectionOutcome> outcomes;
+      if (step == 1 || step == 5) {
+        const absl::Time time = timestep.start_time() + absl::Hours(3);
+        outcomes = {ContactOutcome(7, 1, time),
+                    ContactOutcome(7, 2, time - absl::Hours(1)),
+                    {.agent_uuid = 7,
+                     .exposure = {.start_time = time},
+                     .exposure_type = InfectionOutcomeProto::LOCATION}};
+      }
+      RecordingBroker<Visit> expected_visits;
+      RecordingBroker<ContactReport> expected_reports;
+      seir_agent->ProcessInfectionOutcomes(timestep, outcomes);
+      seir_agent->UpdateContactReports(timestep, {}, &expected_reports);
+      seir_agent->ComputeVisits(timestep, &expected_visits);
+
+      RecordingBroker<Visit> visits;
+      RecordingBroker<ContactReport> reports;
+      CountingObserver observer;
+      absl::Span<const InfectionOutcome> remaining_outcomes = outcomes;
+      absl::Span<const ContactReport> remaining_reports;
+      EXPECT_EQ(population.StepAgents(timestep, agents, &remaining_outcomes,
+                                      &remaining_reports, &observer, &visits,
+                                      &reports),
+                1);
+      EXPECT_TRUE(remaining_outcomes.empty());
+      EXPECT_THAT(observer.observed(), ElementsAreArray({7}));
+
+      EXPECT_THAT(visits.msgs(), ElementsAreArray(expected_visits.msgs()))
+          << "step " << step;
+      EXPECT_TRUE(reports.msgs().empty());
+      EXPECT_TRUE(expected_reports.msgs().empty());
+      EXPECT_THAT(agents[0]->HealthTransitions(),
+                  ElementsAreArray(seir_agent->HealthTransitions()));
+      EXPECT_EQ(agents[0]->CurrentHealthState(),
+                seir_agent->CurrentHealthState());
+      EXPECT_EQ(agents[0]->CurrentTestResult(timestep),
+                seir_agent->CurrentTestResult(timestep));
+      timestep.Advance();
+    }
+    EXPECT_EQ(agents[0]->CurrentHealthState(), HealthState::RECOVERED);
+  }
+}
+
+TEST(SEIRPopulationTest, ReportsPossibleLocations) {
+  FixedTransmissionModel transmission_model;
+  FixedTransitionModel transition_model;
+  SEIRPopulation population(&transmission_model);
+  const int profile =
+      population.AddProfile({.transition_model = &transition_model,
+                             .visit_durations = CyclingDurations()});
+  population.AddAgent(2, {.time = absl::InfiniteFuture(),
+                          .health_state = HealthState::SUSCEPTIBLE},
+                      profile, {20, 21});
+  population.AddAgent(1, {.time = absl::InfiniteFuture(),
+                          .health_state = HealthState::SUSCEPTIBLE},
+                      profile, {10, 11});
+  const std::vector<std::unique_ptr<Agent>> agents = population.MakeAgents();
+  ASSERT_EQ(agents.size(), 2);
+  EXPECT_EQ(agents[0]->uuid(), 1);
+  EXPECT_EQ(agents[1]->uuid(), 2);
+  std::vector<int64> location_uuids;
+  EXPECT_TRUE(agents[1]->GetPossibleLocations(&location_uuids));
+  EXPECT_THAT(location_uuids, ElementsAreArray({20, 21}));
+}
+
+TEST(SEIRPopulationTest, StepsOnlyConsecutiveMembers) {
+  FixedTransmissionModel transmission_model;
+  FixedTransitionModel transition_model;
+  const HealthTransition susceptible = {
+      .time = absl::InfiniteFuture(), .health_state = HealthState::SUSCEPTIBLE};
+  SEIRPopulation population(&transmission_model);
+  SEIRPopulation other_population(&transmission_model);
+  for (SEIRPopulation* p : {&population, &other_population}) {
+    p->AddProfile({.transition_model = &transition_model,
+                   .visit_durations = {[](float) { return 1.0f; }}});
+  }
+  for (const int64 uuid : {1, 2, 5}) {
+    population.AddAgent(uuid, susceptible, 0, {100});
+  }
+  other_population.AddAgent(3, susceptible, 0, {100});
+  std::vector<std::unique_ptr<Agent>> members = population.MakeAgents();
+  std::vector<std::unique_ptr<Agent>> agents;
+  agents.push_back(std::move(members[0]));
+  agents.push_back(std::move(members[1]));
+  agents.push_back(std::move(other_population.MakeAgents()[0]));
+  agents.push_back(std::move(members[2]));
+
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  const std::vector<InfectionOutcome> outcomes = {
+      ContactOutcome(1, 5, timestep.start_time()),
+      ContactOutcome(3, 5, timestep.start_time()),
+      ContactOutcome(5, 1, timestep.start_time())};
+  const std::vector<ContactReport> reports = {
+      {.from_agent_uuid = 3, .to_agent_uuid = 2},
+      {.from_agent_uuid = 1, .to_agent_uuid = 5}};
+  absl::Span<const InfectionOutcome> remaining_outcomes = outcomes;
+  absl::Span<const ContactReport> remaining_reports = reports;
+  RecordingBroker<Visit> visits;
+  RecordingBroker<ContactReport> sent_reports;
+  CountingObserver observer;
+  EXPECT_EQ(population.StepAgents(timestep, agents, &remaining_outcomes,
+                                  &remaining_reports, &observer, &visits,
+                                  &sent_reports),
+            2);
+  EXPECT_EQ(remaining_outcomes.size(), 2);
+  EXPECT_EQ(remaining_reports.size(), 1);
+  EXPECT_THAT(observer.observed(), ElementsAreArray({1, 2}));
+  EXPECT_EQ(visits.msgs().size(), 2);
+  EXPECT_EQ(agents[0]->CurrentHealthState(), HealthState::EXPOSED);
+  EXPECT_EQ(agents[1]->CurrentHealthState(), HealthState::SUSCEPTIBLE);
+
+  EXPECT_EQ(other_population.StepAgents(
+                timestep, absl::MakeConstSpan(agents).subspan(2),
+                &remaining_outcomes, &remaining_reports, &observer, &visits,
+                &sent_reports),
+            1);
+  EXPECT_EQ(population.StepAgents(timestep,
+                                  absl::MakeConstSpan(agents).subspan(3),
+                                  &remaining_outcomes, &remaining_reports,
+                                  &observer, &visits, &sent_reports),
+            1);
+  EXPECT_TRUE(remaining_outcomes.empty());
+  EXPECT_TRUE(remaining_reports.empty());
+  EXPECT_TRUE(sent_reports.msgs().empty());
+  EXPECT_EQ(agents[3]->CurrentHealthState(), HealthState::EXPOSED);
+}
+
+// Exposes every visitor to every other infectious visitor of the location.
+class ContactLocation : public Location {
+ public:
+  ContactLocation(const int64 uuid, absl::Mutex* mu, std::vector<Visit>* log)
+      : uuid_(uuid), mu_(mu), log_(log) {}
+
+  int64 uuid() const override { return uuid_; }
+  void ProcessVisits(absl::Span<const Visit> visits,
+                     Broker<InfectionOutcome>* infection_broker) override {
+    {
+      absl::MutexLock l(mu_);
+      log_->insert(log_->end(), visits.begin(), visits.end());
+    }
+    std::vector<InfectionOutcome> outcomes;
+    for (const Visit& visit : visits) {
+      for (const Visit& other : visits) {
+        if (other.agent_uuid == visit.agent_uuid || other.infectivity == 0) {
+          continue;
+        }
+        outcomes.push_back(
+            ContactOutcome(visit.agent_uuid, other.agent_uuid,
+                    std::max(visit.start_time, other.start_time)));
+      }
+    }
+    infection_broker->Send(outcomes);
+  }
+
+ private:
+  const int64 uuid_;
+  absl::Mutex* const mu_;
+  std::vector<Visit>* const log_;
+};
+
+struct SimulationRun {
+  std::vector<Visit> visits;
+  std::vector<std::vector<HealthTransition>> health_transitions;
+};
+
+using SimBuilder = std::function<std::unique_ptr<Simulation>(
+    absl::Time start, std::vector<std::unique_ptr<Agent>>,
+    std::vector<std::unique_ptr<Location>>)>;
+
+constexpr int kNumAgents = 40;
+constexpr int kNumLocations = 5;
+constexpr int kNumSteps = 12;
+
+// Runs a simulation of agents made by make_agents, with stateless visit
+// durations so that sharing them between agents does not change the outcome.
+SimulationRun RunSimulation(
+    const SimBuilder& builder,
+    const std::function<std::vector<std::unique_ptr<Agent>>(
+        const std::vector<std::function<float(float)>>&)>& make_agents) {
+  const std::vector<std::function<float(float)>> durations = {
+      [](float adjustment) { return adjustment * 8.0f; },
+      [](float adjustment) { return adjustment * 16.0f; }};
+  std::vector<std::unique_ptr<Agent>> agents = make_agents(durations);
+  std::vector<const Agent*> agent_ptrs;
+  for (const auto& agent : agents) agent_ptrs.push_back(agent.get());
+
+  absl::Mutex mu;
+  SimulationRun run;
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    locations.push_back(
+        absl::make_unique<ContactLocation>(1000 + i, &mu, &run.visits));
+  }
+  auto sim = builder(absl::UnixEpoch(), std::move(agents),
+                     std::move(locations));
+  sim->Step(kNumSteps, absl::Hours(24));
+  for (const Agent* agent : agent_ptrs) {
+    run.health_transitions.emplace_back(agent->HealthTransitions().begin(),
+                                        agent->HealthTransitions().end());
+  }
+  return run;
+}
+
+HealthTransition InitialTransition(const int64 uuid) {
+  if (uuid == 0) {
+    return {.time = absl::UnixEpoch() + absl::Hours(6),
+            .health_state = HealthState::EXPOSED};
+  }
+  return {.time = absl::InfiniteFuture(),
+          .health_state = HealthState::SUSCEPTIBLE};
+}
+
+std::vector<int64> AgentLocations(const int64 uuid) {
+  return {1000 + uuid % kNumLocations, 1000 + (uuid / 8) % kNumLocations};
+}
+
+void ExpectSimulationsMatch(const SimBuilder& builder) {
+  FixedTransmissionModel transmission_model;
+  FixedTransitionModel transition_model;
+  const SimulationRun expected = RunSimulation(
+      builder, [&transmission_model](const auto& durations) {
+        std::vector<std::unique_ptr<Agent>> agents;
+        for (int64 uuid = 0; uuid < kNumAgents; ++uuid) {
+          agents.push_back(SEIRAgent::Create(
+              uuid, InitialTransition(uuid), &transmission_model,
+              absl::make_unique<FixedTransitionModel>(),
+              absl::make_unique<DurationSpecifiedVisitGenerator>(
+                  ToLocationDurations(AgentLocations(uuid), durations)),
+              NewNullRiskScore()));
+        }
+        return agents;
+      });
+  SEIRPopulation population(&transmission_model);
+  const SimulationRun actual = RunSimulation(
+      builder, [&](const auto& durations) {
+        const int profile = population.AddProfile(
+            {.transition_model = &transition_model,
+             .visit_durations = durations});
+        for (int64 uuid = kNumAgents - 1; uuid >= 0; --uuid) {
+          population.AddAgent(uuid, InitialTransition(uuid), profile,
+                              AgentLocations(uuid));
+        }
+        return population.MakeAgents();
+      });
+
+  auto sort_visits = [](std::vector<Visit> visits) {
+    std::sort(visits.begin(), visits.end(),
+              [](const Visit& a, const Visit& b) {
+                return CompareDestId(a, b);
+              });
+    return visits;
+  };
+  EXPECT_THAT(sort_visits(actual.visits),
+              ElementsAreArray(sort_visits(expected.visits)));
+  ASSERT_EQ(actual.health_transitions.size(), kNumAgents);
+  int infected = 0;
+  for (int i = 0; i < kNumAgents; ++i) {
+    EXPECT_THAT(actual.health_transitions[i],
+                ElementsAreArray(expected.health_transitions[i]))
+        << "agent " << i;
+    if (actual.health_transitions[i].size() > 1) ++infected;
+  }
+  // The epidemic spreads beyond the initially exposed agent.
+  EXPECT_GT(infected, 1);
+}
+
+TEST(SEIRPopulationTest, MatchesSEIRAgentsInSerialSimulation) {
+  ExpectSimulationsMatch([](absl::Time start,
+                            std::vector<std::unique_ptr<Agent>> agents,
+                            std::vector<std::unique_ptr<Location>> locations) {
+    return SerialSimulation(start, std::move(agents), std::move(locations));
+  });
+}
+
+TEST(SEIRPopulationTest, MatchesSEIRAgentsInParallelSimulation) {
+  ExpectSimulationsMatch([](absl::Time start,
+                            std::vector<std::unique_ptr<Agent>> agents,
+                            std::vector<std::unique_ptr<Location>> locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  });
+}
+
+}  // namespace
+}  // namespace abesim
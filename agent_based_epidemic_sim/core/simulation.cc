@@ -15,19 +15,23 @@
 #include "agent_based_epidemic_sim/core/simulation.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
 
-#include "absl/base/thread_annotations.h"
 #include "absl/container/fixed_array.h"
-#include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
-#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/sort_by_dest.h"
+#include "agent_based_epidemic_sim/core/step_pipeline.h"
+#include "agent_based_epidemic_sim/core/step_stats.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/work_queue_broker.h"
 #include "agent_based_epidemic_sim/port/executor.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
@@ -37,126 +41,134 @@ namespace {
 
 const int kWorkChunkSize = 128;
 const int kPerThreadBrokerBuffer = 256;
+// The number of timesteps whose observers may be aggregated in the background
+// while later timesteps run.
+const int kMaxPendingAggregations = 2;
+
+// The relative cost of processing a location that received the given number of
+// visits.  Locations generate contacts between pairs of visitors, so the cost
+// grows quadratically with occupancy.
+double EstimatedLocationCost(const int64 visits) {
+  return 1.0 + visits + static_cast<double>(visits) * visits;
+}
 
 auto CompareUuid = [](const auto& a, const auto& b) {
   return a->uuid() < b->uuid();
 };
 
-int GetDestId(const Visit& visit) { return visit.location_uuid; }
-int GetDestId(const InfectionOutcome& outcome) { return outcome.agent_uuid; }
-int GetDestId(const ContactReport& report) { return report.to_agent_uuid; }
-
-bool CompareDestId(const Visit& a, const Visit& b) {
-  if (a.location_uuid != b.location_uuid) {
-    return a.location_uuid < b.location_uuid;
-  }
-  if (a.start_time != b.start_time) {
-    return a.start_time < b.start_time;
-  }
-  return a.agent_uuid < b.agent_uuid;
-}
-bool CompareDestId(const InfectionOutcome& a, const InfectionOutcome& b) {
-  if (a.agent_uuid != b.agent_uuid) {
-    return a.agent_uuid < b.agent_uuid;
-  }
-  return a.exposure.start_time < b.exposure.start_time;
-}
-bool CompareDestId(const ContactReport& a, const ContactReport& b) {
-  if (a.to_agent_uuid != b.to_agent_uuid) {
-    return a.to_agent_uuid < b.to_agent_uuid;
-  }
-  return a.from_agent_uuid < b.from_agent_uuid;
-}
-
-template <typename Msg>
-void SortByDest(absl::Span<Msg> msgs) {
-  std::sort(msgs.begin(), msgs.end(),
-            [](const Msg& a, const Msg& b) { return CompareDestId(a, b); });
-}
-
-template <typename Msg>
-std::pair<absl::Span<const Msg>, absl::Span<Msg>> SplitMessages(
-    int64 uuid, absl::Span<Msg> messages) {
-  DCHECK(messages.empty() || GetDestId(messages[0]) >= uuid)
-      << "Message found for non-local entity.";
-  int idx = 0;
-  for (; idx < messages.size() && GetDestId(messages[idx]) == uuid; ++idx) {
-  }
-  return {messages.subspan(0, idx), messages.subspan(idx)};
-}
-
 class BaseSimulation : public Simulation {
  public:
   BaseSimulation(absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
                  std::vector<std::unique_ptr<Location>> locations)
       : time_(start),
         agents_(std::move(agents)),
-        locations_(std::move(locations)) {
+        locations_(std::move(locations)),
+        observer_manager_(kMaxPendingAggregations) {
     std::sort(agents_.begin(), agents_.end(), CompareUuid);
     std::sort(locations_.begin(), locations_.end(), CompareUuid);
   }
 
   void Step(const int steps, absl::Duration step_duration) final {
     Timestep timestep(time_, step_duration);
-    for (int step = 0; step < steps; ++step) {
-      RunAgentPhase(
-          timestep,
-          [&timestep](const absl::Span<const std::unique_ptr<Agent>> agents,
-                      absl::Span<InfectionOutcome> outcomes,
-                      absl::Span<ContactReport> reports,
-                      ObserverShard* const observer,
-                      Broker<Visit>* const visit_broker,
-                      Broker<ContactReport>* const contact_report_broker) {
-            SortByDest(outcomes);
-            SortByDest(reports);
-            for (const auto& agent : agents) {
-              absl::Span<const InfectionOutcome> agent_outcomes;
-              std::tie(agent_outcomes, outcomes) =
-                  SplitMessages(agent->uuid(), outcomes);
-              absl::Span<const ContactReport> agent_reports;
-              std::tie(agent_reports, reports) =
-                  SplitMessages(agent->uuid(), reports);
-              observer->Observe(*agent, agent_outcomes);
-              agent->ProcessInfectionOutcomes(timestep, agent_outcomes);
-              agent->UpdateContactReports(timestep, agent_reports,
-                                          contact_report_broker);
-              agent->ComputeVisits(timestep, visit_broker);
+    const AgentPhaseFn agent_fn =
+        [&timestep](const absl::Span<const std::unique_ptr<Agent>> agents,
+                    absl::Span<InfectionOutcome> outcomes,
+                    absl::Span<ContactReport> reports,
+                    ObserverShard* const observer,
+                    Broker<Visit>* const visit_broker,
+                    Broker<ContactReport>* const contact_report_broker,
+                    WorkerStats* const worker_stats) {
+          absl::Span<const InfectionOutcome> remaining_outcomes = outcomes;
+          absl::Span<const ContactReport> remaining_reports = reports;
+          for (int i = 0; i < agents.size();) {
+            Agent& agent = *agents[i];
+            if (AgentGroup* const group = agent.group(); group != nullptr) {
+              i += group->StepAgents(timestep, agents.subspan(i),
+                                     &remaining_outcomes, &remaining_reports,
+                                     observer, visit_broker,
+                                     contact_report_broker);
+              continue;
             }
-            DCHECK(outcomes.empty()) << "Unprocessed InfectionOutcomes";
-            DCHECK(reports.empty()) << "Unprocessed ContactReports";
-          });
-      RunLocationPhase(
-          timestep,
-          [](const absl::Span<const std::unique_ptr<Location>> locations,
-             absl::Span<Visit> visits, ObserverShard* const observer,
-             Broker<InfectionOutcome>* const broker) {
-            SortByDest(visits);
-            for (const auto& location : locations) {
-              absl::Span<const Visit> location_visits;
-              std::tie(location_visits, visits) =
-                  SplitMessages(location->uuid(), visits);
-              observer->Observe(*location, location_visits);
-              location->ProcessVisits(location_visits, broker);
+            absl::Span<const InfectionOutcome> agent_outcomes;
+            std::tie(agent_outcomes, remaining_outcomes) =
+                SplitMessages(agent.uuid(), remaining_outcomes);
+            absl::Span<const ContactReport> agent_reports;
+            std::tie(agent_reports, remaining_reports) =
+                SplitMessages(agent.uuid(), remaining_reports);
+            observer->Observe(agent, agent_outcomes);
+            if (!agent_outcomes.empty() || !agent_reports.empty() ||
+                !agent.IsQuiescent(timestep)) {
+              agent.ProcessInfectionOutcomes(timestep, agent_outcomes);
+              agent.UpdateContactReports(timestep, agent_reports,
+                                         contact_report_broker);
             }
-          });
-      observer_manager_.AggregateForTimestep(timestep);
+            agent.ComputeVisits(timestep, visit_broker);
+            ++i;
+          }
+          DCHECK(remaining_outcomes.empty()) << "Unprocessed InfectionOutcomes";
+          DCHECK(remaining_reports.empty()) << "Unprocessed ContactReports";
+        };
+    const LocationPhaseFn location_fn =
+        [](const absl::Span<const std::unique_ptr<Location>> locations,
+           absl::Span<Visit> visits, ObserverShard* const observer,
+           Broker<InfectionOutcome>* const broker,
+           WorkerStats* const worker_stats) {
+          for (const auto& location : locations) {
+            absl::Span<const Visit> location_visits;
+            std::tie(location_visits, visits) =
+                SplitMessages(location->uuid(), visits);
+            observer->Observe(*location, location_visits);
+            location->ProcessVisits(location_visits, broker);
+          }
+        };
+    for (int step = 0; step < steps; ++step) {
+      StepStats& stats = step_stats_.emplace_back();
+      stats.time = timestep.start_time();
+      RunPhases(timestep, agent_fn, location_fn, stats);
+      {
+        ScopedTimer timer(&stats.observer_aggregation);
+        observer_manager_.AggregateForTimestep(timestep);
+        // Observers may inspect their results once Step returns.
+        if (step == steps - 1) observer_manager_.AwaitAggregation();
+      }
+      stats.SumWorkers();
+      if (step_stats_writer_ != nullptr) step_stats_writer_->Write(stats);
       timestep.Advance();
     }
     time_ = timestep.start_time();
   }
 
+  // Phase functions process a chunk of entities and the messages sent to them,
+  // sorted by destination.  They record their timings in the WorkerStats of
+  // the calling worker.
   using AgentPhaseFn = std::function<void(
       absl::Span<const std::unique_ptr<Agent>>, absl::Span<InfectionOutcome>,
       absl::Span<ContactReport>, ObserverShard* observer, Broker<Visit>*,
-      Broker<ContactReport>*)>;
+      Broker<ContactReport>*, WorkerStats*)>;
   using LocationPhaseFn = std::function<void(
       absl::Span<const std::unique_ptr<Location>>, absl::Span<Visit>,
-      ObserverShard*, Broker<InfectionOutcome>*)>;
+      ObserverShard*, Broker<InfectionOutcome>*, WorkerStats*)>;
+
+  // Runs the agent phase and then the location phase of a step, recording
+  // their durations in stats.  Simulations may override this to overlap the
+  // phases.
+  virtual void RunPhases(const Timestep& timestep, const AgentPhaseFn& agent_fn,
+                         const LocationPhaseFn& location_fn,
+                         StepStats& stats) {
+    absl::Time phase_start = absl::Now();
+    RunAgentPhase(timestep, agent_fn, stats);
+    stats.agent_phase = absl::Now() - phase_start;
+    phase_start = absl::Now();
+    RunLocationPhase(timestep, location_fn, stats);
+    stats.location_phase = absl::Now() - phase_start;
+  }
 
-  virtual void RunAgentPhase(const Timestep& timestep,
-                             const AgentPhaseFn& fn) = 0;
+  // Runs a phase, recording its broker, flush and per worker stats in stats.
+  virtual void RunAgentPhase(const Timestep& timestep, const AgentPhaseFn& fn,
+                             StepStats& stats) = 0;
   virtual void RunLocationPhase(const Timestep& timestep,
-                                const LocationPhaseFn& fn) = 0;
+                                const LocationPhaseFn& fn,
+                                StepStats& stats) = 0;
 
   void AddObserverFactory(ObserverFactoryBase* factory) override {
     observer_manager_.AddFactory(factory);
@@ -166,6 +178,14 @@ class BaseSimulation : public Simulation {
     observer_manager_.RemoveFactory(factory);
   }
 
+  absl::Span<const StepStats> GetStepStats() const override {
+    return step_stats_;
+  }
+
+  void SetStepStatsWriter(StepStatsWriter* const writer) override {
+    step_stats_writer_ = writer;
+  }
+
  protected:
   ObserverManager& GetObserverManager() { return observer_manager_; }
   absl::Span<const std::unique_ptr<Agent>> agents() { return agents_; }
@@ -176,6 +196,8 @@ class BaseSimulation : public Simulation {
   std::vector<std::unique_ptr<Agent>> agents_;
   std::vector<std::unique_ptr<Location>> locations_;
   class ObserverManager observer_manager_;
+  std::vector<StepStats> step_stats_;
+  StepStatsWriter* step_stats_writer_ = nullptr;
 };
 
 // A ConsumableBroker accumulates messages which can be consumed via the
@@ -220,19 +242,44 @@ class Serial : public BaseSimulation {
          std::vector<std::unique_ptr<Location>> locations)
       : BaseSimulation(start, std::move(agents), std::move(locations)) {}
 
-  void RunAgentPhase(const Timestep& timestep,
-                     const AgentPhaseFn& fn) override {
+  void RunAgentPhase(const Timestep& timestep, const AgentPhaseFn& fn,
+                     StepStats& stats) override {
+    stats.workers.resize(1);
+    WorkerStats& worker = stats.workers[0];
+    ScopedTimer timer(&worker.busy);
+    absl::Time consume_start = absl::Now();
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    worker.broker_consume += absl::Now() - consume_start;
+    {
+      ScopedTimer sort_timer(&worker.sort);
+      RadixSortByDest(absl::MakeSpan(*outcomes));
+      RadixSortByDest(absl::MakeSpan(*reports));
+    }
+    TimedBroker<Visit> visit_broker(&visit_broker_, &worker.broker_send,
+                                    &worker.visits);
+    TimedBroker<ContactReport> report_broker(
+        &report_broker_, &worker.broker_send, &worker.contact_reports);
     fn(agents(), absl::MakeSpan(*outcomes), absl::MakeSpan(*reports),
-       GetObserverManager().MakeShard(timestep), &visit_broker_,
-       &report_broker_);
+       GetObserverManager().MakeShard(timestep), &visit_broker, &report_broker,
+       &worker);
   }
-  void RunLocationPhase(const Timestep& timestep,
-                        const LocationPhaseFn& fn) override {
+  void RunLocationPhase(const Timestep& timestep, const LocationPhaseFn& fn,
+                        StepStats& stats) override {
+    stats.workers.resize(1);
+    WorkerStats& worker = stats.workers[0];
+    ScopedTimer timer(&worker.busy);
+    absl::Time consume_start = absl::Now();
     auto visits = visit_broker_.Consume();
+    worker.broker_consume += absl::Now() - consume_start;
+    {
+      ScopedTimer sort_timer(&worker.sort);
+      RadixSortByDest(absl::MakeSpan(*visits));
+    }
+    TimedBroker<InfectionOutcome> outcome_broker(
+        &outcome_broker_, &worker.broker_send, &worker.infection_outcomes);
     fn(locations(), absl::MakeSpan(*visits),
-       GetObserverManager().MakeShard(timestep), &outcome_broker_);
+       GetObserverManager().MakeShard(timestep), &outcome_broker, &worker);
   }
 
  private:
@@ -241,235 +288,326 @@ class Serial : public BaseSimulation {
   ConsumableBroker<ContactReport> report_broker_;
 };
 
-// The Chunker helps divide a list of entities, and messages destined for those
-// entities, into chunks of work.  Basically the first KWorkChunkSize entities
-// and messages targeted at them goin in the first chunk and so on.
-template <typename Entity>
-class Chunker {
- public:
-  explicit Chunker(const absl::Span<const std::unique_ptr<Entity>> entities)
-      : chunks_((entities.size() + kWorkChunkSize - 1) / kWorkChunkSize) {
-    size_t idx = 0;
-    for (int chunk = 0; chunk < chunks_.size(); ++chunk) {
-      chunks_[chunk] = entities.subspan(idx, kWorkChunkSize);
-      int end = idx + chunks_[chunk].size();
-      for (; idx < end; ++idx) {
-        chunk_map_[entities[idx]->uuid()] = chunk;
-      }
-    }
+// Adds the time each worker spent busy during a phase of the given duration,
+// and the remainder of the phase as idle time, to stats.
+void RecordBusyAndIdle(const absl::Duration phase,
+                       const absl::Span<const absl::Duration> busy,
+                       StepStats& stats) {
+  for (int w = 0; w < busy.size(); ++w) {
+    stats.workers[w].busy += busy[w];
+    stats.workers[w].idle += std::max(phase - busy[w], absl::ZeroDuration());
   }
-
-  template <typename Msg>
-  int Chunk(const Msg& msg) const {
-    auto iter = chunk_map_.find(GetDestId(msg));
-    DCHECK(iter != chunk_map_.end());
-    return iter->second;
-  }
-  absl::Span<const absl::Span<const std::unique_ptr<Entity>>> Chunks() const {
-    return chunks_;
-  }
-
- private:
-  absl::FixedArray<absl::Span<const std::unique_ptr<Entity>>> chunks_;
-  absl::flat_hash_map<int64, int> chunk_map_;
-};
-
-// WorkQueueBroker is the thread-safe analog to ConsumableBroker.  It can
-// receive Send calls from any thread.
-template <typename Entity, typename Msg>
-class WorkQueueBroker : public Broker<Msg> {
- private:
-  struct Deleter {
-    void operator()(std::vector<std::vector<Msg>>* const msgs) {
-      broker->Delete(msgs);
-    }
-    WorkQueueBroker* const broker;
-  };
-  virtual void Delete(std::vector<std::vector<Msg>>* const msgs) {
-    absl::MutexLock l(&mu_);
-    DCHECK_EQ(msgs, &consume_);
-    std::for_each(consume_.begin(), consume_.end(), [](auto& v) { v.clear(); });
-    // We are using swapping buffers so we're always reading from one
-    // buffer and writing to another one.  For most of our message types
-    // we don't read and write at the same time.  In that case we swap back
-    // to using the buffer we consumed for the next round of sends to avoid
-    // allocating any memory in the alternate buffer.  Otherwise we'll swap
-    // back at the next call to Consume.
-    if (!sent_msgs_) send_.swap(consume_);
-  }
-
- public:
-  explicit WorkQueueBroker(const Chunker<Entity>& chunker)
-      : chunker_(chunker),
-        send_(chunker.Chunks().size()),
-        consume_(chunker.Chunks().size()) {}
-  void Send(const absl::Span<const Msg> msgs) override {
-    absl::MutexLock l(&mu_);
-    for (const Msg& msg : msgs) {
-      send_[chunker_.Chunk(msg)].push_back(msg);
-    }
-    sent_msgs_ = true;
-  }
-  virtual std::unique_ptr<std::vector<std::vector<Msg>>, Deleter> Consume() {
-    absl::MutexLock l(&mu_);
-    DCHECK(std::all_of(consume_.begin(), consume_.end(),
-                       [](const std::vector<Msg>& v) { return v.empty(); }));
-    sent_msgs_ = false;
-    consume_.swap(send_);
-    return {&consume_, {this}};
-  }
-
- private:
-  const Chunker<Entity>& chunker_;
-  absl::Mutex mu_;
-  bool sent_msgs_ = false;
-  std::vector<std::vector<Msg>> send_ ABSL_GUARDED_BY(mu_);
-  std::vector<std::vector<Msg>> consume_ ABSL_GUARDED_BY(mu_);
-};
+}
 
 template <typename Worker>
 void ParallelAgentPhase(const Timestep& timestep, Executor& executor,
                         ObserverManager& observer_manager,
                         const Chunker<Agent>& chunker,
-                        std::vector<std::vector<InfectionOutcome>>& outcomes,
-                        std::vector<std::vector<ContactReport>>& reports,
+                        ChunkedMessages<InfectionOutcome>& outcomes,
+                        ChunkedMessages<ContactReport>& reports,
                         absl::FixedArray<Worker>& workers,
-                        const BaseSimulation::AgentPhaseFn& fn) {
-  absl::Mutex mu;
-  int next_chunk = 0;
+                        const BaseSimulation::AgentPhaseFn& fn,
+                        StepStats& stats) {
+  // Workers claim chunks in order until none are left.
+  std::atomic<int> next_chunk = 0;
 
   absl::FixedArray<ObserverShard*> observers(workers.size());
   for (int i = 0; i < workers.size(); ++i) {
     observers[i] = observer_manager.MakeShard(timestep);
   }
 
-  DCHECK_EQ(outcomes.size(), chunker.Chunks().size());
-  DCHECK_EQ(reports.size(), chunker.Chunks().size());
-
+  stats.workers.resize(workers.size());
+  absl::FixedArray<absl::Duration> busy(workers.size(), absl::ZeroDuration());
+  const absl::Time start = absl::Now();
   std::unique_ptr<Execution> exec = executor.NewExecution();
   for (int w = 0; w < workers.size(); ++w) {
-    exec->Add([w, &workers, &outcomes, &reports, &chunker, &next_chunk, &mu,
-               &observers, &fn]() {
+    exec->Add([w, &workers, &outcomes, &reports, &chunker, &next_chunk,
+               &observers, &fn, &stats, &busy]() {
+      ScopedTimer timer(&busy[w]);
       auto& worker = workers[w];
+      WorkerStats& worker_stats = stats.workers[w];
+      TimedBroker<Visit> visit_broker(worker.visit_broker.get(),
+                                      &worker_stats.broker_send,
+                                      &worker_stats.visits);
+      TimedBroker<ContactReport> report_broker(worker.report_broker.get(),
+                                               &worker_stats.broker_send,
+                                               &worker_stats.contact_reports);
       while (true) {
-        absl::Span<InfectionOutcome> my_outcomes;
-        absl::Span<ContactReport> my_reports;
-        absl::Span<const std::unique_ptr<Agent>> my_agents;
+        const int chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= chunker.Chunks().size()) break;
+        absl::Span<InfectionOutcome> chunk_outcomes;
+        absl::Span<ContactReport> chunk_reports;
         {
-          absl::MutexLock l(&mu);
-          int chunk = next_chunk++;
-          if (chunk >= chunker.Chunks().size()) break;
-          my_agents = chunker.Chunks()[chunk];
-          my_outcomes = absl::MakeSpan(outcomes[chunk]);
-          my_reports = absl::MakeSpan(reports[chunk]);
+          ScopedTimer sort_timer(&worker_stats.sort);
+          chunk_outcomes = outcomes.Chunk(chunk);
+          chunk_reports = reports.Chunk(chunk);
         }
-        fn(my_agents, my_outcomes, my_reports, observers[w],
-           worker.visit_broker.get(), worker.report_broker.get());
+        fn(chunker.Chunks()[chunk], chunk_outcomes, chunk_reports,
+           observers[w], &visit_broker, &report_broker, &worker_stats);
       }
+      ScopedTimer flush_timer(&worker_stats.broker_send);
       worker.visit_broker->Flush();
       worker.report_broker->Flush();
     });
   }
   exec->Wait();
+  RecordBusyAndIdle(absl::Now() - start, busy, stats);
 }
 
 template <typename Worker>
 void ParallelLocationPhase(const Timestep& timestep, Executor& executor,
                            ObserverManager& observer_manager,
-                           const Chunker<Location>& chunker,
-                           std::vector<std::vector<Visit>>& visits,
+                           Chunker<Location>& chunker,
+                           ChunkedMessages<Visit>& visits,
                            absl::FixedArray<Worker>& workers,
-                           const BaseSimulation::LocationPhaseFn& fn) {
-  absl::Mutex mu;
-  int next_chunk = 0;
+                           const BaseSimulation::LocationPhaseFn& fn,
+                           StepStats& stats) {
+  // Workers claim chunks in order until none are left.
+  std::atomic<int> next_chunk = 0;
 
   absl::FixedArray<ObserverShard*> observers(workers.size());
   for (int i = 0; i < workers.size(); ++i) {
     observers[i] = observer_manager.MakeShard(timestep);
   }
 
+  stats.workers.resize(workers.size());
+  absl::FixedArray<absl::Duration> busy(workers.size(), absl::ZeroDuration());
+  const absl::Time start = absl::Now();
   std::unique_ptr<Execution> exec = executor.NewExecution();
   for (int w = 0; w < workers.size(); ++w) {
     auto& worker = workers[w];
-    exec->Add([w, &worker, &visits, &chunker, &next_chunk, &mu, &observers,
-               &fn]() {
+    exec->Add([w, &worker, &visits, &chunker, &next_chunk, &observers, &fn,
+               &stats, &busy]() {
+      ScopedTimer timer(&busy[w]);
+      WorkerStats& worker_stats = stats.workers[w];
+      TimedBroker<InfectionOutcome> outcome_broker(
+          worker.outcome_broker.get(), &worker_stats.broker_send,
+          &worker_stats.infection_outcomes);
       while (true) {
-        absl::Span<Visit> my_visits;
-        absl::Span<const std::unique_ptr<Location>> my_locations;
+        const int chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= chunker.Chunks().size()) break;
+        absl::Span<Visit> chunk_visits;
         {
-          absl::MutexLock l(&mu);
-          int chunk = next_chunk++;
-          if (chunk >= chunker.Chunks().size()) break;
-          my_locations = chunker.Chunks()[chunk];
-          my_visits = absl::MakeSpan(visits[chunk]);
+          ScopedTimer sort_timer(&worker_stats.sort);
+          chunk_visits = visits.Chunk(chunk);
         }
-        fn(my_locations, my_visits, observers[w], worker.outcome_broker.get());
+        chunker.RecordLoad<Visit>(chunk_visits);
+        fn(chunker.Chunks()[chunk], chunk_visits, observers[w],
+           &outcome_broker, &worker_stats);
       }
+      ScopedTimer flush_timer(&worker_stats.broker_send);
       worker.outcome_broker->Flush();
     });
   }
   exec->Wait();
+  RecordBusyAndIdle(absl::Now() - start, busy, stats);
+}
+
+// Returns the dense location indices that agents in each agent chunk may visit,
+// or nullopt for chunks with agents that cannot bound their visits.
+std::vector<absl::optional<std::vector<int>>> PossibleLocationsByChunk(
+    const Chunker<Agent>& agent_chunker,
+    const Chunker<Location>& location_chunker) {
+  std::vector<absl::optional<std::vector<int>>> chunk_locations;
+  std::vector<int64> location_uuids;
+  for (const auto& agents : agent_chunker.Chunks()) {
+    location_uuids.clear();
+    const bool bounded = std::all_of(
+        agents.begin(), agents.end(), [&location_uuids](const auto& agent) {
+          return agent->GetPossibleLocations(&location_uuids);
+        });
+    if (!bounded) {
+      chunk_locations.emplace_back();
+      continue;
+    }
+    std::vector<int>& locations = chunk_locations.emplace_back().emplace();
+    for (const int64 uuid : location_uuids) {
+      const int location = location_chunker.Index(uuid);
+      // Visits to unknown locations are rejected when they are sent.
+      if (location >= 0) locations.push_back(location);
+    }
+    std::sort(locations.begin(), locations.end());
+    locations.erase(std::unique(locations.begin(), locations.end()),
+                    locations.end());
+  }
+  return chunk_locations;
 }
 
-// Parallel implements a simulation that runs in multiple threads.
+// Parallel implements a simulation that runs in multiple threads, optionally
+// overlapping the agent and location phases of each step.
 class Parallel : public BaseSimulation {
  public:
   Parallel(absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
            std::vector<std::unique_ptr<Location>> locations,
-           const int num_workers)
+           const int num_workers, const bool pipelined)
       : BaseSimulation(start, std::move(agents), std::move(locations)),
-        executor_(NewExecutor(num_workers)),
-        agent_chunker_(BaseSimulation::agents()),
-        location_chunker_(BaseSimulation::locations()),
-        agent_workers_(num_workers),
-        location_workers_(num_workers),
+        executor_(NewWorkStealingExecutor(num_workers)),
+        agent_chunker_(BaseSimulation::agents(), kWorkChunkSize),
+        location_chunker_(BaseSimulation::locations(), kWorkChunkSize),
         outcome_broker_(agent_chunker_),
         report_broker_(agent_chunker_),
-        visit_broker_(location_chunker_) {
+        visit_broker_(location_chunker_),
+        agent_workers_(num_workers),
+        location_workers_(num_workers) {
     for (int w = 0; w < num_workers; ++w) {
-      agent_workers_[w].visit_broker =
-          absl::make_unique<BufferingBroker<Visit>>(kPerThreadBrokerBuffer,
-                                                    &visit_broker_);
-      agent_workers_[w].report_broker =
-          absl::make_unique<BufferingBroker<ContactReport>>(
-              kPerThreadBrokerBuffer, &report_broker_);
-      location_workers_[w].outcome_broker =
-          absl::make_unique<BufferingBroker<InfectionOutcome>>(
-              kPerThreadBrokerBuffer, &outcome_broker_);
+      agent_workers_[w].visit_broker = visit_broker_.NewOutbox();
+      agent_workers_[w].report_broker = report_broker_.NewOutbox();
+      location_workers_[w].outcome_broker = outcome_broker_.NewOutbox();
+    }
+    if (pipelined) {
+      pipeline_ = absl::make_unique<StepPipeline>(
+          PossibleLocationsByChunk(agent_chunker_, location_chunker_),
+          location_chunker_.Chunks().size());
     }
   }
 
-  void RunAgentPhase(const Timestep& timestep,
-                     const AgentPhaseFn& fn) override {
+  void RunPhases(const Timestep& timestep, const AgentPhaseFn& agent_fn,
+                 const LocationPhaseFn& location_fn,
+                 StepStats& stats) override {
+    if (pipeline_ == nullptr) {
+      BaseSimulation::RunPhases(timestep, agent_fn, location_fn, stats);
+      return;
+    }
+    {
+      absl::Time consume_start = absl::Now();
+      auto outcomes = outcome_broker_.Consume();
+      auto reports = report_broker_.Consume();
+      stats.broker_consume += absl::Now() - consume_start;
+      RunPipelinedPhases(timestep, *outcomes, *reports, agent_fn, location_fn,
+                         stats);
+    }
+    DCHECK_EQ(visit_broker_.PendingMessages(), 0)
+        << "Visits sent to locations their agents did not declare.";
+    location_chunker_.Rebalance(EstimatedLocationCost);
+  }
+
+  void RunAgentPhase(const Timestep& timestep, const AgentPhaseFn& fn,
+                     StepStats& stats) override {
+    absl::Time consume_start = absl::Now();
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    stats.broker_consume += absl::Now() - consume_start;
     ParallelAgentPhase(timestep, *executor_, GetObserverManager(),
-                       agent_chunker_, *outcomes, *reports, agent_workers_, fn);
+                       agent_chunker_, *outcomes, *reports, agent_workers_, fn,
+                       stats);
   }
-  void RunLocationPhase(const Timestep& timestep,
-                        const LocationPhaseFn& fn) override {
-    auto visits = visit_broker_.Consume();
-    ParallelLocationPhase(timestep, *executor_, GetObserverManager(),
-                          location_chunker_, *visits, location_workers_, fn);
+  void RunLocationPhase(const Timestep& timestep, const LocationPhaseFn& fn,
+                        StepStats& stats) override {
+    {
+      absl::Time consume_start = absl::Now();
+      auto visits = visit_broker_.Consume();
+      stats.broker_consume += absl::Now() - consume_start;
+      ParallelLocationPhase(timestep, *executor_, GetObserverManager(),
+                            location_chunker_, *visits, location_workers_, fn,
+                            stats);
+    }
+    // No visits are in flight until the next agent phase.
+    location_chunker_.Rebalance(EstimatedLocationCost);
   }
 
  private:
   struct AgentWorker {
-    std::unique_ptr<BufferingBroker<Visit>> visit_broker;
-    std::unique_ptr<BufferingBroker<ContactReport>> report_broker;
+    std::unique_ptr<WorkQueueBroker<Location, Visit>::Outbox> visit_broker;
+    std::unique_ptr<WorkQueueBroker<Agent, ContactReport>::Outbox>
+        report_broker;
   };
   struct LocationWorker {
-    std::unique_ptr<BufferingBroker<InfectionOutcome>> outcome_broker;
+    std::unique_ptr<WorkQueueBroker<Agent, InfectionOutcome>::Outbox>
+        outcome_broker;
   };
 
+  // Runs both phases of a step in a single execution, with each worker taking
+  // agent and location chunks from the pipeline until none are left.
+  void RunPipelinedPhases(const Timestep& timestep,
+                          ChunkedMessages<InfectionOutcome>& outcomes,
+                          ChunkedMessages<ContactReport>& reports,
+                          const AgentPhaseFn& agent_fn,
+                          const LocationPhaseFn& location_fn,
+                          StepStats& stats) {
+    const int num_workers = agent_workers_.size();
+    absl::FixedArray<ObserverShard*> observers(num_workers);
+    for (int i = 0; i < num_workers; ++i) {
+      observers[i] = GetObserverManager().MakeShard(timestep);
+    }
+
+    pipeline_->Start(location_chunker_.EntityChunks());
+    stats.workers.resize(num_workers);
+    absl::FixedArray<absl::Duration> busy(num_workers, absl::ZeroDuration());
+    const absl::Time start = absl::Now();
+    std::unique_ptr<Execution> exec = executor_->NewExecution();
+    for (int w = 0; w < num_workers; ++w) {
+      exec->Add([this, w, start, &outcomes, &reports, &observers, &agent_fn,
+                 &location_fn, &stats, &busy]() {
+        AgentWorker& agent_worker = agent_workers_[w];
+        LocationWorker& location_worker = location_workers_[w];
+        WorkerStats& worker_stats = stats.workers[w];
+        TimedBroker<Visit> visit_broker(agent_worker.visit_broker.get(),
+                                        &worker_stats.broker_send,
+                                        &worker_stats.visits);
+        TimedBroker<ContactReport> report_broker(
+            agent_worker.report_broker.get(), &worker_stats.broker_send,
+            &worker_stats.contact_reports);
+        TimedBroker<InfectionOutcome> outcome_broker(
+            location_worker.outcome_broker.get(), &worker_stats.broker_send,
+            &worker_stats.infection_outcomes);
+        while (true) {
+          const StepPipeline::Task task = pipeline_->Next();
+          if (task.kind == StepPipeline::Task::kDone) break;
+          ScopedTimer timer(&busy[w]);
+          if (task.kind == StepPipeline::Task::kAgents) {
+            absl::Span<InfectionOutcome> chunk_outcomes;
+            absl::Span<ContactReport> chunk_reports;
+            {
+              ScopedTimer sort_timer(&worker_stats.sort);
+              chunk_outcomes = outcomes.Chunk(task.chunk);
+              chunk_reports = reports.Chunk(task.chunk);
+            }
+            agent_fn(agent_chunker_.Chunks()[task.chunk], chunk_outcomes,
+                     chunk_reports, observers[w], &visit_broker,
+                     &report_broker, &worker_stats);
+            {
+              ScopedTimer flush_timer(&worker_stats.broker_send);
+              agent_worker.visit_broker->Flush();
+            }
+            if (pipeline_->FinishAgents(task.chunk)) {
+              stats.agent_phase = absl::Now() - start;
+            }
+          } else {
+            std::unique_ptr<std::vector<Visit>,
+                            WorkQueueBroker<Location, Visit>::ChunkDeleter>
+                visits;
+            {
+              ScopedTimer sort_timer(&worker_stats.sort);
+              visits = visit_broker_.ConsumeChunk(task.chunk);
+            }
+            location_chunker_.RecordLoad<Visit>(*visits);
+            location_fn(location_chunker_.Chunks()[task.chunk],
+                        absl::MakeSpan(*visits), observers[w], &outcome_broker,
+                        &worker_stats);
+          }
+        }
+        ScopedTimer flush_timer(&worker_stats.broker_send);
+        agent_worker.report_broker->Flush();
+        location_worker.outcome_broker->Flush();
+      });
+    }
+    exec->Wait();
+    const absl::Duration elapsed = absl::Now() - start;
+    RecordBusyAndIdle(elapsed, busy, stats);
+    stats.location_phase = elapsed - stats.agent_phase;
+  }
+
   std::unique_ptr<Executor> executor_;
   Chunker<Agent> agent_chunker_;
   Chunker<Location> location_chunker_;
-  absl::FixedArray<AgentWorker> agent_workers_;
-  absl::FixedArray<LocationWorker> location_workers_;
   WorkQueueBroker<Agent, InfectionOutcome> outcome_broker_;
   WorkQueueBroker<Agent, ContactReport> report_broker_;
   WorkQueueBroker<Location, Visit> visit_broker_;
+  // Workers hold outboxes of the brokers above, so must be destroyed first.
+  absl::FixedArray<AgentWorker> agent_workers_;
+  absl::FixedArray<LocationWorker> location_workers_;
+  // Only set for pipelined simulations.
+  std::unique_ptr<StepPipeline> pipeline_;
 };
 
 // DistributedParallel implements a simulation that runs in multiple threads and
@@ -482,28 +620,33 @@ class DistributedParallel : public BaseSimulation {
                       const int num_workers,
                       DistributedManager* const distributed_manager)
       : BaseSimulation(start, std::move(agents), std::move(locations)),
-        executor_(NewExecutor(num_workers)),
-        agent_chunker_(BaseSimulation::agents()),
-        location_chunker_(BaseSimulation::locations()),
-        agent_workers_(num_workers),
-        location_workers_(num_workers),
+        executor_(NewWorkStealingExecutor(num_workers)),
+        agent_chunker_(BaseSimulation::agents(), kWorkChunkSize),
+        location_chunker_(BaseSimulation::locations(), kWorkChunkSize),
         outcome_broker_(agent_chunker_),
         report_broker_(agent_chunker_),
         visit_broker_(location_chunker_),
+        agent_workers_(num_workers),
+        location_workers_(num_workers),
         distributed_manager_(distributed_manager) {
     for (int w = 0; w < num_workers; ++w) {
-      agent_workers_[w].visit_broker =
-          absl::make_unique<DistributingBroker<Visit>>(
-              kPerThreadBrokerBuffer, distributed_manager->VisitMessenger(),
-              &visit_broker_);
-      agent_workers_[w].report_broker =
+      AgentWorker& agent_worker = agent_workers_[w];
+      agent_worker.visit_outbox = visit_broker_.NewOutbox();
+      agent_worker.visit_broker = absl::make_unique<DistributingBroker<Visit>>(
+          kPerThreadBrokerBuffer, distributed_manager->VisitMessenger(),
+          agent_worker.visit_outbox.get());
+      agent_worker.report_outbox = report_broker_.NewOutbox();
+      agent_worker.report_broker =
           absl::make_unique<DistributingBroker<ContactReport>>(
               kPerThreadBrokerBuffer,
-              distributed_manager->ContactReportMessenger(), &report_broker_);
-      location_workers_[w].outcome_broker =
+              distributed_manager->ContactReportMessenger(),
+              agent_worker.report_outbox.get());
+      LocationWorker& location_worker = location_workers_[w];
+      location_worker.outcome_outbox = outcome_broker_.NewOutbox();
+      location_worker.outcome_broker =
           absl::make_unique<DistributingBroker<InfectionOutcome>>(
               kPerThreadBrokerBuffer, distributed_manager->OutcomeMessenger(),
-              &outcome_broker_);
+              location_worker.outcome_outbox.get());
     }
   }
 
@@ -516,10 +659,12 @@ class DistributedParallel : public BaseSimulation {
         nullptr);
   }
 
-  void RunAgentPhase(const Timestep& timestep,
-                     const AgentPhaseFn& fn) override {
+  void RunAgentPhase(const Timestep& timestep, const AgentPhaseFn& fn,
+                     StepStats& stats) override {
+    absl::Time consume_start = absl::Now();
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    stats.broker_consume += absl::Now() - consume_start;
 
     distributed_manager_->VisitMessenger()->SetReceiveBrokerForNextPhase(
         &visit_broker_);
@@ -527,40 +672,57 @@ class DistributedParallel : public BaseSimulation {
         ->SetReceiveBrokerForNextPhase(&report_broker_);
 
     ParallelAgentPhase(timestep, *executor_, GetObserverManager(),
-                       agent_chunker_, *outcomes, *reports, agent_workers_, fn);
+                       agent_chunker_, *outcomes, *reports, agent_workers_, fn,
+                       stats);
+    ScopedTimer timer(&stats.distributed_flush);
     distributed_manager_->VisitMessenger()->FlushAndAwaitRemotes();
     // TODO: We technically don't need to await remotes here, but we
     // should flush.  Consider splitting the two functions and calling
     // await remotes at the end of the location phase.
     distributed_manager_->ContactReportMessenger()->FlushAndAwaitRemotes();
   }
-  void RunLocationPhase(const Timestep& timestep,
-                        const LocationPhaseFn& fn) override {
-    auto visits = visit_broker_.Consume();
-    distributed_manager_->OutcomeMessenger()->SetReceiveBrokerForNextPhase(
-        &outcome_broker_);
-    ParallelLocationPhase(timestep, *executor_, GetObserverManager(),
-                          location_chunker_, *visits, location_workers_, fn);
-    distributed_manager_->OutcomeMessenger()->FlushAndAwaitRemotes();
+  void RunLocationPhase(const Timestep& timestep, const LocationPhaseFn& fn,
+                        StepStats& stats) override {
+    {
+      absl::Time consume_start = absl::Now();
+      auto visits = visit_broker_.Consume();
+      stats.broker_consume += absl::Now() - consume_start;
+      distributed_manager_->OutcomeMessenger()->SetReceiveBrokerForNextPhase(
+          &outcome_broker_);
+      ParallelLocationPhase(timestep, *executor_, GetObserverManager(),
+                            location_chunker_, *visits, location_workers_, fn,
+                            stats);
+      ScopedTimer timer(&stats.distributed_flush);
+      distributed_manager_->OutcomeMessenger()->FlushAndAwaitRemotes();
+    }
+    // Remote visits are only received during the agent phase, so no visits
+    // are in flight until then.
+    location_chunker_.Rebalance(EstimatedLocationCost);
   }
 
  private:
   struct AgentWorker {
+    std::unique_ptr<WorkQueueBroker<Location, Visit>::Outbox> visit_outbox;
     std::unique_ptr<DistributingBroker<Visit>> visit_broker;
+    std::unique_ptr<WorkQueueBroker<Agent, ContactReport>::Outbox>
+        report_outbox;
     std::unique_ptr<DistributingBroker<ContactReport>> report_broker;
   };
   struct LocationWorker {
+    std::unique_ptr<WorkQueueBroker<Agent, InfectionOutcome>::Outbox>
+        outcome_outbox;
     std::unique_ptr<DistributingBroker<InfectionOutcome>> outcome_broker;
   };
 
   std::unique_ptr<Executor> executor_;
   Chunker<Agent> agent_chunker_;
   Chunker<Location> location_chunker_;
-  absl::FixedArray<AgentWorker> agent_workers_;
-  absl::FixedArray<LocationWorker> location_workers_;
   WorkQueueBroker<Agent, InfectionOutcome> outcome_broker_;
   WorkQueueBroker<Agent, ContactReport> report_broker_;
   WorkQueueBroker<Location, Visit> visit_broker_;
+  // Workers hold outboxes of the brokers above, so must be destroyed first.
+  absl::FixedArray<AgentWorker> agent_workers_;
+  absl::FixedArray<LocationWorker> location_workers_;
   DistributedManager* const distributed_manager_;
 };
 
@@ -577,7 +739,16 @@ std::unique_ptr<Simulation> ParallelSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
     std::vector<std::unique_ptr<Location>> locations, const int num_workers) {
   return absl::make_unique<Parallel>(start, std::move(agents),
-                                     std::move(locations), num_workers);
+                                     std::move(locations), num_workers,
+                                     /*pipelined=*/false);
+}
+
+std::unique_ptr<Simulation> PipelinedSimulation(
+    absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+    std::vector<std::unique_ptr<Location>> locations, const int num_workers) {
+  return absl::make_unique<Parallel>(start, std::move(agents),
+                                     std::move(locations), num_workers,
+                                     /*pipelined=*/true);
 }
 
 std::unique_ptr<Simulation> ParallelDistributedSimulation(
@@ -21,6 +21,7 @@
 #include "agent_based_epidemic_sim/core/distributed.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/step_stats.h"
 
 namespace abesim {
 
@@ -45,6 +46,15 @@ class Simulation {
   // factory.
   virtual void RemoveObserverFactory(ObserverFactoryBase* factory) = 0;
 
+  // Returns timings and message counts for every step run so far, oldest
+  // first.  The returned span is invalidated by the next call to Step.
+  virtual absl::Span<const StepStats> GetStepStats() const = 0;
+
+  // Set a writer that the StepStats for each future step are written to as
+  // soon as the step completes, or nullptr to stop writing stats.  The writer
+  // must outlive its use by the simulation.
+  virtual void SetStepStatsWriter(StepStatsWriter* writer) = 0;
+
   virtual ~Simulation() = default;
 };
 
@@ -56,6 +66,14 @@ std::unique_ptr<Simulation> ParallelSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
     std::vector<std::unique_ptr<Location>> locations, int num_workers);
 
+// Create a parallel simulation that overlaps the agent and location phases of
+// each step.  Each chunk of locations is processed as soon as every agent that
+// may visit it, according to Agent::GetPossibleLocations, has computed its
+// visits.  Locations wait for all agents that cannot bound their visits.
+std::unique_ptr<Simulation> PipelinedSimulation(
+    absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+    std::vector<std::unique_ptr<Location>> locations, int num_workers);
+
 // Create a parallel simulation with num_local_workers local worker threads
 // and also coorinate with distributed simulation nodes via the given
 // DistributedManager.
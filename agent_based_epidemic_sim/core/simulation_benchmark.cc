@@ -0,0 +1,308 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the throughput of whole simulation steps, in agent-steps per second,
+// for a home-work population of SEIRAgents and LocationDiscreteEventSimulators.
+// The population benchmarks store the same agents in a SEIRPopulation instead.
+// range(0) is the number of agents and, for the parallel and pipelined
+// simulations, range(1) is the number of worker threads.  The tracing
+// benchmarks test every infectious agent and trace its contacts, forwarding
+// reports up to range(1) hops, and count the reports delivered per step.
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/risk_score.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
+#include "agent_based_epidemic_sim/core/seir_population.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/core/transition_model.h"
+#include "agent_based_epidemic_sim/core/wrapped_transition_model.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+constexpr int kHouseholdSize = 4;
+constexpr int kWorkplaceSize = 20;
+// One in kSeedInterval agents starts out infectious.
+constexpr int kSeedInterval = 1000;
+// Used to scatter agents across workplaces independently of their household.
+constexpr int64 kWorkplaceStride = 7919;
+
+// A transition model with fixed dwell times in each infected state.
+class FixedSEIRTransitionModel : public TransitionModel {
+ public:
+  HealthTransition GetNextHealthTransition(
+      const HealthTransition& latest_transition) override {
+    switch (latest_transition.health_state) {
+      case HealthState::EXPOSED:
+        return {.time = latest_transition.time + absl::Hours(48),
+                .health_state = HealthState::INFECTIOUS};
+      case HealthState::INFECTIOUS:
+        return {.time = latest_transition.time + absl::Hours(120),
+                .health_state = HealthState::RECOVERED};
+      default:
+        return {.time = absl::InfiniteFuture(),
+                .health_state = latest_transition.health_state};
+    }
+  }
+};
+
+// Tests agents positive a day after they become infectious, and reports their
+// contacts.
+class TracingRiskScore : public RiskScore {
+ public:
+  TracingRiskScore(const int max_hops, std::atomic<int64>* notifications)
+      : max_hops_(max_hops), notifications_(notifications) {}
+
+  void AddHealthStateTransistion(HealthTransition transition) override {
+    if (transition.health_state != HealthState::INFECTIOUS) return;
+    test_result_ = {.time_requested = transition.time,
+                    .time_received = transition.time + absl::Hours(24),
+                    .probability = 1.0};
+  }
+  void AddExposures(absl::Span<const Exposure* const> exposures) override {}
+  void AddExposureNotification(const Contact& contact,
+                               const TestResult& result,
+                               const int hops) override {
+    notifications_->fetch_add(1, std::memory_order_relaxed);
+  }
+
+  VisitAdjustment GetVisitAdjustment(const Timestep& timestep,
+                                     int64 location_uuid) const override {
+    return {.frequency_adjustment = 1.0, .duration_adjustment = 1.0};
+  }
+  TestResult GetTestResult(const Timestep& timestep) const override {
+    return test_result_;
+  }
+  ContactTracingPolicy GetContactTracingPolicy(
+      const Timestep& timestep) const override {
+    return {.report_recursively = max_hops_ > 1,
+            .send_report = test_result_.time_received < timestep.end_time(),
+            .max_hops = max_hops_};
+  }
+  absl::Duration ContactRetentionDuration() const override {
+    return absl::Hours(24 * 7);
+  }
+
+ private:
+  const int max_hops_;
+  std::atomic<int64>* const notifications_;
+  TestResult test_result_ = {.time_requested = absl::InfiniteFuture(),
+                             .time_received = absl::InfiniteFuture(),
+                             .probability = 0.0};
+};
+
+// Owns a simulation and the models shared by its agents.
+struct Population {
+  FixedSEIRTransitionModel transition_model;
+  AggregatedTransmissionModel transmission_model{0.5};
+  std::unique_ptr<SEIRPopulation> seir_population;
+  std::unique_ptr<Simulation> sim;
+  // The contact reports delivered, with tracing.
+  std::atomic<int64> notifications{0};
+};
+
+enum class Scheduler { kSerial, kParallel, kPipelined };
+enum class Storage { kSEIRAgents, kSEIRPopulation };
+
+std::unique_ptr<Population> MakePopulation(const int num_agents,
+                                           const Scheduler scheduler,
+                                           const int num_workers,
+                                           const Storage storage,
+                                           const int max_hops = 0) {
+  auto population = absl::make_unique<Population>();
+  const int num_households = (num_agents + kHouseholdSize - 1) / kHouseholdSize;
+  const int num_workplaces = (num_agents + kWorkplaceSize - 1) / kWorkplaceSize;
+
+  auto sample_hours = [](const float hours) {
+    return [hours](float adjustment) { return hours * adjustment; };
+  };
+  int profile = 0;
+  if (storage == Storage::kSEIRPopulation) {
+    population->seir_population =
+        absl::make_unique<SEIRPopulation>(&population->transmission_model);
+    profile = population->seir_population->AddProfile(
+        {.transition_model = &population->transition_model,
+         .visit_durations = {sample_hours(8), sample_hours(8),
+                             sample_hours(8)}});
+  }
+  std::vector<std::unique_ptr<Agent>> agents;
+  agents.reserve(num_agents);
+  for (int i = 0; i < num_agents; ++i) {
+    const int64 household = i / kHouseholdSize;
+    const int64 workplace =
+        num_households + (i * kWorkplaceStride % num_agents) / kWorkplaceSize;
+    const HealthTransition initial_transition =
+        i % kSeedInterval == 0
+            ? HealthTransition{.time = absl::UnixEpoch(),
+                               .health_state = HealthState::INFECTIOUS}
+            : HealthTransition{.time = absl::InfiniteFuture(),
+                               .health_state = HealthState::SUSCEPTIBLE};
+    if (storage == Storage::kSEIRPopulation) {
+      population->seir_population->AddAgent(i, initial_transition, profile,
+                                            {household, workplace, household});
+      continue;
+    }
+    auto visit_generator = absl::make_unique<DurationSpecifiedVisitGenerator>(
+        std::vector<LocationDuration>{
+            {.location_uuid = household, .sample_duration = sample_hours(8)},
+            {.location_uuid = workplace, .sample_duration = sample_hours(8)},
+            {.location_uuid = household, .sample_duration = sample_hours(8)},
+        });
+    agents.push_back(SEIRAgent::Create(
+        i, initial_transition, &population->transmission_model,
+        absl::make_unique<WrappedTransitionModel>(
+            &population->transition_model),
+        std::move(visit_generator),
+        max_hops > 0 ? absl::make_unique<TracingRiskScore>(
+                           max_hops, &population->notifications)
+                     : NewNullRiskScore()));
+  }
+  if (storage == Storage::kSEIRPopulation) {
+    agents = population->seir_population->MakeAgents();
+  }
+
+  std::vector<std::unique_ptr<Location>> locations;
+  locations.reserve(num_households + num_workplaces);
+  MicroExposureGeneratorBuilder exposure_generator_builder;
+  for (int i = 0; i < num_households + num_workplaces; ++i) {
+    locations.push_back(absl::make_unique<LocationDiscreteEventSimulator>(
+        i, exposure_generator_builder.Build()));
+  }
+
+  switch (scheduler) {
+    case Scheduler::kSerial:
+      population->sim = SerialSimulation(absl::UnixEpoch(), std::move(agents),
+                                         std::move(locations));
+      break;
+    case Scheduler::kParallel:
+      population->sim = ParallelSimulation(
+          absl::UnixEpoch(), std::move(agents), std::move(locations),
+          num_workers);
+      break;
+    case Scheduler::kPipelined:
+      population->sim = PipelinedSimulation(
+          absl::UnixEpoch(), std::move(agents), std::move(locations),
+          num_workers);
+      break;
+  }
+  return population;
+}
+
+void RunStepBenchmark(benchmark::State& state, const Scheduler scheduler,
+                      const int num_workers,
+                      const Storage storage = Storage::kSEIRAgents) {
+  const int num_agents = state.range(0);
+  auto population =
+      MakePopulation(num_agents, scheduler, num_workers, storage);
+  for (auto _ : state) {
+    population->sim->Step(1, absl::Hours(24));
+  }
+  state.SetItemsProcessed(state.iterations() * num_agents);
+}
+
+void BM_SerialTracingStep(benchmark::State& state) {
+  const int num_agents = state.range(0);
+  const int max_hops = state.range(1);
+  auto population = MakePopulation(num_agents, Scheduler::kSerial, 1,
+                                   Storage::kSEIRAgents, max_hops);
+  // Let the epidemic and its reports spread before measuring.
+  population->sim->Step(7, absl::Hours(24));
+  population->notifications = 0;
+  for (auto _ : state) {
+    population->sim->Step(1, absl::Hours(24));
+  }
+  state.SetItemsProcessed(state.iterations() * num_agents);
+  state.counters["reports"] = benchmark::Counter(
+      population->notifications, benchmark::Counter::kAvgIterations);
+}
+
+void BM_SerialStep(benchmark::State& state) {
+  RunStepBenchmark(state, Scheduler::kSerial, 1);
+}
+void BM_ParallelStep(benchmark::State& state) {
+  RunStepBenchmark(state, Scheduler::kParallel, state.range(1));
+}
+void BM_PipelinedStep(benchmark::State& state) {
+  RunStepBenchmark(state, Scheduler::kPipelined, state.range(1));
+}
+void BM_SerialPopulationStep(benchmark::State& state) {
+  RunStepBenchmark(state, Scheduler::kSerial, 1, Storage::kSEIRPopulation);
+}
+void BM_ParallelPopulationStep(benchmark::State& state) {
+  RunStepBenchmark(state, Scheduler::kParallel, state.range(1),
+                   Storage::kSEIRPopulation);
+}
+
+constexpr int kPopulationSizes[] = {10000, 1000000, 10000000};
+
+void SerialArgs(benchmark::internal::Benchmark* b) {
+  for (int num_agents : kPopulationSizes) b->Args({num_agents});
+}
+void ParallelArgs(benchmark::internal::Benchmark* b) {
+  for (int num_agents : kPopulationSizes) {
+    for (int num_workers : {2, 4, 8, 16}) {
+      b->Args({num_agents, num_workers});
+    }
+  }
+}
+
+BENCHMARK(BM_SerialStep)
+    ->Apply(SerialArgs)
+    ->ArgNames({"agents"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ParallelStep)
+    ->Apply(ParallelArgs)
+    ->ArgNames({"agents", "workers"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_PipelinedStep)
+    ->Apply(ParallelArgs)
+    ->ArgNames({"agents", "workers"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_SerialTracingStep)
+    ->ArgPair(100000, 1)
+    ->ArgPair(100000, 2)
+    ->ArgPair(100000, 3)
+    ->ArgPair(100000, 4)
+    ->ArgNames({"agents", "max_hops"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_SerialPopulationStep)
+    ->Apply(SerialArgs)
+    ->ArgNames({"agents"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ParallelPopulationStep)
+    ->Apply(ParallelArgs)
+    ->ArgNames({"agents", "workers"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace abesim
@@ -14,6 +14,8 @@
 
 #include "agent_based_epidemic_sim/core/simulation.h"
 
+#include <atomic>
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
@@ -126,6 +128,76 @@ class FakeAgent : public Agent {
   ReportMap* report_counts_;
 };
 
+// An agent that also visits location 0 every step, making it much busier than
+// every other location.
+class CrowdingAgent : public FakeAgent {
+ public:
+  using FakeAgent::FakeAgent;
+  void ComputeVisits(const Timestep& timestep,
+                     Broker<Visit>* visit_broker) const override {
+    FakeAgent::ComputeVisits(timestep, visit_broker);
+    visit_broker->Send({{.location_uuid = 0, .agent_uuid = uuid()}});
+  }
+};
+
+// An agent that is always quiescent and only visits a location on even
+// uuids, counting how often each of its methods is called.
+class QuiescentAgent : public Agent {
+ public:
+  struct Calls {
+    std::atomic<int> outcomes{0};
+    std::atomic<int> reports{0};
+    std::atomic<int> visits{0};
+  };
+
+  QuiescentAgent(int64 uuid, Calls* calls) : uuid_(uuid), calls_(calls) {}
+  int64 uuid() const override { return uuid_; }
+  bool IsQuiescent(const Timestep& timestep) const override { return true; }
+  void ComputeVisits(const Timestep& timestep,
+                     Broker<Visit>* visit_broker) const override {
+    calls_->visits++;
+    if (uuid_ % 2 == 0) {
+      visit_broker->Send({{.location_uuid = uuid_ % kNumLocations,
+                           .agent_uuid = uuid_}});
+    }
+  }
+  void ProcessInfectionOutcomes(
+      const Timestep& timestep,
+      absl::Span<const InfectionOutcome> infection_outcomes) override {
+    calls_->outcomes++;
+  }
+  void UpdateContactReports(const Timestep& timestep,
+                            absl::Span<const ContactReport> symptom_reports,
+                            Broker<ContactReport>* symptom_broker) override {
+    calls_->reports++;
+  }
+  HealthState::State CurrentHealthState() const override {
+    return HealthState::SUSCEPTIBLE;
+  }
+  TestResult CurrentTestResult(const Timestep&) const override {
+    return TestResult{};
+  }
+  absl::Span<const HealthTransition> HealthTransitions() const override {
+    return {};
+  }
+
+ private:
+  int64 uuid_;
+  Calls* calls_;
+};
+
+// An agent that declares the locations it visits.
+class BoundedAgent : public FakeAgent {
+ public:
+  using FakeAgent::FakeAgent;
+  bool GetPossibleLocations(std::vector<int64>* location_uuids) const override {
+    for (const int location_uuid : VisitLocations(uuid())) {
+      location_uuids->push_back(location_uuid);
+    }
+    return true;
+  }
+};
+
 class FakeLocation : public Location {
  public:
   FakeLocation(int64 uuid, VisitMap* visit_counts)
@@ -184,6 +256,11 @@ class FakeObserverFactory : public ObserverFactory<FakeObserver> {
   std::unique_ptr<FakeObserver> MakeObserver(const Timestep&) const override {
     return absl::make_unique<FakeObserver>();
   }
+  bool ResetObserver(const Timestep&, FakeObserver* observer) const override {
+    observer->agent_stats_.clear();
+    observer->location_stats_.clear();
+    return true;
+  }
   void Aggregate(
       const Timestep& timestep,
       absl::Span<std::unique_ptr<FakeObserver> const> observers) override {
@@ -335,8 +412,178 @@ TEST(SimulationTest, AllAgentsAndLocationsAreProcessedInParallelWithObserver) {
   observer_factory.CheckResults();
 }
 
+TEST(SimulationTest, AllAgentsAndLocationsAreProcessedPipelined) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return PipelinedSimulation(start, std::move(agents), std::move(locations),
+                               3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  FakeObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  for (int step = 0; step < kNumSteps; ++step) {
+    sim->Step(1, absl::Hours(24));
+  }
+  CheckSimulatorResults(outcomes, visits, reports);
+  observer_factory.CheckResults();
+}
+
+TEST(SimulationTest, BoundedAgentsAndLocationsAreProcessedPipelined) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  std::vector<std::unique_ptr<Agent>> agents;
+  for (int i = 0; i < kNumAgents; ++i) {
+    agents.push_back(absl::make_unique<BoundedAgent>(i, &outcomes, &reports));
+  }
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    locations.push_back(absl::make_unique<FakeLocation>(i, &visits));
+  }
+  auto sim = PipelinedSimulation(absl::UnixEpoch(), std::move(agents),
+                                 std::move(locations), 3);
+  FakeObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  sim->Step(kNumSteps, absl::Hours(24));
+  CheckSimulatorResults(outcomes, visits, reports);
+  observer_factory.CheckResults();
+}
+
+TEST(SimulationTest, SkewedLocationsAreProcessedInParallel) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  std::vector<std::unique_ptr<Agent>> agents;
+  for (int i = 0; i < kNumAgents; ++i) {
+    agents.push_back(absl::make_unique<CrowdingAgent>(i, &outcomes, &reports));
+  }
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    locations.push_back(absl::make_unique<FakeLocation>(i, &visits));
+  }
+  auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                std::move(locations), 3);
+  // Run enough steps for the location chunks to be rebalanced.
+  for (int step = 0; step < kNumSteps; ++step) {
+    sim->Step(1, absl::Hours(24));
+  }
+
+  absl::MutexLock l(&map_mu);
+  for (int i = 0; i < kNumAgents; i++) {
+    EXPECT_EQ(outcomes[i], (kVisitsPerAgent + 1) * (kNumSteps - 1));
+    const auto locations = VisitLocations(i);
+    const bool visits_zero = std::find(locations.begin(), locations.end(),
+                                       0) != locations.end();
+    EXPECT_EQ((visits[{0, i}]), kNumSteps * (visits_zero ? 2 : 1));
+    for (const int location : locations) {
+      if (location == 0) continue;
+      EXPECT_EQ((visits[{location, i}]), kNumSteps);
+    }
+  }
+}
+
+void CheckStepStats(const Simulation& sim, const int num_workers) {
+  absl::Span<const StepStats> step_stats = sim.GetStepStats();
+  ASSERT_EQ(step_stats.size(), kNumSteps);
+  for (int step = 0; step < kNumSteps; ++step) {
+    const StepStats& stats = step_stats[step];
+    EXPECT_EQ(stats.time, absl::UnixEpoch() + step * absl::Hours(24));
+    EXPECT_EQ(stats.visits, kNumAgents * kVisitsPerAgent);
+    EXPECT_EQ(stats.infection_outcomes, kNumAgents * kVisitsPerAgent);
+    EXPECT_EQ(stats.contact_reports, kNumAgents * kReportsPerAgent);
+    EXPECT_GT(stats.agent_phase, absl::ZeroDuration());
+    EXPECT_GT(stats.location_phase, absl::ZeroDuration());
+    EXPECT_LE(stats.sort, num_workers * (stats.agent_phase +
+                                         stats.location_phase));
+    EXPECT_EQ(stats.distributed_flush, absl::ZeroDuration());
+    ASSERT_EQ(stats.workers.size(), num_workers);
+    int64 visits = 0;
+    for (const WorkerStats& worker : stats.workers) {
+      EXPECT_LE(worker.busy + worker.idle,
+                stats.agent_phase + stats.location_phase);
+      visits += worker.visits;
+    }
+    EXPECT_EQ(visits, stats.visits);
+  }
+}
+
+TEST(SimulationTest, RecordsStepStatsSerially) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto sim = BuildSimulator(SerialSimulation, &outcomes, &visits, &reports);
+  sim->Step(kNumSteps, absl::Hours(24));
+  CheckStepStats(*sim, 1);
+}
+
+TEST(SimulationTest, RecordsStepStatsInParallel) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  for (int step = 0; step < kNumSteps; ++step) {
+    sim->Step(1, absl::Hours(24));
+  }
+  CheckStepStats(*sim, 3);
+}
+
+TEST(SimulationTest, RecordsStepStatsPipelined) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return PipelinedSimulation(start, std::move(agents), std::move(locations),
+                               3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  sim->Step(kNumSteps, absl::Hours(24));
+  CheckStepStats(*sim, 3);
+}
+
 // TODO: Add a test for DistributedParallelSimulation using a mock
 // DistributedManager.  Currently I'm relying on the stubby test.
 
+void CheckQuiescentAgentsAreSkipped(SimBuilder builder) {
+  std::vector<QuiescentAgent::Calls> calls(kNumAgents);
+  std::vector<std::unique_ptr<Agent>> agents;
+  for (int i = 0; i < kNumAgents; ++i) {
+    agents.push_back(absl::make_unique<QuiescentAgent>(i, &calls[i]));
+  }
+  VisitMap visits;
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    locations.push_back(absl::make_unique<FakeLocation>(i, &visits));
+  }
+  auto sim =
+      builder(absl::UnixEpoch(), std::move(agents), std::move(locations));
+  sim->Step(kNumSteps, absl::Hours(24));
+
+  for (int i = 0; i < kNumAgents; ++i) {
+    EXPECT_EQ(calls[i].visits, kNumSteps);
+    // Agents only receive outcomes in the step after their visits.
+    const int expected = i % 2 == 0 ? kNumSteps - 1 : 0;
+    EXPECT_EQ(calls[i].outcomes, expected);
+    EXPECT_EQ(calls[i].reports, expected);
+  }
+}
+
+TEST(SimulationTest, QuiescentAgentsAreSkippedSerially) {
+  CheckQuiescentAgentsAreSkipped(SerialSimulation);
+}
+
+TEST(SimulationTest, QuiescentAgentsAreSkippedInParallel) {
+  CheckQuiescentAgentsAreSkipped(
+      [](absl::Time start, auto agents, auto locations) {
+        return ParallelSimulation(start, std::move(agents),
+                                  std::move(locations), 3);
+      });
+}
+
 }  // namespace
 }  // namespace abesim
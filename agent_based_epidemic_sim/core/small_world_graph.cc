@@ -1,65 +1,110 @@
 #include "agent_based_epidemic_sim/core/small_world_graph.h"
 
-#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <random>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "agent_based_epidemic_sim/port/executor.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
+namespace {
 
-bool SmallWorldGraph::HasEdge(int i, int j) const {
-  if (i > j) std::swap(i, j);
-  if (graph_[i].empty()) return false;
-  return std::find(graph_[i].begin(), graph_[i].end(), j) != graph_[i].end();
-}
-
-void SmallWorldGraph::AddEdge(int i, int j) {
-  if (i > j) std::swap(i, j);
-  if (HasEdge(i, j)) return;
-  graph_[i].push_back(j);
-  degrees_[i]++;
-  degrees_[j]++;
-}
+// Nodes are rewired in chunks of this many, each with its own random
+// generator, so that the graph does not depend on how chunks are scheduled.
+constexpr int kChunkSize = 4096;
 
-void SmallWorldGraph::AddNode(int i) {
-  if (i > graph_.size()) graph_.resize(i + 1);
-  if (i > degrees_.size()) degrees_.resize(i + 1);
+std::pair<int, int> Edge(const int i, const int j) {
+  return std::minmax(i, j);
 }
 
-void SmallWorldGraph::RemoveEdge(int i, int j) {
-  if (i > j) std::swap(i, j);
-  if (!HasEdge(i, j)) return;
-  graph_[i].erase(std::remove(graph_[i].begin(), graph_[i].end(), j),
-                  graph_[i].end());
-  degrees_[i]--;
-  degrees_[j]--;
-}
-
-int SmallWorldGraph::Degree(int i) const { return degrees_[i]; }
-
-std::vector<std::pair<int, int>> SmallWorldGraph::GetEdges() const {
+// Returns the edges (u, v mod n) with u < v <= u + k/2 of nodes
+// [begin, end), each rewired with probability 'p'.  Rewiring replaces
+// (u, v mod n) with (u, w), where w is chosen uniformly at random from the
+// nodes that are neither u, nor a neighbor of u in the ring lattice, nor
+// already joined to u by a rewired edge.
+std::vector<std::pair<int, int>> RewireNodes(const int n, const int k,
+                                             const float p, const int begin,
+                                             const int end,
+                                             std::mt19937_64& gen) {
+  const int half_k = k / 2;
+  // If u is joined to every other node by the lattice, there is nowhere to
+  // rewire its edges to.
+  const int free_nodes = n - 1 - 2 * half_k;
   std::vector<std::pair<int, int>> edges;
-  CHECK(graph_.size() == n_);
-  for (int i = 0; i < n_; ++i) {
-    for (int j = i + 1; j < n_; ++j) {
-      if (HasEdge(i, j)) {
-        edges.push_back(std::make_pair(i, j));
+  edges.reserve((end - begin) * half_k);
+  std::vector<int> rewired;
+  for (int u = begin; u < end; ++u) {
+    rewired.clear();
+    for (int v = u + 1; v <= u + half_k; ++v) {
+      if (free_nodes - static_cast<int>(rewired.size()) <= 0 ||
+          !absl::Bernoulli(gen, p)) {
+        edges.push_back(Edge(u, v % n));
+        continue;
       }
+      int w;
+      do {
+        w = absl::Uniform<int>(absl::IntervalClosedClosed, gen, 0, n - 1);
+        // Rejects u itself and its lattice neighbors, which lie within
+        // half_k of u around the ring.
+      } while ((w - u + n + half_k) % n <= 2 * half_k ||
+               std::find(rewired.begin(), rewired.end(), w) != rewired.end());
+      rewired.push_back(w);
+      edges.push_back(Edge(u, w));
     }
   }
-  CHECK(edges.size() == n_ * (k_ / 2));
   return edges;
 }
 
+// Sets edges to the concatenation of chunk_edges, sorted.  Edges are first
+// bucketed by their lower node, so that only each node's few edges need to be
+// compared.
+void SortEdges(const int n,
+               const std::vector<std::vector<std::pair<int, int>>>& chunk_edges,
+               std::vector<std::pair<int, int>>* edges) {
+  std::vector<int64> offsets(n + 1);
+  for (const auto& chunk : chunk_edges) {
+    for (const auto& edge : chunk) ++offsets[edge.first + 1];
+  }
+  for (int i = 0; i < n; ++i) offsets[i + 1] += offsets[i];
+  edges->resize(offsets[n]);
+  std::vector<int64> filled(offsets.begin(), offsets.end() - 1);
+  for (const auto& chunk : chunk_edges) {
+    for (const auto& edge : chunk) (*edges)[filled[edge.first]++] = edge;
+  }
+  for (int i = 0; i < n; ++i) {
+    std::sort(edges->begin() + offsets[i], edges->begin() + offsets[i + 1]);
+  }
+}
+
+}  // namespace
+
+/* static */ std::unique_ptr<SmallWorldGraph>
+SmallWorldGraph::GenerateWattsStrogatzGraph(int n, int k, float p) {
+  absl::BitGen gen;
+  return GenerateWattsStrogatzGraph(n, k, p, absl::Uniform<uint64>(gen),
+                                    /*num_workers=*/1);
+}
+
 // First create a ring over 'n' nodes.  Then each node in the ring is joined to
 // its 'k' nearest neighbors (or 'k - 1' neighbors if 'k' is odd). Then
 // shortcuts are created by replacing some edges as follows: for each
 // edge (u, v) in the underlying n-ring, with probability 'p' replace it with a
 // new edge (u, w) with uniformly random choice of existing node 'w'.
+//
+// Nodes are rewired independently, in parallel, so two nodes may rewire to the
+// same edge.  Such duplicates are rare, and are afterwards rewired again in
+// turn.
 /* static */ std::unique_ptr<SmallWorldGraph>
-SmallWorldGraph::GenerateWattsStrogatzGraph(int n, int k, float p) {
+SmallWorldGraph::GenerateWattsStrogatzGraph(const int n, const int k,
+                                            const float p, const uint64 seed,
+                                            const int num_workers) {
   // Validate inputs
   // 0 <= p <= 1
   CHECK(p >= 0) << "'p' must be >= 0";
@@ -72,55 +117,90 @@ SmallWorldGraph::GenerateWattsStrogatzGraph(int n, int k, float p) {
   ws->k_ = k;
   ws->p_ = p;
 
-  // 1. Create nodes labeled 0,...n-1
-  ws->AddNode(n - 1);
-
-  // 2. Create ring lattice. There is an edge (u,v) iff
-  //    0 < |u-v| mod (n - 1 - k/2) <= k/2
-  for (int u = 0; u < n; ++u) {
-    // Add k/2 edges to the right for node 'u'.
-    for (int v = u + 1; v <= u + k / 2; ++v) {
-      ws->AddEdge(u, v % n);
-    }
-    // Add k/2 edges to the left for node 'u'.
-    for (int v = u - 1; v < u - 1 - k / 2; --v) {
-      ws->AddEdge(u, v % n);
+  // 1. Create the ring lattice and rewire its edges, a chunk of nodes at a
+  //    time.
+  const int num_chunks = (n + kChunkSize - 1) / kChunkSize;
+  std::vector<std::vector<std::pair<int, int>>> chunk_edges(num_chunks);
+  auto rewire_chunk = [n, k, p, seed, &chunk_edges](const int chunk) {
+    std::seed_seq seq = {static_cast<uint32>(seed),
+                         static_cast<uint32>(seed >> 32),
+                         static_cast<uint32>(chunk)};
+    std::mt19937_64 gen(seq);
+    chunk_edges[chunk] =
+        RewireNodes(n, k, p, chunk * kChunkSize,
+                    std::min(n, (chunk + 1) * kChunkSize), gen);
+  };
+  if (num_workers > 1 && num_chunks > 1) {
+    std::atomic<int> next_chunk(0);
+    auto executor = NewExecutor(num_workers);
+    std::unique_ptr<Execution> exec = executor->NewExecution();
+    for (int w = 0; w < num_workers; ++w) {
+      exec->Add([&next_chunk, num_chunks, &rewire_chunk]() {
+        for (int chunk = next_chunk++; chunk < num_chunks;
+             chunk = next_chunk++) {
+          rewire_chunk(chunk);
+        }
+      });
     }
+    exec->Wait();
+  } else {
+    for (int chunk = 0; chunk < num_chunks; ++chunk) rewire_chunk(chunk);
   }
+  std::vector<std::pair<int, int>>& edges = ws->edges_;
+  SortEdges(n, chunk_edges, &edges);
 
-  // 3. Rewire an edge with probability 'p'.
-  // For every node u = 0,..., n-1, take every edge connecting 'u' to its k/2
-  // rightmost neighbors, that is, every edge (u, v mod n) with
-  // u < v <= u + k/2, and rewire it with probability 'p'. Rewiring is done by
-  // replacing (u, v mod N) with (u, w) where w is chosen uniformly at random
-  // from all possible nodes while avoiding self-loops (w != u) and link
-  // duplication (there is no edge (u, w') with w'=w at this point in the
-  // algorithm).
-  for (int u = 0; u < n; ++u) {
-    if (ws->Degree(u) >= n - 1) {
-      // u is already fully connected. Skip this rewiring
-      continue;
+  // 2. Rewire all but one copy of each duplicate edge (u, v), replacing it
+  //    with (u, w) for a random w not yet joined to u, or with a random
+  //    missing edge if u and v are both joined to every other node.
+  auto duplicate = std::adjacent_find(edges.begin(), edges.end());
+  if (duplicate != edges.end()) {
+    std::vector<int> degrees(n);
+    for (auto edge = edges.begin(); edge != edges.end(); ++edge) {
+      if (edge != edges.begin() && *edge == *(edge - 1)) continue;
+      ++degrees[edge->first];
+      ++degrees[edge->second];
     }
-    for (int v = u + 1; v <= u + k / 2; ++v) {
-      // Check if there is an edge (u, v) since could have been already rewired.
-      if (!ws->HasEdge(u, v % n)) continue;
-      // Rewire with probability 'p'
-      if (absl::Bernoulli(ws->bitgen_, p)) {
-        int w = u;
-        // Enforce no self-loops or duplicate edges. There is at least one
-        // available node.
-        while (w == u || ws->HasEdge(u, w)) {
-          // Generate a uniform value between [0, n-1].
-          w = absl::Uniform<int>(absl::IntervalClosedClosed, ws->bitgen_, 0,
-                                 n - 1);
-        }
-        // Rewire the edges.
-        ws->RemoveEdge(u, v % n);
-        ws->AddEdge(u, w);
+    // Edges added here, in addition to those in the sorted edges, which are
+    // only replaced once all are chosen.
+    absl::flat_hash_set<std::pair<int, int>> added;
+    std::vector<std::pair<int, int>*> replaced;
+    std::vector<std::pair<int, int>> replacements;
+    auto has_edge = [&edges, &added](const std::pair<int, int>& edge) {
+      return std::binary_search(edges.begin(), edges.end(), edge) ||
+             added.contains(edge);
+    };
+    std::seed_seq seq = {static_cast<uint32>(seed),
+                         static_cast<uint32>(seed >> 32),
+                         static_cast<uint32>(num_chunks)};
+    std::mt19937_64 gen(seq);
+    auto random_node = [n, &gen]() {
+      return absl::Uniform<int>(absl::IntervalClosedClosed, gen, 0, n - 1);
+    };
+    std::pair<int, int> previous = *duplicate;
+    for (auto next = duplicate + 1; next != edges.end(); ++next) {
+      if (*next != previous) {
+        previous = *next;
+        continue;
       }
+      const int u = degrees[next->first] < n - 1    ? next->first
+                    : degrees[next->second] < n - 1 ? next->second
+                                                    : -1;
+      std::pair<int, int> edge;
+      do {
+        edge = Edge(u >= 0 ? u : random_node(), random_node());
+      } while (edge.first == edge.second || has_edge(edge));
+      added.insert(edge);
+      ++degrees[edge.first];
+      ++degrees[edge.second];
+      replaced.push_back(&*next);
+      replacements.push_back(edge);
     }
+    for (int i = 0; i < replaced.size(); ++i) *replaced[i] = replacements[i];
+    chunk_edges.clear();
+    chunk_edges.push_back(std::move(edges));
+    SortEdges(n, chunk_edges, &edges);
   }
-  CHECK(ws->graph_.size() == ws->n_);
+  CHECK(edges.size() == n * (k / 2));
 
   return ws;
 }
@@ -2,10 +2,10 @@
 #define RESEARCH_SIMULATION_PANDEMIC_UTIL_SMALL_WORLD_GRAPH_H_
 
 #include <memory>
+#include <utility>
 #include <vector>
 
-#include "absl/container/inlined_vector.h"
-#include "absl/random/random.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 
 namespace abesim {
 
@@ -26,6 +26,12 @@ class SmallWorldGraph {
                                                                      int k,
                                                                      float p);
 
+  // As above, but the graph only depends on the seed, and not on num_workers,
+  // the number of threads used to generate it, nor on the process generating
+  // it.  Generation takes O(n * k) time.
+  static std::unique_ptr<SmallWorldGraph> GenerateWattsStrogatzGraph(
+      int n, int k, float p, uint64 seed, int num_workers);
+
   int NumNodes() const { return n_; }
   int Degree() const { return k_; }
   float RewireProbability() const { return p_; }
@@ -34,31 +40,20 @@ class SmallWorldGraph {
   // Nodes are numbered from 0,...,n and edges are in topologically sorted
   // order. Should have n*k/2 edges, if k is even, and n*(k-1)/2 edges if k is
   // odd.
-  std::vector<std::pair<int, int>> GetEdges() const;
+  const std::vector<std::pair<int, int>>& GetEdges() const { return edges_; }
 
  private:
   int n_;
   int k_;
   float p_;
 
-  // undirected graph implemented as an adjacency list with edges going between
-  // nodes i, j assigned to node i where i < j.
-  std::vector<absl::InlinedVector<int, 4>> graph_;
-  // Store degrees for performance.
-  std::vector<int> degrees_;
+  // Undirected edges (i, j) with i < j, sorted.
+  std::vector<std::pair<int, int>> edges_;
 
   SmallWorldGraph() = default;
   // Disallow copy and assign.
   SmallWorldGraph(const SmallWorldGraph&) = delete;
   SmallWorldGraph& operator=(const SmallWorldGraph&) = delete;
-
-  absl::BitGen bitgen_;
-
-  void AddEdge(int i, int j);
-  void AddNode(int i);
-  int Degree(int i) const;
-  bool HasEdge(int i, int j) const;
-  void RemoveEdge(int i, int j);
 };
 
 }  // namespace abesim
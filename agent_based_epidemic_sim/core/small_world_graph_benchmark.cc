@@ -0,0 +1,40 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures generating a Watts-Strogatz graph of range(0) nodes of degree 10,
+// with a tenth of the edges rewired, using range(1) threads.
+
+#include "agent_based_epidemic_sim/core/small_world_graph.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+void BM_GenerateWattsStrogatzGraph(benchmark::State& state) {
+  uint64 seed = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SmallWorldGraph::GenerateWattsStrogatzGraph(
+        state.range(0), /*k=*/10, /*p=*/0.1, seed++, state.range(1)));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_GenerateWattsStrogatzGraph)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgPair(10000, 1)
+    ->ArgPair(1000000, 1)
+    ->ArgPair(1000000, 4);
+
+}  // namespace
+}  // namespace abesim
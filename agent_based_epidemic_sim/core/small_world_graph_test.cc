@@ -1,6 +1,9 @@
 #include "agent_based_epidemic_sim/core/small_world_graph.h"
 
+#include <algorithm>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -8,6 +11,7 @@
 namespace abesim {
 namespace {
 
+using ::testing::ElementsAre;
 using ::testing::Pair;
 using ::testing::UnorderedElementsAre;
 
@@ -100,5 +104,69 @@ TEST(SmallWorldGraph, GenerateWattsStrogatzGraphPhalfOddK) {
   EXPECT_EQ(edges.size(), 5);
 }
 
+TEST(SmallWorldGraph, GenerateWattsStrogatzGraphIsSortedAndSimple) {
+  std::unique_ptr<SmallWorldGraph> ws =
+      SmallWorldGraph::GenerateWattsStrogatzGraph(/*n=*/10000, /*k=*/10,
+                                                  /*p=*/0.2, /*seed=*/1,
+                                                  /*num_workers=*/1);
+  const std::vector<std::pair<int, int>>& edges = ws->GetEdges();
+  EXPECT_EQ(edges.size(), 10000 * 5);
+  EXPECT_TRUE(std::is_sorted(edges.begin(), edges.end()));
+  EXPECT_EQ(std::adjacent_find(edges.begin(), edges.end()), edges.end());
+  int rewired = 0;
+  for (const auto& [i, j] : edges) {
+    EXPECT_LT(i, j);
+    EXPECT_GE(i, 0);
+    EXPECT_LT(j, 10000);
+    const int distance = std::min(j - i, 10000 - (j - i));
+    if (distance > 5) ++rewired;
+  }
+  // Few rewired edges land back in the lattice, so about a fifth are
+  // shortcuts.
+  EXPECT_NEAR(rewired, 0.2 * edges.size(), 0.01 * edges.size());
+}
+
+TEST(SmallWorldGraph, GenerateWattsStrogatzGraphDependsOnlyOnSeed) {
+  auto generate = [](const uint64 seed, const int num_workers) {
+    return SmallWorldGraph::GenerateWattsStrogatzGraph(
+               /*n=*/100000, /*k=*/6, /*p=*/0.1, seed, num_workers)
+        ->GetEdges();
+  };
+  const std::vector<std::pair<int, int>> edges = generate(7, 1);
+  EXPECT_EQ(generate(7, 1), edges);
+  EXPECT_EQ(generate(7, 4), edges);
+  EXPECT_NE(generate(8, 1), edges);
+}
+
+TEST(SmallWorldGraph, GenerateWattsStrogatzGraphIsTheSameInEveryProcess) {
+  std::unique_ptr<SmallWorldGraph> ws =
+      SmallWorldGraph::GenerateWattsStrogatzGraph(/*n=*/20, /*k=*/4,
+                                                  /*p=*/0.5, /*seed=*/42,
+                                                  /*num_workers=*/1);
+  const std::vector<std::pair<int, int>>& edges = ws->GetEdges();
+  ASSERT_EQ(edges.size(), 40);
+  const std::vector<std::pair<int, int>> first_edges(edges.begin(),
+                                                     edges.begin() + 8);
+  EXPECT_THAT(first_edges, ElementsAre(Pair(0, 3), Pair(0, 9), Pair(0, 11),
+                                       Pair(0, 12), Pair(0, 18), Pair(1, 3),
+                                       Pair(1, 7), Pair(1, 18)));
+  EXPECT_THAT(edges[20], Pair(6, 17));
+  EXPECT_THAT(edges.back(), Pair(17, 19));
+}
+
+TEST(SmallWorldGraph, GenerateWattsStrogatzGraphRemovesDuplicates) {
+  // With few free nodes, nodes often rewire to the same edge.
+  for (uint64 seed = 0; seed < 100; ++seed) {
+    std::unique_ptr<SmallWorldGraph> ws =
+        SmallWorldGraph::GenerateWattsStrogatzGraph(/*n=*/8, /*k=*/4,
+                                                    /*p=*/1.0, seed,
+                                                    /*num_workers=*/1);
+    const std::vector<std::pair<int, int>>& edges = ws->GetEdges();
+    EXPECT_EQ(edges.size(), 16);
+    EXPECT_EQ(std::adjacent_find(edges.begin(), edges.end()), edges.end());
+    for (const auto& [i, j] : edges) EXPECT_LT(i, j);
+  }
+}
+
 }  // namespace
 }  // namespace abesim
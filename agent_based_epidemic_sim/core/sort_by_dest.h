@@ -0,0 +1,296 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_SORT_BY_DEST_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_SORT_BY_DEST_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+
+// Returns the uuid of the entity a message should be delivered to.
+inline int64 GetDestId(const Visit& visit) { return visit.location_uuid; }
+inline int64 GetDestId(const InfectionOutcome& outcome) {
+  return outcome.agent_uuid;
+}
+inline int64 GetDestId(const ContactReport& report) {
+  return report.to_agent_uuid;
+}
+
+// Splits messages sorted by destination into those for the entity with the
+// given uuid, which must come first, and the rest.
+template <typename Msg>
+std::pair<absl::Span<const Msg>, absl::Span<Msg>> SplitMessages(
+    int64 uuid, absl::Span<Msg> messages) {
+  DCHECK(messages.empty() || GetDestId(messages[0]) >= uuid)
+      << "Message found for non-local entity.";
+  int idx = 0;
+  for (; idx < messages.size() && GetDestId(messages[idx]) == uuid; ++idx) {
+  }
+  return {messages.subspan(0, idx), messages.subspan(idx)};
+}
+
+// Orders messages by destination, and then by a message specific secondary key
+// so that each entity always receives its messages in a deterministic order.
+inline bool CompareDestId(const Visit& a, const Visit& b) {
+  if (a.location_uuid != b.location_uuid) {
+    return a.location_uuid < b.location_uuid;
+  }
+  if (a.start_time != b.start_time) {
+    return a.start_time < b.start_time;
+  }
+  return a.agent_uuid < b.agent_uuid;
+}
+inline bool CompareDestId(const InfectionOutcome& a,
+                          const InfectionOutcome& b) {
+  if (a.agent_uuid != b.agent_uuid) {
+    return a.agent_uuid < b.agent_uuid;
+  }
+  return a.exposure.start_time < b.exposure.start_time;
+}
+inline bool CompareDestId(const ContactReport& a, const ContactReport& b) {
+  if (a.to_agent_uuid != b.to_agent_uuid) {
+    return a.to_agent_uuid < b.to_agent_uuid;
+  }
+  return a.from_agent_uuid < b.from_agent_uuid;
+}
+
+// Sorts messages by CompareDestId using a comparison sort.
+template <typename Msg>
+void SortByDest(absl::Span<Msg> msgs) {
+  std::sort(msgs.begin(), msgs.end(),
+            [](const Msg& a, const Msg& b) { return CompareDestId(a, b); });
+}
+
+// RadixDestSorter sorts messages into the same order as SortByDest, but
+// distributes messages to their destinations in linear time.
+//
+// Messages are first bucketed by their destination offset from the smallest
+// destination in the batch.  When destinations are dense (as they are for the
+// uuids of a single work chunk) this is a single counting sort pass, otherwise
+// we fall back to a least significant digit radix sort on the offset.  Both are
+// stable.  Messages sharing a destination are then ordered by the secondary key
+// of CompareDestId; these groups are typically tiny so this is cheap.
+//
+// The sorter retains its scratch buffers between calls, so callers should keep
+// an instance around (e.g. one per thread) rather than creating one per sort.
+template <typename Msg>
+class RadixDestSorter {
+ public:
+  void Sort(absl::Span<Msg> msgs) {
+    if (msgs.size() < 2) return;
+    int64 min_dest = GetDestId(msgs[0]);
+    int64 max_dest = min_dest;
+    for (const Msg& msg : msgs) {
+      min_dest = std::min(min_dest, GetDestId(msg));
+      max_dest = std::max(max_dest, GetDestId(msg));
+    }
+    const uint64 range =
+        static_cast<uint64>(max_dest) - static_cast<uint64>(min_dest);
+    if (range == 0) {
+      SortGroup(msgs);
+      return;
+    }
+
+    scratch_.resize(msgs.size());
+    if (IsDense(range, msgs.size())) {
+      DistributeByDigit(msgs, min_dest, /*shift=*/0, range + 1);
+    } else {
+      for (int shift = 0; shift < 64 && (range >> shift) != 0;
+           shift += kRadixBits) {
+        DistributeByDigit(msgs, min_dest, shift, 1 << kRadixBits);
+      }
+    }
+    SortGroups(msgs);
+  }
+
+  // Replaces msgs with the concatenation of segments, sorted as by Sort.  When
+  // destinations are dense, each message is copied once, directly from its
+  // segment to its sorted position in msgs.
+  void SortInto(const absl::Span<const absl::Span<const Msg>> segments,
+                std::vector<Msg>* const msgs) {
+    size_t size = 0;
+    int64 min_dest = 0;
+    int64 max_dest = 0;
+    for (const absl::Span<const Msg> segment : segments) {
+      for (const Msg& msg : segment) {
+        if (size++ == 0) min_dest = max_dest = GetDestId(msg);
+        min_dest = std::min(min_dest, GetDestId(msg));
+        max_dest = std::max(max_dest, GetDestId(msg));
+      }
+    }
+    const uint64 range =
+        static_cast<uint64>(max_dest) - static_cast<uint64>(min_dest);
+    if (size < 2 || range == 0 || !IsDense(range, size)) {
+      msgs->clear();
+      for (const absl::Span<const Msg> segment : segments) {
+        msgs->insert(msgs->end(), segment.begin(), segment.end());
+      }
+      Sort(absl::MakeSpan(*msgs));
+      return;
+    }
+
+    offsets_.assign(range + 2, 0);
+    for (const absl::Span<const Msg> segment : segments) {
+      for (const Msg& msg : segment) {
+        ++offsets_[GetDestId(msg) - min_dest + 1];
+      }
+    }
+    for (size_t i = 1; i < offsets_.size(); ++i) {
+      offsets_[i] += offsets_[i - 1];
+    }
+    msgs->resize(size);
+    for (const absl::Span<const Msg> segment : segments) {
+      for (const Msg& msg : segment) {
+        (*msgs)[offsets_[GetDestId(msg) - min_dest]++] = msg;
+      }
+    }
+    SortGroups(absl::MakeSpan(*msgs));
+  }
+
+  // As above, but segments hold encoded messages, which decode converts to
+  // Msg.  GetDestId of an encoded message must order destinations as GetDestId
+  // of the decoded message does.  When destinations are dense, the encoded
+  // messages are distributed by destination and then decoded in order, so
+  // the larger decoded messages are written sequentially.
+  template <typename Encoded, typename DecodeFn>
+  void SortInto(const absl::Span<const absl::Span<const Encoded>> segments,
+                DecodeFn decode, std::vector<Msg>* const msgs) {
+    size_t size = 0;
+    int64 min_dest = 0;
+    int64 max_dest = 0;
+    for (const absl::Span<const Encoded> segment : segments) {
+      for (const Encoded& msg : segment) {
+        if (size++ == 0) min_dest = max_dest = GetDestId(msg);
+        min_dest = std::min(min_dest, GetDestId(msg));
+        max_dest = std::max(max_dest, GetDestId(msg));
+      }
+    }
+    msgs->clear();
+    msgs->reserve(size);
+    const uint64 range =
+        static_cast<uint64>(max_dest) - static_cast<uint64>(min_dest);
+    if (size < 2 || range == 0 || !IsDense(range, size)) {
+      for (const absl::Span<const Encoded> segment : segments) {
+        for (const Encoded& msg : segment) msgs->push_back(decode(msg));
+      }
+      Sort(absl::MakeSpan(*msgs));
+      return;
+    }
+
+    offsets_.assign(range + 2, 0);
+    for (const absl::Span<const Encoded> segment : segments) {
+      for (const Encoded& msg : segment) {
+        ++offsets_[GetDestId(msg) - min_dest + 1];
+      }
+    }
+    for (size_t i = 1; i < offsets_.size(); ++i) {
+      offsets_[i] += offsets_[i - 1];
+    }
+    // Only grown, as every element up to size is overwritten.
+    thread_local std::vector<Encoded> distributed;
+    if (distributed.size() < size) distributed.resize(size);
+    for (const absl::Span<const Encoded> segment : segments) {
+      for (const Encoded& msg : segment) {
+        distributed[offsets_[GetDestId(msg) - min_dest]++] = msg;
+      }
+    }
+    for (size_t i = 0; i < size; ++i) msgs->push_back(decode(distributed[i]));
+    SortGroups(absl::MakeSpan(*msgs));
+  }
+
+ private:
+  static constexpr int kRadixBits = 8;
+  static constexpr uint64 kDenseRangeFactor = 4;
+  static constexpr uint64 kDenseRangeSlack = 1 << 10;
+
+  static bool IsDense(const uint64 range, const size_t size) {
+    return range < kDenseRangeFactor * size + kDenseRangeSlack;
+  }
+
+  static void SortGroup(absl::Span<Msg> msgs) {
+    std::sort(msgs.begin(), msgs.end(),
+              [](const Msg& a, const Msg& b) { return CompareDestId(a, b); });
+  }
+
+  // Orders each group of messages, already grouped by destination, by the
+  // remainder of the CompareDestId key.
+  static void SortGroups(absl::Span<Msg> msgs) {
+    size_t begin = 0;
+    for (size_t i = 1; i <= msgs.size(); ++i) {
+      if (i == msgs.size() || GetDestId(msgs[i]) != GetDestId(msgs[begin])) {
+        if (i - begin > 1) SortGroup(msgs.subspan(begin, i - begin));
+        begin = i;
+      }
+    }
+  }
+
+  // Stable counting sort of msgs on the digit
+  // ((dest - min_dest) >> shift) % num_buckets.
+  void DistributeByDigit(absl::Span<Msg> msgs, const int64 min_dest,
+                         const int shift, const uint64 num_buckets) {
+    auto digit = [min_dest, shift, num_buckets](const Msg& msg) {
+      const uint64 offset = static_cast<uint64>(GetDestId(msg)) -
+                            static_cast<uint64>(min_dest);
+      return (offset >> shift) % num_buckets;
+    };
+    offsets_.assign(num_buckets + 1, 0);
+    for (const Msg& msg : msgs) {
+      ++offsets_[digit(msg) + 1];
+    }
+    // Skip passes where every message shares the same digit.
+    if (std::any_of(offsets_.begin(), offsets_.end(),
+                    [&msgs](size_t count) { return count == msgs.size(); })) {
+      return;
+    }
+    for (size_t i = 1; i < offsets_.size(); ++i) {
+      offsets_[i] += offsets_[i - 1];
+    }
+    for (const Msg& msg : msgs) {
+      scratch_[offsets_[digit(msg)]++] = msg;
+    }
+    std::copy(scratch_.begin(), scratch_.begin() + msgs.size(), msgs.begin());
+  }
+
+  std::vector<Msg> scratch_;
+  std::vector<size_t> offsets_;
+};
+
+// Returns the RadixDestSorter owned by the calling thread.
+template <typename Msg>
+RadixDestSorter<Msg>& ThreadRadixDestSorter() {
+  thread_local RadixDestSorter<Msg> sorter;
+  return sorter;
+}
+
+// Sorts messages into the same order as SortByDest using a RadixDestSorter
+// owned by the calling thread.
+template <typename Msg>
+void RadixSortByDest(absl::Span<Msg> msgs) {
+  ThreadRadixDestSorter<Msg>().Sort(msgs);
+}
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_SORT_BY_DEST_H_
@@ -0,0 +1,126 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the comparison sort and radix sort message routing paths.  Each
+// benchmark sorts a batch of range(0) messages addressed to range(1)
+// consecutive destinations, which mirrors a single work chunk in the parallel
+// simulation (range(1) == 128) or a whole serial simulation.
+
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/sort_by_dest.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+std::vector<Visit> MakeVisits(const int num_msgs, const int num_dests) {
+  absl::BitGen gen;
+  std::vector<Visit> visits(num_msgs);
+  for (Visit& visit : visits) {
+    visit.location_uuid = absl::Uniform(gen, 0, num_dests);
+    visit.agent_uuid = absl::Uniform(gen, 0, 10 * num_dests);
+    visit.start_time =
+        absl::UnixEpoch() + absl::Minutes(absl::Uniform(gen, 0, 24 * 60));
+    visit.end_time = visit.start_time + absl::Hours(8);
+  }
+  return visits;
+}
+
+std::vector<InfectionOutcome> MakeOutcomes(const int num_msgs,
+                                           const int num_dests) {
+  absl::BitGen gen;
+  std::vector<InfectionOutcome> outcomes(num_msgs);
+  for (InfectionOutcome& outcome : outcomes) {
+    outcome.agent_uuid = absl::Uniform(gen, 0, num_dests);
+    outcome.source_uuid = absl::Uniform(gen, 0, num_dests);
+    outcome.exposure.start_time =
+        absl::UnixEpoch() + absl::Minutes(absl::Uniform(gen, 0, 24 * 60));
+  }
+  return outcomes;
+}
+
+std::vector<ContactReport> MakeReports(const int num_msgs,
+                                       const int num_dests) {
+  absl::BitGen gen;
+  std::vector<ContactReport> reports(num_msgs);
+  for (ContactReport& report : reports) {
+    report.to_agent_uuid = absl::Uniform(gen, 0, num_dests);
+    report.from_agent_uuid = absl::Uniform(gen, 0, num_dests);
+  }
+  return reports;
+}
+
+template <typename Msg, typename MakeFn, typename SortFn>
+void RunSortBenchmark(benchmark::State& state, MakeFn make, SortFn sort) {
+  const std::vector<Msg> input = make(state.range(0), state.range(1));
+  std::vector<Msg> msgs;
+  for (auto _ : state) {
+    state.PauseTiming();
+    msgs = input;
+    state.ResumeTiming();
+    sort(absl::MakeSpan(msgs));
+    benchmark::DoNotOptimize(msgs.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ComparisonSortVisits(benchmark::State& state) {
+  RunSortBenchmark<Visit>(state, MakeVisits, SortByDest<Visit>);
+}
+void BM_RadixSortVisits(benchmark::State& state) {
+  RunSortBenchmark<Visit>(state, MakeVisits, RadixSortByDest<Visit>);
+}
+void BM_ComparisonSortOutcomes(benchmark::State& state) {
+  RunSortBenchmark<InfectionOutcome>(state, MakeOutcomes,
+                                     SortByDest<InfectionOutcome>);
+}
+void BM_RadixSortOutcomes(benchmark::State& state) {
+  RunSortBenchmark<InfectionOutcome>(state, MakeOutcomes,
+                                     RadixSortByDest<InfectionOutcome>);
+}
+void BM_ComparisonSortReports(benchmark::State& state) {
+  RunSortBenchmark<ContactReport>(state, MakeReports,
+                                  SortByDest<ContactReport>);
+}
+void BM_RadixSortReports(benchmark::State& state) {
+  RunSortBenchmark<ContactReport>(state, MakeReports,
+                                  RadixSortByDest<ContactReport>);
+}
+
+void MessageVolumes(benchmark::internal::Benchmark* b) {
+  // A single chunk of 128 entities receiving ~7 messages each, up to a very
+  // busy chunk.
+  for (int num_msgs : {1 << 10, 1 << 14, 1 << 18}) {
+    b->Args({num_msgs, 128});
+  }
+  // All the messages for a whole simulation of 1M entities in one batch.
+  b->Args({1 << 23, 1 << 20});
+}
+
+BENCHMARK(BM_ComparisonSortVisits)->Apply(MessageVolumes);
+BENCHMARK(BM_RadixSortVisits)->Apply(MessageVolumes);
+BENCHMARK(BM_ComparisonSortOutcomes)->Apply(MessageVolumes);
+BENCHMARK(BM_RadixSortOutcomes)->Apply(MessageVolumes);
+BENCHMARK(BM_ComparisonSortReports)->Apply(MessageVolumes);
+BENCHMARK(BM_RadixSortReports)->Apply(MessageVolumes);
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,144 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/sort_by_dest.h"
+
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAreArray;
+
+std::vector<Visit> RandomVisits(const int n, const int64 first_dest,
+                                const int64 dest_stride, const int num_dests,
+                                absl::BitGen& gen) {
+  std::vector<Visit> visits;
+  for (int i = 0; i < n; ++i) {
+    const absl::Time start =
+        absl::UnixEpoch() + absl::Minutes(absl::Uniform(gen, 0, 24 * 60));
+    visits.push_back({
+        .location_uuid =
+            first_dest + dest_stride * absl::Uniform(gen, 0, num_dests),
+        .agent_uuid = absl::Uniform<int64>(gen, 0, 1000),
+        .start_time = start,
+        .end_time = start + absl::Hours(1),
+    });
+  }
+  return visits;
+}
+
+TEST(SortByDestTest, RadixSortMatchesComparisonSortForDenseDestinations) {
+  absl::BitGen gen;
+  std::vector<Visit> expected = RandomVisits(5000, 1000, 1, 128, gen);
+  std::vector<Visit> actual = expected;
+  SortByDest(absl::MakeSpan(expected));
+  RadixDestSorter<Visit> sorter;
+  sorter.Sort(absl::MakeSpan(actual));
+  EXPECT_THAT(actual, ElementsAreArray(expected));
+}
+
+TEST(SortByDestTest, RadixSortMatchesComparisonSortForSparseDestinations) {
+  absl::BitGen gen;
+  std::vector<Visit> expected =
+      RandomVisits(5000, int64{3} << 48, int64{1} << 20, 300, gen);
+  std::vector<Visit> actual = expected;
+  SortByDest(absl::MakeSpan(expected));
+  RadixDestSorter<Visit> sorter;
+  sorter.Sort(absl::MakeSpan(actual));
+  EXPECT_THAT(actual, ElementsAreArray(expected));
+}
+
+TEST(SortByDestTest, RadixSortMatchesComparisonSortForNegativeDestinations) {
+  absl::BitGen gen;
+  std::vector<Visit> expected = RandomVisits(1000, -500, 7, 200, gen);
+  std::vector<Visit> actual = expected;
+  SortByDest(absl::MakeSpan(expected));
+  RadixSortByDest(absl::MakeSpan(actual));
+  EXPECT_THAT(actual, ElementsAreArray(expected));
+}
+
+TEST(SortByDestTest, SortIntoMatchesComparisonSortOfConcatenation) {
+  absl::BitGen gen;
+  RadixDestSorter<Visit> sorter;
+  for (const int64 dest_stride : {int64{1}, int64{1} << 20}) {
+    const std::vector<Visit> segment1 =
+        RandomVisits(3000, 1000, dest_stride, 128, gen);
+    const std::vector<Visit> segment2 =
+        RandomVisits(2000, 1000, dest_stride, 128, gen);
+    std::vector<Visit> expected = segment1;
+    expected.insert(expected.end(), segment2.begin(), segment2.end());
+    SortByDest(absl::MakeSpan(expected));
+
+    std::vector<Visit> actual = {Visit{}};
+    sorter.SortInto({segment1, {}, segment2}, &actual);
+    EXPECT_THAT(actual, ElementsAreArray(expected)) << dest_stride;
+  }
+}
+
+TEST(SortByDestTest, RadixSortOrdersOutcomesAndReports) {
+  absl::BitGen gen;
+  std::vector<InfectionOutcome> outcomes;
+  std::vector<ContactReport> reports;
+  for (int i = 0; i < 2000; ++i) {
+    outcomes.push_back({
+        .agent_uuid = absl::Uniform<int64>(gen, 0, 100),
+        .exposure = {.start_time = absl::UnixEpoch() +
+                                   absl::Minutes(absl::Uniform(gen, 0, 600))},
+        .source_uuid = i,
+    });
+    reports.push_back({
+        .from_agent_uuid = absl::Uniform<int64>(gen, 0, 100000),
+        .to_agent_uuid = absl::Uniform<int64>(gen, 0, 100),
+    });
+  }
+
+  std::vector<InfectionOutcome> expected_outcomes = outcomes;
+  SortByDest(absl::MakeSpan(expected_outcomes));
+  RadixSortByDest(absl::MakeSpan(outcomes));
+  for (int i = 0; i < outcomes.size(); ++i) {
+    EXPECT_EQ(outcomes[i].agent_uuid, expected_outcomes[i].agent_uuid);
+    EXPECT_EQ(outcomes[i].exposure.start_time,
+              expected_outcomes[i].exposure.start_time);
+  }
+
+  std::vector<ContactReport> expected_reports = reports;
+  SortByDest(absl::MakeSpan(expected_reports));
+  RadixSortByDest(absl::MakeSpan(reports));
+  EXPECT_THAT(reports, ElementsAreArray(expected_reports));
+}
+
+TEST(SortByDestTest, HandlesTrivialInputs) {
+  std::vector<ContactReport> reports;
+  RadixSortByDest(absl::MakeSpan(reports));
+  EXPECT_TRUE(reports.empty());
+
+  reports = {{.from_agent_uuid = 3, .to_agent_uuid = 1},
+             {.from_agent_uuid = 2, .to_agent_uuid = 1}};
+  RadixSortByDest(absl::MakeSpan(reports));
+  EXPECT_EQ(reports[0].from_agent_uuid, 2);
+  EXPECT_EQ(reports[1].from_agent_uuid, 3);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,104 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/step_pipeline.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+
+StepPipeline::StepPipeline(
+    std::vector<absl::optional<std::vector<int>>> agent_chunk_locations,
+    const int num_location_chunks)
+    : agent_chunk_locations_(std::move(agent_chunk_locations)),
+      num_location_chunks_(num_location_chunks),
+      dependents_(agent_chunk_locations_.size()),
+      pending_(num_location_chunks) {
+  num_unbounded_ = std::count_if(
+      agent_chunk_locations_.begin(), agent_chunk_locations_.end(),
+      [](const auto& locations) { return !locations.has_value(); });
+}
+
+void StepPipeline::Start(const absl::Span<const int> location_chunks) {
+  absl::MutexLock l(&mu_);
+  DCHECK_EQ(unclaimed_location_chunks_, 0) << "Previous step is unfinished.";
+  std::fill(pending_.begin(), pending_.end(), num_unbounded_ > 0 ? 1 : 0);
+  for (int chunk = 0; chunk < agent_chunk_locations_.size(); ++chunk) {
+    std::vector<int>& dependents = dependents_[chunk];
+    dependents.clear();
+    if (!agent_chunk_locations_[chunk].has_value()) continue;
+    // Location chunks are contiguous, so sorted locations map to sorted chunks.
+    for (const int location : *agent_chunk_locations_[chunk]) {
+      const int location_chunk = location_chunks[location];
+      if (dependents.empty() || dependents.back() != location_chunk) {
+        dependents.push_back(location_chunk);
+        pending_[location_chunk]++;
+      }
+    }
+  }
+  ready_.clear();
+  for (int chunk = num_location_chunks_ - 1; chunk >= 0; --chunk) {
+    if (pending_[chunk] == 0) ready_.push_back(chunk);
+  }
+  next_agent_chunk_ = 0;
+  unfinished_agent_chunks_ = agent_chunk_locations_.size();
+  unfinished_unbounded_ = num_unbounded_;
+  unclaimed_location_chunks_ = num_location_chunks_;
+}
+
+bool StepPipeline::HasTask() const {
+  return !ready_.empty() ||
+         next_agent_chunk_ < agent_chunk_locations_.size() ||
+         unclaimed_location_chunks_ == 0;
+}
+
+StepPipeline::Task StepPipeline::Next() {
+  absl::MutexLock l(&mu_);
+  mu_.Await(absl::Condition(this, &StepPipeline::HasTask));
+  if (!ready_.empty()) {
+    const int chunk = ready_.back();
+    ready_.pop_back();
+    unclaimed_location_chunks_--;
+    return {.kind = Task::kLocations, .chunk = chunk};
+  }
+  if (next_agent_chunk_ < agent_chunk_locations_.size()) {
+    return {.kind = Task::kAgents, .chunk = next_agent_chunk_++};
+  }
+  return {.kind = Task::kDone, .chunk = -1};
+}
+
+void StepPipeline::Release(const int location_chunk) {
+  DCHECK_GT(pending_[location_chunk], 0);
+  if (--pending_[location_chunk] == 0) ready_.push_back(location_chunk);
+}
+
+bool StepPipeline::FinishAgents(const int chunk) {
+  absl::MutexLock l(&mu_);
+  for (const int location_chunk : dependents_[chunk]) {
+    Release(location_chunk);
+  }
+  if (!agent_chunk_locations_[chunk].has_value() &&
+      --unfinished_unbounded_ == 0) {
+    for (int location_chunk = num_location_chunks_ - 1; location_chunk >= 0;
+         --location_chunk) {
+      Release(location_chunk);
+    }
+  }
+  return --unfinished_agent_chunks_ == 0;
+}
+
+}  // namespace abesim
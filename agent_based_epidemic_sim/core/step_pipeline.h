@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_PIPELINE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_PIPELINE_H_
+
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+
+namespace abesim {
+
+// StepPipeline schedules the work chunks of a simulation step so that the
+// agent and location phases overlap.  A location chunk becomes ready as soon
+// as every agent chunk that may visit one of its locations has been processed,
+// rather than once all agent chunks have been processed.  Agent chunks that
+// cannot bound the locations they visit hold back every location chunk.
+//
+// Each step, call Start and then have every worker call Next until it returns
+// a kDone task, calling FinishAgents after processing each agent chunk.  Next
+// and FinishAgents may be called concurrently from any thread.
+class StepPipeline {
+ public:
+  struct Task {
+    enum Kind { kAgents, kLocations, kDone };
+    Kind kind;
+    int chunk;
+  };
+
+  // agent_chunk_locations holds, for each agent chunk, the sorted dense indices
+  // of the locations its agents may visit, or nullopt if they may visit any
+  // location.
+  StepPipeline(
+      std::vector<absl::optional<std::vector<int>>> agent_chunk_locations,
+      int num_location_chunks);
+
+  // Starts a step in which the location with dense index i belongs to location
+  // chunk location_chunks[i].  Location chunks must be contiguous ranges of
+  // dense indices.  All tasks of the previous step must have been handed out.
+  void Start(absl::Span<const int> location_chunks);
+
+  // Returns the next task, blocking while every remaining location chunk is
+  // waiting on agent chunks that other workers are processing.  Ready location
+  // chunks are handed out before agent chunks so their visits are consumed
+  // while they are still in cache.
+  Task Next();
+
+  // Marks an agent chunk returned by Next as processed.  All of its visits must
+  // have been sent.  Returns true if it was the last agent chunk of the step.
+  bool FinishAgents(int chunk);
+
+ private:
+  bool HasTask() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void Release(int location_chunk) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::vector<absl::optional<std::vector<int>>> agent_chunk_locations_;
+  const int num_location_chunks_;
+  // The number of agent chunks that cannot bound their locations.
+  int num_unbounded_ = 0;
+
+  absl::Mutex mu_;
+  // The location chunks that each agent chunk may visit this step.
+  std::vector<std::vector<int>> dependents_ ABSL_GUARDED_BY(mu_);
+  // The number of unprocessed agent chunks each location chunk waits on.
+  std::vector<int> pending_ ABSL_GUARDED_BY(mu_);
+  std::vector<int> ready_ ABSL_GUARDED_BY(mu_);
+  int next_agent_chunk_ ABSL_GUARDED_BY(mu_) = 0;
+  int unfinished_agent_chunks_ ABSL_GUARDED_BY(mu_) = 0;
+  int unfinished_unbounded_ ABSL_GUARDED_BY(mu_) = 0;
+  int unclaimed_location_chunks_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_PIPELINE_H_
@@ -0,0 +1,103 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/step_pipeline.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using Task = StepPipeline::Task;
+
+void ExpectTask(const Task& task, const Task::Kind kind, const int chunk) {
+  EXPECT_EQ(task.kind, kind);
+  EXPECT_EQ(task.chunk, chunk);
+}
+
+TEST(StepPipelineTest, ReleasesLocationsOnceTheirAgentsFinish) {
+  // Agent chunk 0 visits locations 0 and 1, agent chunk 1 visits locations 1
+  // and 2.  Location 3 is never visited.
+  StepPipeline pipeline({std::vector<int>{0, 1}, std::vector<int>{1, 2}}, 3);
+  // Locations 0 and 1 form chunk 0, locations 2 and 3 chunk 1, and so on.
+  const std::vector<int> location_chunks = {0, 0, 1, 2};
+  pipeline.Start(location_chunks);
+
+  ExpectTask(pipeline.Next(), Task::kLocations, 2);
+  ExpectTask(pipeline.Next(), Task::kAgents, 0);
+  EXPECT_FALSE(pipeline.FinishAgents(0));
+  ExpectTask(pipeline.Next(), Task::kAgents, 1);
+  EXPECT_TRUE(pipeline.FinishAgents(1));
+  ExpectTask(pipeline.Next(), Task::kLocations, 1);
+  ExpectTask(pipeline.Next(), Task::kLocations, 0);
+  ExpectTask(pipeline.Next(), Task::kDone, -1);
+}
+
+TEST(StepPipelineTest, PrefersReadyLocationsToAgents) {
+  StepPipeline pipeline({std::vector<int>{0}, std::vector<int>{1}}, 2);
+  const std::vector<int> location_chunks = {0, 1};
+  pipeline.Start(location_chunks);
+
+  ExpectTask(pipeline.Next(), Task::kAgents, 0);
+  EXPECT_FALSE(pipeline.FinishAgents(0));
+  ExpectTask(pipeline.Next(), Task::kLocations, 0);
+  ExpectTask(pipeline.Next(), Task::kAgents, 1);
+  EXPECT_TRUE(pipeline.FinishAgents(1));
+  ExpectTask(pipeline.Next(), Task::kLocations, 1);
+  ExpectTask(pipeline.Next(), Task::kDone, -1);
+}
+
+TEST(StepPipelineTest, UnboundedAgentsHoldBackAllLocations) {
+  StepPipeline pipeline({std::vector<int>{0}, absl::nullopt}, 2);
+  const std::vector<int> location_chunks = {0, 1};
+  pipeline.Start(location_chunks);
+
+  ExpectTask(pipeline.Next(), Task::kAgents, 0);
+  EXPECT_FALSE(pipeline.FinishAgents(0));
+  ExpectTask(pipeline.Next(), Task::kAgents, 1);
+  EXPECT_TRUE(pipeline.FinishAgents(1));
+  ExpectTask(pipeline.Next(), Task::kLocations, 0);
+  ExpectTask(pipeline.Next(), Task::kLocations, 1);
+  ExpectTask(pipeline.Next(), Task::kDone, -1);
+}
+
+TEST(StepPipelineTest, FollowsLocationChunksAcrossSteps) {
+  StepPipeline pipeline({std::vector<int>{0}, std::vector<int>{1}}, 2);
+  std::vector<int> location_chunks = {0, 1};
+  pipeline.Start(location_chunks);
+  ExpectTask(pipeline.Next(), Task::kAgents, 0);
+  pipeline.FinishAgents(0);
+  ExpectTask(pipeline.Next(), Task::kLocations, 0);
+  ExpectTask(pipeline.Next(), Task::kAgents, 1);
+  pipeline.FinishAgents(1);
+  ExpectTask(pipeline.Next(), Task::kLocations, 1);
+  ExpectTask(pipeline.Next(), Task::kDone, -1);
+
+  // Both locations now belong to chunk 0, so chunk 1 is free immediately and
+  // chunk 0 waits for both agent chunks.
+  location_chunks = {0, 0};
+  pipeline.Start(location_chunks);
+  ExpectTask(pipeline.Next(), Task::kLocations, 1);
+  ExpectTask(pipeline.Next(), Task::kAgents, 0);
+  pipeline.FinishAgents(0);
+  ExpectTask(pipeline.Next(), Task::kAgents, 1);
+  pipeline.FinishAgents(1);
+  ExpectTask(pipeline.Next(), Task::kLocations, 0);
+  ExpectTask(pipeline.Next(), Task::kDone, -1);
+}
+
+}  // namespace
+}  // namespace abesim
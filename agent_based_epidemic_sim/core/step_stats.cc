@@ -0,0 +1,107 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/step_stats.h"
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+
+namespace abesim {
+namespace {
+
+int64 Micros(const absl::Duration d) { return absl::ToInt64Microseconds(d); }
+
+template <typename Field>
+std::vector<int64> WorkerMicros(const StepStats& stats, Field field) {
+  std::vector<int64> micros;
+  micros.reserve(stats.workers.size());
+  for (const WorkerStats& worker : stats.workers) {
+    micros.push_back(Micros(worker.*field));
+  }
+  return micros;
+}
+
+}  // namespace
+
+void StepStats::SumWorkers() {
+  for (const WorkerStats& worker : workers) {
+    sort += worker.sort;
+    broker_send += worker.broker_send;
+    broker_consume += worker.broker_consume;
+    visits += worker.visits;
+    infection_outcomes += worker.infection_outcomes;
+    contact_reports += worker.contact_reports;
+  }
+}
+
+std::string StepStatsCsvHeader() {
+  return "time,agent_phase_us,location_phase_us,sort_us,broker_send_us,"
+         "broker_consume_us,observer_aggregation_us,distributed_flush_us,"
+         "visits,infection_outcomes,contact_reports,worker_busy_us,"
+         "worker_idle_us";
+}
+
+std::string StepStatsToCsv(const StepStats& stats) {
+  return absl::StrCat(
+      absl::ToUnixSeconds(stats.time), ",", Micros(stats.agent_phase), ",",
+      Micros(stats.location_phase), ",", Micros(stats.sort), ",",
+      Micros(stats.broker_send), ",", Micros(stats.broker_consume), ",",
+      Micros(stats.observer_aggregation), ",", Micros(stats.distributed_flush),
+      ",", stats.visits, ",", stats.infection_outcomes, ",",
+      stats.contact_reports, ",",
+      absl::StrJoin(WorkerMicros(stats, &WorkerStats::busy), ";"), ",",
+      absl::StrJoin(WorkerMicros(stats, &WorkerStats::idle), ";"));
+}
+
+std::string StepStatsToJson(const StepStats& stats) {
+  return absl::StrCat(
+      "{\"time\":", absl::ToUnixSeconds(stats.time),
+      ",\"agent_phase_us\":", Micros(stats.agent_phase),
+      ",\"location_phase_us\":", Micros(stats.location_phase),
+      ",\"sort_us\":", Micros(stats.sort),
+      ",\"broker_send_us\":", Micros(stats.broker_send),
+      ",\"broker_consume_us\":", Micros(stats.broker_consume),
+      ",\"observer_aggregation_us\":", Micros(stats.observer_aggregation),
+      ",\"distributed_flush_us\":", Micros(stats.distributed_flush),
+      ",\"visits\":", stats.visits,
+      ",\"infection_outcomes\":", stats.infection_outcomes,
+      ",\"contact_reports\":", stats.contact_reports, ",\"worker_busy_us\":[",
+      absl::StrJoin(WorkerMicros(stats, &WorkerStats::busy), ","),
+      "],\"worker_idle_us\":[",
+      absl::StrJoin(WorkerMicros(stats, &WorkerStats::idle), ","), "]}");
+}
+
+StepStatsWriter::StepStatsWriter(file::FileWriter* const output,
+                                 const Format format)
+    : output_(output), format_(format) {}
+
+void StepStatsWriter::Write(const StepStats& stats) {
+  if (!status_.ok()) return;
+  std::string line;
+  switch (format_) {
+    case Format::kCsv:
+      if (!wrote_header_) {
+        absl::StrAppend(&line, StepStatsCsvHeader(), "\n");
+        wrote_header_ = true;
+      }
+      absl::StrAppend(&line, StepStatsToCsv(stats), "\n");
+      break;
+    case Format::kJson:
+      absl::StrAppend(&line, StepStatsToJson(stats), "\n");
+      break;
+  }
+  status_ = output_->WriteString(line);
+}
+
+}  // namespace abesim
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_STATS_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_STATS_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+
+namespace abesim {
+
+// Timings and counters for a single worker thread over both phases of a step.
+// Each worker only updates its own WorkerStats, so no synchronization is
+// needed.
+struct WorkerStats {
+  // Time spent processing work chunks, including flushing brokers.
+  absl::Duration busy;
+  // Time spent inside a phase waiting for other workers to finish.
+  absl::Duration idle;
+  // Portions of busy time spent sorting received messages, sending messages
+  // and consuming received messages from the brokers.  Work queue brokers sort
+  // messages as they gather them from worker outboxes, which is counted as
+  // sorting.
+  absl::Duration sort;
+  absl::Duration broker_send;
+  absl::Duration broker_consume;
+  // Number of messages of each type sent by entities run on this worker.
+  int64 visits = 0;
+  int64 infection_outcomes = 0;
+  int64 contact_reports = 0;
+};
+
+// Timings and counters for a single simulation step.  Phase, aggregation and
+// flush times are wall times.  Sort, send and consume times are summed over
+// all workers, and so may exceed the wall time of the phase they occur in.
+struct StepStats {
+  // The start of the timestep that was simulated.
+  absl::Time time;
+  absl::Duration agent_phase;
+  absl::Duration location_phase;
+  absl::Duration sort;
+  absl::Duration broker_send;
+  absl::Duration broker_consume;
+  // Time the step waited on observer aggregation, which otherwise runs in
+  // the background.
+  absl::Duration observer_aggregation;
+  // Time spent exchanging messages with distributed nodes.  This is part of
+  // the phase times.
+  absl::Duration distributed_flush;
+  int64 visits = 0;
+  int64 infection_outcomes = 0;
+  int64 contact_reports = 0;
+  std::vector<WorkerStats> workers;
+
+  // Adds the per worker sort, send and consume times and message counts into
+  // the step totals.  Called once when the step completes.
+  void SumWorkers();
+};
+
+// Adds the time between its construction and destruction to a duration.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(absl::Duration* const total)
+      : total_(total), start_(absl::Now()) {}
+  ~ScopedTimer() { *total_ += absl::Now() - start_; }
+
+ private:
+  absl::Duration* const total_;
+  const absl::Time start_;
+};
+
+// A Broker that forwards to another broker, adding the time spent sending to
+// send_time and the number of messages sent to count.
+template <typename Msg>
+class TimedBroker : public Broker<Msg> {
+ public:
+  TimedBroker(Broker<Msg>* const receiver, absl::Duration* const send_time,
+              int64* const count)
+      : receiver_(receiver), send_time_(send_time), count_(count) {}
+
+  void Send(const absl::Span<const Msg> msgs) override {
+    ScopedTimer timer(send_time_);
+    receiver_->Send(msgs);
+    *count_ += msgs.size();
+  }
+
+ private:
+  Broker<Msg>* const receiver_;
+  absl::Duration* const send_time_;
+  int64* const count_;
+};
+
+// Writes StepStats to a file, one line per step.
+class StepStatsWriter {
+ public:
+  enum class Format {
+    // Comma separated values with a header line.
+    kCsv,
+    // One JSON object per line.
+    kJson,
+  };
+
+  StepStatsWriter(file::FileWriter* output, Format format);
+
+  void Write(const StepStats& stats);
+
+  // Returns the first error encountered while writing, if any.
+  absl::Status status() const { return status_; }
+
+ private:
+  file::FileWriter* const output_;
+  const Format format_;
+  bool wrote_header_ = false;
+  absl::Status status_;
+};
+
+// Formats stats as a single CSV line without a trailing newline.  Durations
+// are in microseconds.  Per worker busy and idle times are each written as a
+// semicolon separated list in a single column.
+std::string StepStatsCsvHeader();
+std::string StepStatsToCsv(const StepStats& stats);
+
+// Formats stats as a single line JSON object without a trailing newline.
+// Durations are in microseconds.
+std::string StepStatsToJson(const StepStats& stats);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_STATS_H_
@@ -0,0 +1,141 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/step_stats.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+class StringFileWriter : public file::FileWriter {
+ public:
+  absl::Status WriteString(absl::string_view content) override {
+    absl::StrAppend(&contents_, content);
+    return absl::OkStatus();
+  }
+  absl::Status Flush() override { return absl::OkStatus(); }
+  absl::Status Close() override { return absl::OkStatus(); }
+
+  const std::string& contents() const { return contents_; }
+
+ private:
+  std::string contents_;
+};
+
+class CollectingBroker : public Broker<Visit> {
+ public:
+  void Send(absl::Span<const Visit> visits) override {
+    visits_.insert(visits_.end(), visits.begin(), visits.end());
+  }
+  const std::vector<Visit>& visits() const { return visits_; }
+
+ private:
+  std::vector<Visit> visits_;
+};
+
+StepStats MakeStats() {
+  StepStats stats;
+  stats.time = absl::FromUnixSeconds(86400);
+  stats.agent_phase = absl::Milliseconds(20);
+  stats.location_phase = absl::Milliseconds(30);
+  stats.broker_consume = absl::Microseconds(5);
+  stats.observer_aggregation = absl::Milliseconds(2);
+  stats.workers.resize(2);
+  stats.workers[0] = {.busy = absl::Milliseconds(45),
+                      .idle = absl::Milliseconds(5),
+                      .sort = absl::Microseconds(100),
+                      .broker_send = absl::Microseconds(40),
+                      .broker_consume = absl::Microseconds(10),
+                      .visits = 7,
+                      .infection_outcomes = 3,
+                      .contact_reports = 1};
+  stats.workers[1] = {.busy = absl::Milliseconds(50),
+                      .sort = absl::Microseconds(200),
+                      .broker_send = absl::Microseconds(60),
+                      .broker_consume = absl::Microseconds(20),
+                      .visits = 2,
+                      .contact_reports = 4};
+  stats.SumWorkers();
+  return stats;
+}
+
+TEST(StepStatsTest, SumsWorkers) {
+  const StepStats stats = MakeStats();
+  EXPECT_EQ(stats.sort, absl::Microseconds(300));
+  EXPECT_EQ(stats.broker_send, absl::Microseconds(100));
+  EXPECT_EQ(stats.broker_consume, absl::Microseconds(35));
+  EXPECT_EQ(stats.visits, 9);
+  EXPECT_EQ(stats.infection_outcomes, 3);
+  EXPECT_EQ(stats.contact_reports, 5);
+}
+
+TEST(StepStatsTest, TimedBrokerForwardsAndCounts) {
+  CollectingBroker receiver;
+  absl::Duration send_time;
+  int64 count = 0;
+  TimedBroker<Visit> broker(&receiver, &send_time, &count);
+  broker.Send({{.location_uuid = 1}, {.location_uuid = 2}});
+  broker.Send({{.location_uuid = 3}});
+  EXPECT_EQ(receiver.visits().size(), 3);
+  EXPECT_EQ(count, 3);
+  EXPECT_GE(send_time, absl::ZeroDuration());
+}
+
+TEST(StepStatsTest, FormatsCsv) {
+  EXPECT_EQ(StepStatsToCsv(MakeStats()),
+            "86400,20000,30000,300,100,35,2000,0,9,3,5,45000;50000,5000;0");
+}
+
+TEST(StepStatsTest, FormatsJson) {
+  EXPECT_EQ(StepStatsToJson(MakeStats()),
+            "{\"time\":86400,\"agent_phase_us\":20000,"
+            "\"location_phase_us\":30000,\"sort_us\":300,"
+            "\"broker_send_us\":100,\"broker_consume_us\":35,"
+            "\"observer_aggregation_us\":2000,\"distributed_flush_us\":0,"
+            "\"visits\":9,\"infection_outcomes\":3,\"contact_reports\":5,"
+            "\"worker_busy_us\":[45000,50000],\"worker_idle_us\":[5000,0]}");
+}
+
+TEST(StepStatsTest, WritesCsvHeaderOnce) {
+  StringFileWriter output;
+  StepStatsWriter writer(&output, StepStatsWriter::Format::kCsv);
+  writer.Write(MakeStats());
+  writer.Write(MakeStats());
+  PANDEMIC_ASSERT_OK(writer.status());
+  const std::string line = StepStatsToCsv(MakeStats());
+  EXPECT_EQ(output.contents(), absl::StrCat(StepStatsCsvHeader(), "\n", line,
+                                            "\n", line, "\n"));
+}
+
+TEST(StepStatsTest, WritesJsonLines) {
+  StringFileWriter output;
+  StepStatsWriter writer(&output, StepStatsWriter::Format::kJson);
+  writer.Write(MakeStats());
+  writer.Write(MakeStats());
+  PANDEMIC_ASSERT_OK(writer.status());
+  const std::string line = StepStatsToJson(MakeStats());
+  EXPECT_EQ(output.contents(), absl::StrCat(line, "\n", line, "\n"));
+}
+
+}  // namespace
+}  // namespace abesim
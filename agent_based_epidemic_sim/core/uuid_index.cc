@@ -0,0 +1,49 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/uuid_index.h"
+
+#include <algorithm>
+
+namespace abesim {
+namespace {
+
+// The largest ratio of uuid range to uuid count for which we use a flat array.
+const int kMaxDenseRangeFactor = 4;
+
+}  // namespace
+
+UuidIndex::UuidIndex(const absl::Span<const int64> uuids)
+    : size_(uuids.size()) {
+  if (uuids.empty()) return;
+  const auto [min_iter, max_iter] =
+      std::minmax_element(uuids.begin(), uuids.end());
+  min_uuid_ = *min_iter;
+  const uint64 span =
+      static_cast<uint64>(*max_iter) - static_cast<uint64>(min_uuid_);
+  if (span < kMaxDenseRangeFactor * static_cast<uint64>(uuids.size())) {
+    is_dense_ = true;
+    dense_.assign(span + 1, -1);
+    for (int i = 0; i < uuids.size(); ++i) {
+      dense_[uuids[i] - min_uuid_] = i;
+    }
+  } else {
+    sparse_.reserve(uuids.size());
+    for (int i = 0; i < uuids.size(); ++i) {
+      sparse_[uuids[i]] = i;
+    }
+  }
+}
+
+}  // namespace abesim
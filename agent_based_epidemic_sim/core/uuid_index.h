@@ -0,0 +1,62 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_UUID_INDEX_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_UUID_INDEX_H_
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// UuidIndex maps a fixed set of entity uuids onto the dense index space
+// [0, size()), where the i'th uuid given at construction has index i.
+//
+// Uuids handed out by a UuidGenerator are mostly consecutive, so when the
+// uuids span a range not much larger than their count the index is a flat
+// array keyed by the offset from the smallest uuid and a lookup is a single
+// array access.  Otherwise it falls back to a hash map.
+class UuidIndex {
+ public:
+  explicit UuidIndex(absl::Span<const int64> uuids);
+
+  // Returns the dense index of the given uuid, or -1 if it is not indexed.
+  int Find(int64 uuid) const {
+    if (is_dense_) {
+      const uint64 offset =
+          static_cast<uint64>(uuid) - static_cast<uint64>(min_uuid_);
+      return offset < dense_.size() ? dense_[offset] : -1;
+    }
+    auto iter = sparse_.find(uuid);
+    return iter == sparse_.end() ? -1 : iter->second;
+  }
+
+  int size() const { return size_; }
+
+ private:
+  int size_ = 0;
+  bool is_dense_ = false;
+  int64 min_uuid_ = 0;
+  std::vector<int32> dense_;
+  absl::flat_hash_map<int64, int> sparse_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_UUID_INDEX_H_
@@ -0,0 +1,64 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/uuid_index.h"
+
+#include <vector>
+
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+TEST(UuidIndexTest, FindsDenseUuids) {
+  const std::vector<int64> uuids = {10, 12, 11, 15, 13};
+  UuidIndex index(uuids);
+  EXPECT_EQ(index.size(), uuids.size());
+  for (int i = 0; i < uuids.size(); ++i) {
+    EXPECT_EQ(index.Find(uuids[i]), i);
+  }
+  EXPECT_EQ(index.Find(14), -1);
+  EXPECT_EQ(index.Find(9), -1);
+  EXPECT_EQ(index.Find(16), -1);
+  EXPECT_EQ(index.Find(-10), -1);
+}
+
+TEST(UuidIndexTest, FindsShardedUuids) {
+  const int64 shard = int64{7} << 48;
+  const std::vector<int64> uuids = {shard | 3, shard | 1, shard | 2};
+  UuidIndex index(uuids);
+  EXPECT_EQ(index.Find(shard | 3), 0);
+  EXPECT_EQ(index.Find(shard | 1), 1);
+  EXPECT_EQ(index.Find(shard | 2), 2);
+  EXPECT_EQ(index.Find(3), -1);
+}
+
+TEST(UuidIndexTest, FindsSparseUuids) {
+  const std::vector<int64> uuids = {-5, int64{1} << 40, 3, kint64max, kint64min};
+  UuidIndex index(uuids);
+  for (int i = 0; i < uuids.size(); ++i) {
+    EXPECT_EQ(index.Find(uuids[i]), i);
+  }
+  EXPECT_EQ(index.Find(4), -1);
+}
+
+TEST(UuidIndexTest, HandlesEmptyIndex) {
+  UuidIndex index({});
+  EXPECT_EQ(index.size(), 0);
+  EXPECT_EQ(index.Find(0), -1);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -17,7 +17,10 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_VISIT_GENERATOR_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_VISIT_GENERATOR_H_
 
+#include <vector>
+
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/core/visit.h"
@@ -30,6 +33,12 @@ class VisitGenerator {
   virtual void GenerateVisits(const Timestep& timestep,
                               const RiskScore& risk_score,
                               std::vector<Visit>* visits) = 0;
+  // Appends to location_uuids the uuid of every location this generator may
+  // ever generate visits to and returns true, or returns false if there is no
+  // such bound.
+  virtual bool GetPossibleLocations(std::vector<int64>* location_uuids) const {
+    return false;
+  }
   virtual ~VisitGenerator() = default;
 };
 
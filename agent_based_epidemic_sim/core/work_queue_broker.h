@@ -0,0 +1,436 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_WORK_QUEUE_BROKER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_WORK_QUEUE_BROKER_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/fixed_array.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/compact_message.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/sort_by_dest.h"
+#include "agent_based_epidemic_sim/core/uuid_index.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+
+// The Chunker helps divide a list of entities, and messages destined for those
+// entities, into chunks of work.  Initially the first chunk_size entities
+// and messages targeted at them goin in the first chunk and so on.  Chunks are
+// always contiguous ranges of entities, but Rebalance may later move the
+// boundaries between them so that each chunk carries a similar amount of work.
+// Entity uuids are mapped once to a dense index, so finding the chunk for a
+// message is an index lookup rather than a hash probe.  Entities must be
+// ordered by uuid, so that dense indices are too.
+template <typename Entity>
+class Chunker {
+ public:
+  Chunker(const absl::Span<const std::unique_ptr<Entity>> entities,
+          const int chunk_size)
+      : entities_(entities),
+        chunks_((entities.size() + chunk_size - 1) / chunk_size),
+        uuids_(Uuids(entities)),
+        index_(uuids_),
+        chunk_of_(entities.size()) {
+    DCHECK(std::is_sorted(uuids_.begin(), uuids_.end()))
+        << "Entities must be ordered by uuid.";
+    std::vector<int> ends;
+    for (int chunk = 0; chunk < chunks_.size(); ++chunk) {
+      ends.push_back(std::min<int>((chunk + 1) * chunk_size, entities.size()));
+    }
+    SetChunkEnds(ends);
+  }
+
+  template <typename Msg>
+  int Chunk(const Msg& msg) const {
+    const int idx = index_.Find(GetDestId(msg));
+    DCHECK_GE(idx, 0) << "Message found for unknown entity.";
+    return chunk_of_[idx];
+  }
+  absl::Span<const absl::Span<const std::unique_ptr<Entity>>> Chunks() const {
+    return chunks_;
+  }
+
+  // Returns the dense index of the entity with the given uuid, or -1 if there
+  // is no such entity.  Dense indices follow the order of the entities and
+  // never change.
+  int Index(const int64 uuid) const { return index_.Find(uuid); }
+  // Returns the uuid of the entity with the given dense index.
+  int64 Uuid(const int index) const { return uuids_[index]; }
+  // Returns the chunk that each entity currently belongs to, by dense index.
+  absl::Span<const int> EntityChunks() const { return chunk_of_; }
+
+  // Records the messages that entities in a single chunk received this step.
+  // This may be called concurrently for distinct chunks.
+  template <typename Msg>
+  void RecordLoad(const absl::Span<const Msg> msgs) {
+    if (load_.empty()) return;
+    for (const Msg& msg : msgs) {
+      load_[index_.Find(GetDestId(msg))]++;
+    }
+  }
+
+  // Moves the chunk boundaries so that each chunk has roughly the same
+  // estimated cost, where the cost of an entity is cost_fn applied to the
+  // number of messages it received since the last call to Rebalance.  The
+  // number of chunks does not change.  This must not be called while any
+  // messages routed by this chunker are waiting to be consumed.
+  void Rebalance(const std::function<double(int64)>& cost_fn) {
+    if (chunks_.empty()) return;
+    if (load_.empty()) {
+      // Start recording load now, we'll rebalance on the next call.
+      load_.resize(entities_.size());
+      return;
+    }
+    std::vector<double> cost(entities_.size());
+    double total_cost = 0;
+    for (int i = 0; i < entities_.size(); ++i) {
+      cost[i] = cost_fn(load_[i]);
+      total_cost += cost[i];
+      load_[i] = 0;
+    }
+
+    // Greedily cut a chunk once it reaches its share of the remaining cost,
+    // leaving at least one entity for every remaining chunk.
+    std::vector<int> ends;
+    int idx = 0;
+    for (int chunk = 0; chunk < chunks_.size(); ++chunk) {
+      const int chunks_left = chunks_.size() - chunk;
+      const double target = total_cost / chunks_left;
+      const int last_end = entities_.size() - (chunks_left - 1);
+      double chunk_cost = cost[idx++];
+      while (idx < last_end &&
+             (chunks_left == 1 || chunk_cost + cost[idx] / 2 < target)) {
+        chunk_cost += cost[idx++];
+      }
+      total_cost -= chunk_cost;
+      ends.push_back(idx);
+    }
+    DCHECK_EQ(ends.back(), entities_.size());
+    SetChunkEnds(ends);
+  }
+
+ private:
+  static std::vector<int64> Uuids(
+      const absl::Span<const std::unique_ptr<Entity>> entities) {
+    std::vector<int64> uuids;
+    uuids.reserve(entities.size());
+    for (const auto& entity : entities) {
+      uuids.push_back(entity->uuid());
+    }
+    return uuids;
+  }
+
+  void SetChunkEnds(const absl::Span<const int> ends) {
+    int begin = 0;
+    for (int chunk = 0; chunk < chunks_.size(); ++chunk) {
+      chunks_[chunk] = entities_.subspan(begin, ends[chunk] - begin);
+      std::fill(chunk_of_.begin() + begin, chunk_of_.begin() + ends[chunk],
+                chunk);
+      begin = ends[chunk];
+    }
+  }
+
+  const absl::Span<const std::unique_ptr<Entity>> entities_;
+  absl::FixedArray<absl::Span<const std::unique_ptr<Entity>>> chunks_;
+  // The uuid of each entity, by dense index.
+  const std::vector<int64> uuids_;
+  UuidIndex index_;
+  // The chunk of each entity, by dense index.
+  std::vector<int> chunk_of_;
+  // The number of messages received by each entity since the last Rebalance,
+  // by dense index.  Empty when load is not being recorded.
+  std::vector<int64> load_;
+};
+
+// ChunkedMessages is a set of consumed messages grouped by the work chunk of
+// their destination.
+template <typename Msg>
+class ChunkedMessages {
+ public:
+  // Returns the messages destined for entities in the given chunk, sorted as
+  // by SortByDest.  Chunk should be called at most once for each chunk, but
+  // calls for different chunks may be made concurrently from different
+  // threads.
+  virtual absl::Span<Msg> Chunk(int chunk) = 0;
+
+  virtual ~ChunkedMessages() = default;
+};
+
+// The default Codec of WorkQueueBroker, which holds messages as they are sent.
+template <typename Msg>
+struct UncompressedCodec {
+  using Compact = Msg;
+};
+
+// WorkQueueBroker accumulates messages, grouped by the chunk of their
+// destination, which can be consumed via the Consume method.  It can receive
+// Send calls from any thread.
+//
+// Worker threads should instead send through their own Outbox.  Each outbox
+// keeps a buffer per destination chunk that only its worker writes to, so
+// sends from workers never contend.  When a chunk is consumed its buffers are
+// not concatenated and then sorted: messages are copied once, from each
+// buffer straight to their sorted position in a gathered buffer that the
+// consumer borrows until the messages are deleted.  A chunk with a single
+// buffer of messages is sorted in place and handed over without a copy.
+//
+// With MessageCodec<Msg> as the Codec, buffered messages are instead held in
+// their compact encoding, relative to the broker's epoch, and decoded as they
+// are gathered.  This halves the memory held by the broker, but rounds times
+// to whole seconds (see compact_message.h), so is not the default.
+template <typename Entity, typename Msg,
+          typename Codec = UncompressedCodec<Msg>>
+class WorkQueueBroker : public Broker<Msg> {
+ private:
+  using Compact = typename Codec::Compact;
+  static constexpr bool kCompact =
+      !std::is_same<Codec, UncompressedCodec<Msg>>::value;
+
+  class Consumed : public ChunkedMessages<Msg> {
+   public:
+    explicit Consumed(WorkQueueBroker* const broker) : broker_(broker) {}
+    absl::Span<Msg> Chunk(const int chunk) override {
+      return broker_->Gather(chunk);
+    }
+
+   private:
+    WorkQueueBroker* const broker_;
+  };
+  struct Deleter {
+    void operator()(ChunkedMessages<Msg>* const msgs) { broker->Delete(msgs); }
+    WorkQueueBroker* const broker;
+  };
+  virtual void Delete(ChunkedMessages<Msg>* const msgs) {
+    absl::MutexLock l(&mu_);
+    DCHECK_EQ(msgs, &consumed_);
+    std::for_each(consume_.begin(), consume_.end(), [](auto& v) { v.clear(); });
+    std::for_each(gathered_.begin(), gathered_.end(),
+                  [](auto& v) { v.clear(); });
+    for (auto& outbox : outbox_consume_) {
+      std::for_each(outbox.begin(), outbox.end(), [](auto& v) { v.clear(); });
+    }
+    // We are using swapping buffers so we're always reading from one
+    // buffer and writing to another one.  For most of our message types
+    // we don't read and write at the same time.  In that case we swap back
+    // to using the buffer we consumed for the next round of sends to avoid
+    // allocating any memory in the alternate buffer.  Otherwise we'll swap
+    // back at the next call to Consume.
+    if (!sent_msgs_) send_.swap(consume_);
+    if (std::none_of(outboxes_.begin(), outboxes_.end(),
+                     [](const Outbox* outbox) { return outbox->sent_msgs_; })) {
+      outbox_send_.swap(outbox_consume_);
+    }
+  }
+
+ public:
+  // A Broker for the exclusive use of a single worker thread.  Sends to an
+  // Outbox take no locks, but an Outbox must not be used concurrently with
+  // itself or with Consume.
+  class Outbox : public Broker<Msg> {
+   public:
+    void Send(const absl::Span<const Msg> msgs) override {
+      broker_->Encode(msgs, broker_->outbox_send_[worker_]);
+      if (!msgs.empty() && !sent_msgs_) sent_msgs_ = true;
+    }
+    // Messages are never buffered outside the broker, so there is nothing to
+    // flush.  This exists so an Outbox may stand in for a BufferingBroker.
+    void Flush() {}
+
+   private:
+    friend class WorkQueueBroker;
+    Outbox(WorkQueueBroker* const broker, const int worker)
+        : broker_(broker), worker_(worker) {}
+
+    WorkQueueBroker* const broker_;
+    const int worker_;
+    bool sent_msgs_ = false;
+  };
+
+  // With a compact Codec, times are encoded relative to epoch, which should be
+  // near the times of the messages sent.
+  explicit WorkQueueBroker(const Chunker<Entity>& chunker,
+                           const absl::Time epoch = absl::UnixEpoch())
+      : chunker_(chunker),
+        epoch_(epoch),
+        consumed_(this),
+        send_(chunker.Chunks().size()),
+        consume_(chunker.Chunks().size()),
+        gathered_(chunker.Chunks().size()) {}
+  void Send(const absl::Span<const Msg> msgs) override {
+    absl::MutexLock l(&mu_);
+    Encode(msgs, send_);
+    sent_msgs_ = true;
+  }
+  // Creates a new Outbox for a worker thread.  The outbox must not outlive
+  // the broker, and NewOutbox must not be called concurrently with any other
+  // method.
+  std::unique_ptr<Outbox> NewOutbox() {
+    outbox_send_.emplace_back(chunker_.Chunks().size());
+    outbox_consume_.emplace_back(chunker_.Chunks().size());
+    outboxes_.push_back(new Outbox(this, outboxes_.size()));
+    return absl::WrapUnique(outboxes_.back());
+  }
+
+  struct ChunkDeleter {
+    void operator()(std::vector<Msg>* const msgs) { msgs->clear(); }
+  };
+  // Consumes the messages sent so far to a single chunk, while other chunks
+  // may still be receiving messages.  The caller must ensure that every
+  // message for the chunk has been sent, and that those sends happen before
+  // this call.  This must not be mixed with Consume for the same messages.
+  // The messages are sorted as by SortByDest.
+  std::unique_ptr<std::vector<Msg>, ChunkDeleter> ConsumeChunk(
+      const int chunk) {
+    std::vector<Compact>& sent = consume_[chunk];
+    DCHECK(sent.empty());
+    {
+      absl::MutexLock l(&mu_);
+      sent.swap(send_[chunk]);
+    }
+    std::vector<Msg>& msgs = gathered_[chunk];
+    DCHECK(msgs.empty());
+    SortedGather(sent, outbox_send_, chunk, msgs);
+    return std::unique_ptr<std::vector<Msg>, ChunkDeleter>(&msgs);
+  }
+
+  // Returns the number of messages sent but not yet consumed.  This is slow,
+  // and intended for consistency checks.
+  int64 PendingMessages() {
+    auto count = [](const auto& buffers) {
+      int64 count = 0;
+      for (const auto& msgs : buffers) count += msgs.size();
+      return count;
+    };
+    absl::MutexLock l(&mu_);
+    int64 pending = count(send_) + count(consume_) + count(gathered_);
+    for (const auto& outbox : outbox_send_) pending += count(outbox);
+    for (const auto& outbox : outbox_consume_) pending += count(outbox);
+    return pending;
+  }
+
+  virtual std::unique_ptr<ChunkedMessages<Msg>, Deleter> Consume() {
+    absl::MutexLock l(&mu_);
+    DCHECK(std::all_of(consume_.begin(), consume_.end(),
+                       [](const auto& v) { return v.empty(); }));
+    sent_msgs_ = false;
+    consume_.swap(send_);
+    for (Outbox* outbox : outboxes_) outbox->sent_msgs_ = false;
+    outbox_consume_.swap(outbox_send_);
+    return {&consumed_, {this}};
+  }
+
+ private:
+  // Collects the messages sent to the given chunk, sorted, into
+  // gathered_[chunk].  This only touches buffers belonging to the given chunk,
+  // so may be called concurrently for distinct chunks.
+  absl::Span<Msg> Gather(const int chunk) {
+    std::vector<Msg>& msgs = gathered_[chunk];
+    SortedGather(consume_[chunk], outbox_consume_, chunk, msgs);
+    return absl::MakeSpan(msgs);
+  }
+
+  // Appends the encoding of each message to the buffer of its chunk.
+  void Encode(const absl::Span<const Msg> msgs,
+              std::vector<std::vector<Compact>>& buffers) const {
+    if constexpr (kCompact) {
+      const absl::Span<const int> chunk_of = chunker_.EntityChunks();
+      for (const Msg& msg : msgs) {
+        const int index = chunker_.Index(GetDestId(msg));
+        DCHECK_GE(index, 0) << "Message found for unknown entity.";
+        buffers[chunk_of[index]].push_back(Codec::Encode(msg, index, epoch_));
+      }
+    } else {
+      for (const Msg& msg : msgs) buffers[chunker_.Chunk(msg)].push_back(msg);
+    }
+  }
+
+  // Moves the messages in sent and in the given chunk of the outbox buffers to
+  // msgs, decoded and sorted by destination, leaving those buffers empty.
+  void SortedGather(
+      std::vector<Compact>& sent,
+      std::vector<std::vector<std::vector<Compact>>>& outboxes,
+      const int chunk, std::vector<Msg>& msgs) const {
+    if constexpr (kCompact) {
+      thread_local std::vector<absl::Span<const Compact>> segments;
+      segments.clear();
+      if (!sent.empty()) segments.push_back(sent);
+      for (auto& outbox : outboxes) {
+        if (!outbox[chunk].empty()) segments.push_back(outbox[chunk]);
+      }
+      ThreadRadixDestSorter<Msg>().SortInto(
+          absl::MakeConstSpan(segments),
+          [this](const Compact& msg) {
+            return Codec::Decode(msg, chunker_.Uuid(GetDestId(msg)), epoch_);
+          },
+          &msgs);
+      sent.clear();
+      for (auto& outbox : outboxes) outbox[chunk].clear();
+    } else {
+      thread_local std::vector<std::vector<Msg>*> buffers;
+      thread_local std::vector<absl::Span<const Msg>> segments;
+      buffers.clear();
+      segments.clear();
+      if (!sent.empty()) buffers.push_back(&sent);
+      for (auto& outbox : outboxes) {
+        if (!outbox[chunk].empty()) buffers.push_back(&outbox[chunk]);
+      }
+      if (buffers.size() == 1) {
+        // Take the only buffer wholesale to avoid a copy.
+        msgs.swap(*buffers[0]);
+        RadixSortByDest(absl::MakeSpan(msgs));
+        return;
+      }
+      for (const std::vector<Msg>* const buffer : buffers) {
+        segments.push_back(*buffer);
+      }
+      ThreadRadixDestSorter<Msg>().SortInto(segments, &msgs);
+      for (std::vector<Msg>* const buffer : buffers) buffer->clear();
+    }
+  }
+
+  const Chunker<Entity>& chunker_;
+  const absl::Time epoch_;
+  Consumed consumed_;
+  absl::Mutex mu_;
+  bool sent_msgs_ = false;
+  std::vector<std::vector<Compact>> send_ ABSL_GUARDED_BY(mu_);
+  // consume_ is only modified under mu_ in Consume and Delete, between which
+  // Gather has exclusive access to consume_[chunk] and gathered_[chunk].
+  std::vector<std::vector<Compact>> consume_;
+  // The sorted messages of each consumed chunk.
+  std::vector<std::vector<Msg>> gathered_;
+  // Outbox buffers indexed by worker and then by chunk.
+  std::vector<std::vector<std::vector<Compact>>> outbox_send_;
+  std::vector<std::vector<std::vector<Compact>>> outbox_consume_;
+  std::vector<Outbox*> outboxes_;
+};
+
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_WORK_QUEUE_BROKER_H_
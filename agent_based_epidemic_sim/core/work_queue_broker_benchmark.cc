@@ -0,0 +1,153 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures a round of message passing through a WorkQueueBroker: range(1)
+// workers each send range(0) messages to random entities, and then the
+// messages are consumed chunk by chunk, also by range(1) workers.  The outbox
+// benchmark is run both with messages held as sent and in their compact
+// encoding.
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "agent_based_epidemic_sim/core/compact_message.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/work_queue_broker.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "benchmark/benchmark.h"
+
+namespace abesim {
+namespace {
+
+constexpr int kNumEntities = 1 << 16;
+constexpr int kChunkSize = 128;
+// Messages are sent in batches of this size, as agents send their visits.
+constexpr int kBatchSize = 4;
+
+class FakeEntity {
+ public:
+  explicit FakeEntity(const int64 uuid) : uuid_(uuid) {}
+  int64 uuid() const { return uuid_; }
+
+ private:
+  const int64 uuid_;
+};
+
+using ReportBroker = WorkQueueBroker<FakeEntity, ContactReport>;
+using CompactReportBroker =
+    WorkQueueBroker<FakeEntity, ContactReport, MessageCodec<ContactReport>>;
+
+// Runs rounds of sends and consumes, where send(worker, msgs) sends a batch of
+// messages on behalf of a worker.
+template <typename Broker, typename SendFn>
+void RunBrokerBenchmark(benchmark::State& state, Broker& broker,
+                        const Chunker<FakeEntity>& chunker, SendFn send) {
+  const int msgs_per_worker = state.range(0);
+  const int num_workers = state.range(1);
+  absl::BitGen gen;
+  std::vector<ContactReport> msgs(msgs_per_worker);
+  for (ContactReport& msg : msgs) {
+    msg.to_agent_uuid = absl::Uniform(gen, 0, kNumEntities);
+  }
+
+  auto executor = NewWorkStealingExecutor(num_workers);
+  for (auto _ : state) {
+    {
+      auto exec = executor->NewExecution();
+      for (int w = 0; w < num_workers; ++w) {
+        exec->Add([w, &msgs, &send]() {
+          for (int i = 0; i < msgs.size(); i += kBatchSize) {
+            send(w, absl::MakeConstSpan(msgs).subspan(i, kBatchSize));
+          }
+        });
+      }
+      exec->Wait();
+    }
+    auto consumed = broker.Consume();
+    std::atomic<int> next_chunk = 0;
+    auto exec = executor->NewExecution();
+    for (int w = 0; w < num_workers; ++w) {
+      exec->Add([&consumed, &chunker, &next_chunk]() {
+        while (true) {
+          const int chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+          if (chunk >= chunker.Chunks().size()) break;
+          benchmark::DoNotOptimize(consumed->Chunk(chunk).data());
+        }
+      });
+    }
+    exec->Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * msgs_per_worker * num_workers);
+}
+
+std::vector<std::unique_ptr<FakeEntity>> MakeEntities() {
+  std::vector<std::unique_ptr<FakeEntity>> entities;
+  for (int i = 0; i < kNumEntities; ++i) {
+    entities.push_back(absl::make_unique<FakeEntity>(i));
+  }
+  return entities;
+}
+
+template <typename Broker>
+void BM_WorkQueueBrokerOutboxSend(benchmark::State& state) {
+  const auto entities = MakeEntities();
+  Chunker<FakeEntity> chunker(entities, kChunkSize);
+  Broker broker(chunker);
+  std::vector<std::unique_ptr<typename Broker::Outbox>> outboxes;
+  for (int w = 0; w < state.range(1); ++w) {
+    outboxes.push_back(broker.NewOutbox());
+  }
+  RunBrokerBenchmark(state, broker, chunker,
+                     [&outboxes](const int worker,
+                                 absl::Span<const ContactReport> msgs) {
+                       outboxes[worker]->Send(msgs);
+                     });
+}
+
+void BM_WorkQueueBrokerLockedSend(benchmark::State& state) {
+  const auto entities = MakeEntities();
+  Chunker<FakeEntity> chunker(entities, kChunkSize);
+  ReportBroker broker(chunker);
+  RunBrokerBenchmark(state, broker, chunker,
+                     [&broker](int, absl::Span<const ContactReport> msgs) {
+                       broker.Send(msgs);
+                     });
+}
+
+void MessageVolumes(benchmark::internal::Benchmark* b) {
+  for (int num_workers : {1, 4, 16}) {
+    b->Args({1 << 16, num_workers});
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_WorkQueueBrokerOutboxSend, ReportBroker)
+    ->Apply(MessageVolumes)
+    ->ArgNames({"msgs", "workers"})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WorkQueueBrokerOutboxSend, CompactReportBroker)
+    ->Apply(MessageVolumes)
+    ->ArgNames({"msgs", "workers"})
+    ->UseRealTime();
+BENCHMARK(BM_WorkQueueBrokerLockedSend)
+    ->Apply(MessageVolumes)
+    ->ArgNames({"msgs", "workers"})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace abesim
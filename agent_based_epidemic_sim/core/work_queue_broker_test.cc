@@ -0,0 +1,281 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/work_queue_broker.h"
+
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/compact_message.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+using testing::UnorderedElementsAre;
+
+class FakeEntity {
+ public:
+  explicit FakeEntity(const int64 uuid) : uuid_(uuid) {}
+  int64 uuid() const { return uuid_; }
+
+ private:
+  const int64 uuid_;
+};
+
+// Entities with uuids 0, 10, 20, ...
+std::vector<std::unique_ptr<FakeEntity>> MakeEntities(const int n) {
+  std::vector<std::unique_ptr<FakeEntity>> entities;
+  for (int i = 0; i < n; ++i) {
+    entities.push_back(absl::make_unique<FakeEntity>(10 * i));
+  }
+  return entities;
+}
+
+ContactReport ReportTo(const int64 uuid) {
+  return {.from_agent_uuid = -1, .to_agent_uuid = uuid};
+}
+
+std::vector<int64> Uuids(const absl::Span<const std::unique_ptr<FakeEntity>>
+                             entities) {
+  std::vector<int64> uuids;
+  for (const auto& entity : entities) uuids.push_back(entity->uuid());
+  return uuids;
+}
+
+std::vector<int64> Recipients(const absl::Span<const ContactReport> reports) {
+  std::vector<int64> uuids;
+  for (const ContactReport& report : reports) {
+    uuids.push_back(report.to_agent_uuid);
+  }
+  return uuids;
+}
+
+TEST(ChunkerTest, SplitsEntitiesIntoChunks) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  ASSERT_EQ(chunker.Chunks().size(), 3);
+  EXPECT_THAT(Uuids(chunker.Chunks()[0]), ElementsAre(0, 10, 20, 30));
+  EXPECT_THAT(Uuids(chunker.Chunks()[2]), ElementsAre(80, 90));
+  EXPECT_EQ(chunker.Chunk(ReportTo(0)), 0);
+  EXPECT_EQ(chunker.Chunk(ReportTo(50)), 1);
+  EXPECT_EQ(chunker.Chunk(ReportTo(90)), 2);
+}
+
+TEST(ChunkerTest, RebalancesByRecordedLoad) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  // The first call only starts recording load.
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+  EXPECT_EQ(chunker.Chunks()[0].size(), 4);
+
+  std::vector<ContactReport> reports(100, ReportTo(0));
+  reports.push_back(ReportTo(10));
+  chunker.RecordLoad<ContactReport>(reports);
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+  ASSERT_EQ(chunker.Chunks().size(), 3);
+  EXPECT_THAT(Uuids(chunker.Chunks()[0]), ElementsAre(0));
+  EXPECT_EQ(chunker.Chunks()[1].size() + chunker.Chunks()[2].size(), 9);
+  EXPECT_EQ(chunker.Chunk(ReportTo(10)), 1);
+  EXPECT_EQ(chunker.Chunk(ReportTo(90)), 2);
+}
+
+TEST(ChunkerTest, RebalanceLeavesEveryChunkAnEntity) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+
+  // All of the load is on the last entity.
+  chunker.RecordLoad<ContactReport>(
+      std::vector<ContactReport>(1000, ReportTo(90)));
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+  ASSERT_EQ(chunker.Chunks().size(), 3);
+  EXPECT_THAT(Uuids(chunker.Chunks()[0]),
+              ElementsAre(0, 10, 20, 30, 40, 50, 60, 70));
+  EXPECT_THAT(Uuids(chunker.Chunks()[1]), ElementsAre(80));
+  EXPECT_THAT(Uuids(chunker.Chunks()[2]), ElementsAre(90));
+  EXPECT_EQ(chunker.Chunk(ReportTo(70)), 0);
+  EXPECT_EQ(chunker.Chunk(ReportTo(80)), 1);
+  EXPECT_EQ(chunker.Chunk(ReportTo(90)), 2);
+}
+
+TEST(ChunkerTest, RebalanceForgetsLoadRecordedBeforeIt) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+  chunker.RecordLoad<ContactReport>(
+      std::vector<ContactReport>(100, ReportTo(0)));
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+  EXPECT_EQ(chunker.Chunks()[0].size(), 1);
+
+  // With no further load every entity costs the same.
+  chunker.Rebalance([](int64 load) { return 1.0 + load; });
+  ASSERT_EQ(chunker.Chunks().size(), 3);
+  EXPECT_THAT(Uuids(chunker.Chunks()[0]), ElementsAre(0, 10, 20));
+  EXPECT_THAT(Uuids(chunker.Chunks()[1]), ElementsAre(30, 40, 50));
+  EXPECT_THAT(Uuids(chunker.Chunks()[2]), ElementsAre(60, 70, 80, 90));
+  EXPECT_EQ(chunker.Chunk(ReportTo(0)), 0);
+  EXPECT_EQ(chunker.Chunk(ReportTo(30)), 1);
+  EXPECT_EQ(chunker.Chunk(ReportTo(60)), 2);
+}
+
+TEST(WorkQueueBrokerTest, GathersMessagesByChunk) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  WorkQueueBroker<FakeEntity, ContactReport> broker(chunker);
+  auto outbox1 = broker.NewOutbox();
+  auto outbox2 = broker.NewOutbox();
+
+  broker.Send({ReportTo(0), ReportTo(90)});
+  outbox1->Send({ReportTo(10), ReportTo(50)});
+  outbox2->Send({ReportTo(20), ReportTo(40), ReportTo(80)});
+  {
+    auto consumed = broker.Consume();
+    EXPECT_THAT(Recipients(consumed->Chunk(0)),
+                UnorderedElementsAre(0, 10, 20));
+    EXPECT_THAT(Recipients(consumed->Chunk(1)), UnorderedElementsAre(40, 50));
+    EXPECT_THAT(Recipients(consumed->Chunk(2)), UnorderedElementsAre(80, 90));
+  }
+
+  // Messages are only delivered once.
+  outbox1->Send({ReportTo(30)});
+  auto consumed = broker.Consume();
+  EXPECT_THAT(Recipients(consumed->Chunk(0)), UnorderedElementsAre(30));
+  EXPECT_TRUE(consumed->Chunk(1).empty());
+  EXPECT_TRUE(consumed->Chunk(2).empty());
+}
+
+TEST(WorkQueueBrokerTest, OutboxesSendConcurrently) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  using ReportBroker = WorkQueueBroker<FakeEntity, ContactReport>;
+  ReportBroker broker(chunker);
+  constexpr int kWorkers = 4;
+  constexpr int kRounds = 100;
+  std::vector<std::unique_ptr<ReportBroker::Outbox>> outboxes;
+  for (int w = 0; w < kWorkers; ++w) outboxes.push_back(broker.NewOutbox());
+
+  auto executor = NewExecutor(kWorkers);
+  auto execution = executor->NewExecution();
+  for (auto& outbox : outboxes) {
+    execution->Add([&outbox]() {
+      for (int round = 0; round < kRounds; ++round) {
+        outbox->Send({ReportTo(0), ReportTo(50), ReportTo(90)});
+      }
+    });
+  }
+  execution->Wait();
+  EXPECT_EQ(broker.PendingMessages(), 3 * kWorkers * kRounds);
+
+  {
+    auto consumed = broker.Consume();
+    std::vector<int> sizes(chunker.Chunks().size());
+    auto gather = executor->NewExecution();
+    for (int chunk = 0; chunk < sizes.size(); ++chunk) {
+      gather->Add([&consumed, &sizes, chunk]() {
+        sizes[chunk] = consumed->Chunk(chunk).size();
+      });
+    }
+    gather->Wait();
+    EXPECT_THAT(sizes, ElementsAre(kWorkers * kRounds, kWorkers * kRounds,
+                                   kWorkers * kRounds));
+  }
+  EXPECT_EQ(broker.PendingMessages(), 0);
+}
+
+TEST(WorkQueueBrokerTest, OutboxSendsDuringConsumeAreDeliveredNextRound) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  WorkQueueBroker<FakeEntity, ContactReport> broker(chunker);
+  auto outbox = broker.NewOutbox();
+
+  outbox->Send({ReportTo(10)});
+  {
+    auto consumed = broker.Consume();
+    // Sent while the previous round is being consumed, as contact reports
+    // are.
+    outbox->Send({ReportTo(20)});
+    EXPECT_THAT(Recipients(consumed->Chunk(0)), ElementsAre(10));
+  }
+  auto consumed = broker.Consume();
+  EXPECT_THAT(Recipients(consumed->Chunk(0)), ElementsAre(20));
+}
+
+TEST(WorkQueueBrokerTest, SortsChunksByDestination) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  WorkQueueBroker<FakeEntity, ContactReport> broker(chunker);
+  auto outbox1 = broker.NewOutbox();
+  auto outbox2 = broker.NewOutbox();
+
+  broker.Send({ReportTo(10), ReportTo(90)});
+  outbox1->Send({ReportTo(30), ReportTo(0), ReportTo(20)});
+  outbox2->Send({ReportTo(10), ReportTo(80), ReportTo(50), ReportTo(40)});
+  {
+    auto consumed = broker.Consume();
+    EXPECT_THAT(Recipients(consumed->Chunk(0)), ElementsAre(0, 10, 10, 20, 30));
+    EXPECT_THAT(Recipients(consumed->Chunk(1)), ElementsAre(40, 50));
+    EXPECT_THAT(Recipients(consumed->Chunk(2)), ElementsAre(80, 90));
+  }
+
+  outbox1->Send({ReportTo(30), ReportTo(0)});
+  outbox2->Send({ReportTo(20)});
+  outbox2->Send({ReportTo(50), ReportTo(40)});
+  EXPECT_THAT(Recipients(*broker.ConsumeChunk(0)), ElementsAre(0, 20, 30));
+  EXPECT_THAT(Recipients(*broker.ConsumeChunk(1)), ElementsAre(40, 50));
+  EXPECT_EQ(broker.PendingMessages(), 0);
+}
+
+TEST(WorkQueueBrokerTest, DeliversMessagesAsSent) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  WorkQueueBroker<FakeEntity, ContactReport> broker(chunker);
+  ContactReport report = ReportTo(10);
+  report.test_result.time_received =
+      absl::UnixEpoch() + absl::Milliseconds(1400);
+
+  broker.Send({report});
+  auto consumed = broker.Consume();
+  EXPECT_THAT(consumed->Chunk(0), ElementsAre(report));
+}
+
+TEST(WorkQueueBrokerTest, CompactCodecRoundsTimesToSeconds) {
+  const auto entities = MakeEntities(10);
+  Chunker<FakeEntity> chunker(entities, 4);
+  const absl::Time epoch = absl::UnixEpoch() + absl::Hours(1);
+  WorkQueueBroker<FakeEntity, ContactReport, MessageCodec<ContactReport>>
+      broker(chunker, epoch);
+  auto outbox = broker.NewOutbox();
+  ContactReport report = ReportTo(90);
+  report.test_result.time_received = epoch + absl::Milliseconds(1400);
+
+  broker.Send({report, ReportTo(50)});
+  outbox->Send({ReportTo(40)});
+  auto consumed = broker.Consume();
+  EXPECT_THAT(Recipients(consumed->Chunk(1)), ElementsAre(40, 50));
+  const absl::Span<ContactReport> last_chunk = consumed->Chunk(2);
+  ASSERT_EQ(last_chunk.size(), 1);
+  EXPECT_EQ(last_chunk[0].to_agent_uuid, 90);
+  EXPECT_EQ(last_chunk[0].test_result.time_received, epoch + absl::Seconds(1));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -14,7 +14,10 @@
 
 #include "agent_based_epidemic_sim/port/executor.h"
 
+#include <atomic>
+#include <deque>
 #include <thread>  // NOLINT: Open source only.
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
@@ -22,28 +25,12 @@
 namespace abesim {
 namespace {
 
-class StdThreadExecutor : public Executor {
- public:
-  explicit StdThreadExecutor(int workers);
-  std::unique_ptr<Execution> NewExecution() override;
-
-  ~StdThreadExecutor() override;
-
- private:
-  absl::Mutex mu_;
-
-  friend class StdThreadExecution;
-  void Add(std::function<void()> fn) ABSL_LOCKS_EXCLUDED(mu_);
-  bool Ready() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
-  std::vector<std::thread> threads_;
-  bool done_ GUARDED_BY(mu_) = false;
-  std::vector<std::function<void()> > work_ GUARDED_BY(mu_);
-};
-
-class StdThreadExecution : public Execution {
+// CountingExecution tracks the functions it adds to an executor so that it can
+// wait for all of them to finish.
+template <typename ExecutorType>
+class CountingExecution : public Execution {
  public:
-  explicit StdThreadExecution(StdThreadExecutor& executor)
-      : executor_(executor) {}
+  explicit CountingExecution(ExecutorType& executor) : executor_(executor) {}
   void Add(std::function<void()> fn) override {
     {
       absl::MutexLock l(&mu_);
@@ -58,12 +45,12 @@ class StdThreadExecution : public Execution {
     });
   }
   void Wait() override {
-    mu_.LockWhen(absl::Condition(this, &StdThreadExecution::AllFinished));
+    mu_.LockWhen(absl::Condition(this, &CountingExecution::AllFinished));
     mu_.Unlock();
   }
 
  private:
-  StdThreadExecutor& executor_;
+  ExecutorType& executor_;
   absl::Mutex mu_;
   bool AllFinished() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     return started_ == finished_;
@@ -72,6 +59,24 @@ class StdThreadExecution : public Execution {
   int finished_ ABSL_GUARDED_BY(mu_) = 0;
 };
 
+class StdThreadExecutor : public Executor {
+ public:
+  explicit StdThreadExecutor(int workers);
+  std::unique_ptr<Execution> NewExecution() override;
+
+  ~StdThreadExecutor() override;
+
+ private:
+  absl::Mutex mu_;
+
+  friend class CountingExecution<StdThreadExecutor>;
+  void Add(std::function<void()> fn) ABSL_LOCKS_EXCLUDED(mu_);
+  bool Ready() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  std::vector<std::thread> threads_;
+  bool done_ GUARDED_BY(mu_) = false;
+  std::vector<std::function<void()> > work_ GUARDED_BY(mu_);
+};
+
 StdThreadExecutor::StdThreadExecutor(const int workers) {
   for (int i = 0; i < workers; ++i) {
     threads_.push_back(std::thread([this]() {
@@ -108,7 +113,117 @@ void StdThreadExecutor::Add(std::function<void()> fn) {
 }
 
 std::unique_ptr<Execution> StdThreadExecutor::NewExecution() {
-  return absl::make_unique<StdThreadExecution>(*this);
+  return absl::make_unique<CountingExecution<StdThreadExecutor>>(*this);
+}
+
+// WorkStealingExecutor gives each thread its own deque of work.  Threads run
+// work from the back of their own deque, and when it is empty steal work from
+// the front of other threads' deques.  Work added from one of the executor's
+// own threads goes on that thread's deque, other work is spread round robin.
+// Each deque has its own lock, so threads only contend when stealing.
+class WorkStealingExecutor : public Executor {
+ public:
+  explicit WorkStealingExecutor(int workers);
+  std::unique_ptr<Execution> NewExecution() override;
+
+  ~WorkStealingExecutor() override;
+
+ private:
+  struct alignas(64) WorkQueue {
+    absl::Mutex mu;
+    std::deque<std::function<void()>> work ABSL_GUARDED_BY(mu);
+  };
+
+  friend class CountingExecution<WorkStealingExecutor>;
+  void Add(std::function<void()> fn);
+  bool TryRunOne(int worker);
+  bool Ready() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return done_ || pending_.load(std::memory_order_acquire) > 0;
+  }
+
+  // The executor and queue index of the executor thread running the current
+  // code, if any.
+  static thread_local const WorkStealingExecutor* current_executor_;
+  static thread_local int current_worker_;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<int> next_queue_{0};
+  // The number of functions queued but not yet started.
+  std::atomic<int> pending_{0};
+  // mu_ is only used to put idle threads to sleep and wake them up.
+  absl::Mutex mu_;
+  bool done_ ABSL_GUARDED_BY(mu_) = false;
+};
+
+thread_local const WorkStealingExecutor*
+    WorkStealingExecutor::current_executor_ = nullptr;
+thread_local int WorkStealingExecutor::current_worker_ = -1;
+
+WorkStealingExecutor::WorkStealingExecutor(const int workers) {
+  for (int i = 0; i < workers; ++i) {
+    queues_.push_back(absl::make_unique<WorkQueue>());
+  }
+  for (int i = 0; i < workers; ++i) {
+    threads_.push_back(std::thread([this, i]() {
+      current_executor_ = this;
+      current_worker_ = i;
+      while (true) {
+        if (TryRunOne(i)) continue;
+        absl::MutexLock l(&mu_);
+        mu_.Await(absl::Condition(this, &WorkStealingExecutor::Ready));
+        if (done_ && pending_.load(std::memory_order_acquire) == 0) return;
+      }
+    }));
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+  {
+    absl::MutexLock l(&mu_);
+    done_ = true;
+  }
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkStealingExecutor::Add(std::function<void()> fn) {
+  const int queue = current_executor_ == this
+                        ? current_worker_
+                        : next_queue_.fetch_add(1, std::memory_order_relaxed) %
+                              queues_.size();
+  {
+    absl::MutexLock l(&queues_[queue]->mu);
+    queues_[queue]->work.push_back(std::move(fn));
+  }
+  pending_.fetch_add(1, std::memory_order_release);
+  // Wake any sleeping threads so they can reevaluate Ready.
+  absl::MutexLock l(&mu_);
+}
+
+bool WorkStealingExecutor::TryRunOne(const int worker) {
+  std::function<void()> work;
+  for (int i = 0; i < queues_.size() && !work; ++i) {
+    WorkQueue& queue = *queues_[(worker + i) % queues_.size()];
+    absl::MutexLock l(&queue.mu);
+    if (queue.work.empty()) continue;
+    if (i == 0) {
+      work = std::move(queue.work.back());
+      queue.work.pop_back();
+    } else {
+      work = std::move(queue.work.front());
+      queue.work.pop_front();
+    }
+  }
+  if (!work) return false;
+  pending_.fetch_sub(1, std::memory_order_acq_rel);
+  work();
+  return true;
+}
+
+std::unique_ptr<Execution> WorkStealingExecutor::NewExecution() {
+  return absl::make_unique<CountingExecution<WorkStealingExecutor>>(*this);
 }
 
 }  // namespace
@@ -117,4 +232,8 @@ std::unique_ptr<Executor> NewExecutor(int max_parallelism) {
   return absl::make_unique<StdThreadExecutor>(max_parallelism);
 }
 
+std::unique_ptr<Executor> NewWorkStealingExecutor(int max_parallelism) {
+  return absl::make_unique<WorkStealingExecutor>(max_parallelism);
+}
+
 }  // namespace abesim
@@ -46,6 +46,11 @@ class Executor {
 
 std::unique_ptr<Executor> NewExecutor(int max_parallelism);
 
+// Creates an executor whose threads each keep their own queue of work and
+// steal from each other when idle.  Functions added from within a running
+// function are queued on the current thread, which keeps nested work local.
+std::unique_ptr<Executor> NewWorkStealingExecutor(int max_parallelism);
+
 }  // namespace abesim
 
 #endif  // AGENT_BASED_EPIDEMIC_SIM_PORT_EXECUTOR_H_
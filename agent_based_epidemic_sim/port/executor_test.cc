@@ -0,0 +1,81 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/executor.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using ExecutorFactory = std::function<std::unique_ptr<Executor>(int)>;
+
+class ExecutorTest : public testing::TestWithParam<ExecutorFactory> {};
+
+TEST_P(ExecutorTest, RunsAllAddedFunctions) {
+  auto executor = GetParam()(4);
+  std::atomic<int> count = 0;
+  for (int round = 0; round < 10; ++round) {
+    auto execution = executor->NewExecution();
+    for (int i = 0; i < 100; ++i) {
+      execution->Add([&count]() { count++; });
+    }
+    execution->Wait();
+    EXPECT_EQ(count, 100 * (round + 1));
+  }
+}
+
+TEST_P(ExecutorTest, RunsFunctionsAddedFromWorkers) {
+  auto executor = GetParam()(3);
+  std::atomic<int> count = 0;
+  auto outer = executor->NewExecution();
+  auto inner = executor->NewExecution();
+  for (int i = 0; i < 8; ++i) {
+    outer->Add([&inner, &count]() {
+      for (int j = 0; j < 16; ++j) {
+        inner->Add([&count]() { count++; });
+      }
+    });
+  }
+  outer->Wait();
+  inner->Wait();
+  EXPECT_EQ(count, 8 * 16);
+}
+
+TEST_P(ExecutorTest, SupportsConcurrentExecutions) {
+  auto executor = GetParam()(2);
+  std::atomic<int> first = 0;
+  std::atomic<int> second = 0;
+  auto first_execution = executor->NewExecution();
+  auto second_execution = executor->NewExecution();
+  for (int i = 0; i < 50; ++i) {
+    first_execution->Add([&first]() { first++; });
+    second_execution->Add([&second]() { second++; });
+  }
+  first_execution->Wait();
+  second_execution->Wait();
+  EXPECT_EQ(first, 50);
+  EXPECT_EQ(second, 50);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllExecutors, ExecutorTest,
+                         testing::Values(NewExecutor,
+                                         NewWorkStealingExecutor));
+
+}  // namespace
+}  // namespace abesim
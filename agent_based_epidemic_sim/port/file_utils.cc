@@ -37,6 +37,13 @@ class FileWriterImpl : public FileWriter {
     return absl::Status(absl::StatusCode::kUnavailable, "Failed to write.");
   }
 
+  absl::Status Flush() override {
+    if (!ofstream_.flush()) {
+      return absl::Status(absl::StatusCode::kUnknown, "Failed to flush.");
+    }
+    return absl::OkStatus();
+  }
+
   absl::Status Close() override {
     ofstream_.close();
     if (ofstream_.is_open()) {
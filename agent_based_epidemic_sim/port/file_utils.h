@@ -30,6 +30,8 @@ class FileWriter {
   virtual ~FileWriter() = default;
   // Writes a string to file.
   virtual absl::Status WriteString(absl::string_view content) = 0;
+  // Writes any buffered content through to the file.
+  virtual absl::Status Flush() = 0;
   // Must be called before destroying the object.
   virtual absl::Status Close() = 0;
 };